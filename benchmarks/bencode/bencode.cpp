@@ -0,0 +1,103 @@
+#include <generic/bencode_map.hpp>
+#include <generic/bencode_view.hpp>
+#include <generic/bencode_scan.hpp>
+#include <generic/bencode_writer.hpp>
+#include <functional>
+#include <cassert>
+#include <chrono>
+#include <format>
+#include <print>
+
+#define BENCHMARK_NAME "generic/bencode"
+#define BENCHMARK_PIECES 100000
+#define BENCHMARK_FILES 5000
+#define BENCHMARK_ROUNDS 20
+
+/* synthetic multi-file torrent, a large pieces blob
+ * and many small file dictionaries */
+static std::vector<std::byte> synthetic_torrent()
+{
+    std::vector<std::byte> buffer;
+    std::vector<std::byte> pieces(BENCHMARK_PIECES * 20);
+    for (size_t i = 0; i < pieces.size(); ++i)
+        pieces[i] = (std::byte)(i * 131);
+
+    bencode_writer writer(buffer);
+    writer.begin_dictionary()
+        .key("announce").string("udp://tracker.example.org:6969")
+        .key("info").begin_dictionary()
+            .key("name").string("synthetic")
+            .key("piece length").integer(262144)
+            .key("pieces").string(pieces)
+            .key("files").begin_list();
+
+    for (size_t i = 0; i < BENCHMARK_FILES; ++i) {
+        writer.begin_dictionary()
+            .key("length").integer(1048576 + i)
+            .key("path").begin_list()
+                .string("directory")
+                .string(std::format("file_{}.bin", i))
+            .end()
+        .end();
+    }
+
+    writer.end().end().end();
+    assert(writer.finish().has_value());
+    return buffer;
+}
+
+static void run(const char* name, std::span<const std::byte> data,
+    const std::function<void()>& parse)
+{
+    parse();
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < BENCHMARK_ROUNDS; ++i)
+        parse();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    double megabytes = (double)data.size() * BENCHMARK_ROUNDS / (1024 * 1024);
+    std::println("  {:<28} {:>10.1f} MB/s", name, megabytes / seconds);
+}
+
+int main()
+{
+    std::println("benchmark: {}", BENCHMARK_NAME);
+
+    auto torrent = synthetic_torrent();
+    std::span<const std::byte> data = torrent;
+    std::println("  input {} bytes, {} pieces, {} files",
+        data.size(), BENCHMARK_PIECES, BENCHMARK_FILES);
+
+    run("bencode_map", data, [&]() {
+        bencode_map bencode;
+        bencode.from_buffer(data);
+        assert(bencode["info"]["piece length"].as_int() == 262144);
+    });
+
+    run("bencode_map (arena)", data, [&]() {
+        bencode_map bencode;
+        bencode.use_arena();
+        bencode.from_buffer(data);
+        assert(bencode["info"]["piece length"].as_int() == 262144);
+    });
+
+    const std::pair<bencode_scan::simd_level, const char*> levels[] = {
+        { bencode_scan::simd_level::avx2, "bencode_view (avx2)" },
+        { bencode_scan::simd_level::sse2, "bencode_view (sse2)" },
+        { bencode_scan::simd_level::scalar, "bencode_view (scalar)" },
+    };
+
+    for (const auto& [level, name] : levels) {
+        if (level > bencode_scan::detect_level())
+            continue;
+        bencode_scan::set_level(level);
+        run(name, data, [&]() {
+            bencode_view bencode;
+            bencode.from_buffer(data);
+            assert(bencode["info"]["piece length"].as_int() == 262144);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <string_view>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include <span>
+
+/* Resumable bencode decoder, input is fed in chunks as it arrives
+ * and values are reported through a handler as soon as they are
+ * decoded. Strings are reported in chunks pointing into the fed
+ * buffer, so large strings (ex. compact peer lists) are never
+ * buffered. Dictionary keys are the only data kept by the decoder. */
+class bencode_decoder {
+public:
+    enum class status {
+        need_more_bytes = 0,
+        complete = 1,
+        error = 2,
+    };
+
+    enum class event_type {
+        integer = 0,
+        string = 1,
+        list_begin = 2,
+        dictionary_begin = 3,
+        end = 4,
+    };
+
+    struct event {
+        event_type type {};
+        /* depth of the value, the root value is at depth 0 */
+        size_t depth {};
+        /* dictionary key of the value, empty inside lists */
+        std::string_view key {};
+        int64_t integer {};
+        /* string chunk, offset of the chunk within the string,
+         * total string length and whether it is the last chunk */
+        std::span<const std::byte> data {};
+        size_t offset {};
+        size_t length {};
+        bool last {};
+    };
+
+    using handler = std::function<void(const event&)>;
+
+private:
+    static constexpr size_t max_key_length = 65536;
+
+    enum class states {
+        value = 0,
+        integer = 1,
+        string_length = 2,
+        string = 3,
+        done = 4,
+        failed = 5,
+    };
+
+    struct frame {
+        bool dictionary {};
+        size_t children {};
+        std::string key {};
+    };
+
+    states m_state { states::value };
+    std::vector<frame> m_frames {};
+    handler m_handler {};
+    const char* m_error = nullptr;
+    size_t m_consumed = 0;
+
+    bool m_negative = false;
+    size_t m_digits = 0;
+    uint64_t m_integer = 0;
+    size_t m_string_length = 0;
+    size_t m_string_offset = 0;
+
+    bool parsing_key() const
+    {
+        return !m_frames.empty()
+            && m_frames.back().dictionary
+            && m_frames.back().children % 2 == 0;
+    }
+
+    std::string_view current_key() const
+    {
+        if (m_frames.empty() || !m_frames.back().dictionary)
+            return {};
+        return m_frames.back().key;
+    }
+
+    void emit(event e)
+    {
+        e.depth = m_frames.size();
+        e.key = current_key();
+        if (m_handler) m_handler(e);
+    }
+
+    status fail(const char* error)
+    {
+        m_error = error;
+        m_state = states::failed;
+        return status::error;
+    }
+
+    void finish_value()
+    {
+        if (m_frames.empty()) {
+            m_state = states::done;
+            return;
+        }
+        m_frames.back().children++;
+        m_state = states::value;
+    }
+
+    status consume_value(char c)
+    {
+        if (c == 'e') {
+            if (m_frames.empty())
+                return fail("bencode decoder: unexpected end of container");
+            if (m_frames.back().dictionary && m_frames.back().children % 2)
+                return fail("bencode decoder: dictionary key without value");
+            m_frames.pop_back();
+            emit({ event_type::end });
+            finish_value();
+            return status::need_more_bytes;
+        }
+
+        if (c >= '0' && c <= '9') {
+            m_string_length = c - '0';
+            m_state = states::string_length;
+            return status::need_more_bytes;
+        }
+
+        if (parsing_key())
+            return fail("bencode decoder: dictionary key is not a string");
+
+        switch (c) {
+        case 'i':
+            m_negative = false;
+            m_digits = 0;
+            m_integer = 0;
+            m_state = states::integer;
+            break;
+        case 'l':
+        case 'd':
+            emit({ (c == 'l') ? event_type::list_begin : event_type::dictionary_begin });
+            m_frames.push_back({ c == 'd' });
+            m_frames.back().key.reserve(32);
+            break;
+        default:
+            return fail("bencode decoder: unexpected byte");
+        }
+
+        return status::need_more_bytes;
+    }
+
+    status consume_integer(char c)
+    {
+        if (c == '-' && !m_negative && !m_digits) {
+            m_negative = true;
+        } else if (c >= '0' && c <= '9') {
+            if (m_integer > ((uint64_t)std::numeric_limits<int64_t>::max() - (c - '0')) / 10)
+                return fail("bencode decoder: integer overflow");
+            m_integer = m_integer * 10 + (c - '0');
+            m_digits++;
+        } else if (c == 'e' && m_digits) {
+            event e { event_type::integer };
+            e.integer = m_negative ? -(int64_t)m_integer : (int64_t)m_integer;
+            emit(e);
+            finish_value();
+        } else {
+            return fail("bencode decoder: invalid integer");
+        }
+
+        return status::need_more_bytes;
+    }
+
+    status consume_string_length(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            if (m_string_length > (std::numeric_limits<uint32_t>::max() - (c - '0')) / 10)
+                return fail("bencode decoder: string length overflow");
+            m_string_length = m_string_length * 10 + (c - '0');
+            return status::need_more_bytes;
+        }
+
+        if (c != ':')
+            return fail("bencode decoder: invalid string length");
+
+        m_string_offset = 0;
+        if (parsing_key()) {
+            if (m_string_length > max_key_length)
+                return fail("bencode decoder: dictionary key too long");
+            m_frames.back().key.clear();
+        }
+
+        m_state = states::string;
+        if (!m_string_length)
+            consume_string({});
+        return status::need_more_bytes;
+    }
+
+    /* consumes as much of the string payload as the chunk holds */
+    size_t consume_string(std::span<const std::byte> chunk)
+    {
+        size_t size = std::min(chunk.size(), m_string_length - m_string_offset);
+        auto payload = chunk.first(size);
+        bool last = (m_string_offset + size == m_string_length);
+
+        if (parsing_key()) {
+            m_frames.back().key.append((const char*)payload.data(), payload.size());
+        } else {
+            event e { event_type::string };
+            e.data = payload;
+            e.offset = m_string_offset;
+            e.length = m_string_length;
+            e.last = last;
+            emit(e);
+        }
+
+        m_string_offset += size;
+        if (last) finish_value();
+        return size;
+    }
+
+public:
+    bencode_decoder() {}
+    ~bencode_decoder() {}
+
+    void set_handler(const handler& h) { m_handler = h; }
+
+    void reset()
+    {
+        m_state = states::value;
+        m_frames.clear();
+        m_error = nullptr;
+        m_consumed = 0;
+    }
+
+    status feed(std::span<const std::byte> chunk)
+    {
+        size_t i = 0;
+        while (i < chunk.size()) {
+            if (m_state == states::done) break;
+            if (m_state == states::failed) return status::error;
+
+            if (m_state == states::string) {
+                i += consume_string(chunk.subspan(i));
+                continue;
+            }
+
+            char c = (char)chunk[i++];
+            status result = status::need_more_bytes;
+            switch (m_state) {
+            case states::value:
+                result = consume_value(c);
+                break;
+            case states::integer:
+                result = consume_integer(c);
+                break;
+            case states::string_length:
+                result = consume_string_length(c);
+                break;
+            default:
+                break;
+            }
+
+            if (result == status::error)
+                return result;
+        }
+
+        m_consumed += i;
+        return state();
+    }
+
+    status state() const
+    {
+        if (m_state == states::done) return status::complete;
+        if (m_state == states::failed) return status::error;
+        return status::need_more_bytes;
+    }
+
+    const char* error() const { return m_error; }
+    size_t consumed() const { return m_consumed; }
+};
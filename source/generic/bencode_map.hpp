@@ -1,10 +1,16 @@
 #pragma once
 
+#include <memory_resource>
 #include <unordered_map>
+#include <string_view>
 #include <ctype.h>
+#include <limits>
+#include <algorithm>
 #include <expected>
 #include <cassert>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include <span>
 
@@ -36,69 +42,159 @@ private:
         parsing_integer = 5,
     };
 
+    struct string_hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const
+            { return std::hash<std::string_view>{}(s); }
+    };
+
+    /* all containers of a target share one memory resource, children
+     * are constructed in place inside their parent's containers */
     struct target {
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
         target_type type { target_type::unknown };
-        std::string string_value {};
+        std::pmr::string string_value;
         int64_t integer_value {};
-        std::vector<target> list_container {};
-        std::unordered_map<std::string, target> map_container {};
-        std::string latest_key {};
-        std::vector<std::byte> raw_bencode {};
+        std::pmr::vector<target> list_container;
+        std::pmr::unordered_map<std::pmr::string, target,
+            string_hash, std::equal_to<>> map_container;
+        std::pmr::string latest_key;
+        bool has_latest_key {};
+        size_t source_begin {};
+        size_t source_end {};
+
+        target(target_type t = target_type::unknown, const allocator_type& allocator = {})
+            : type(t),
+            string_value(allocator),
+            list_container(allocator),
+            map_container(allocator),
+            latest_key(allocator) {}
+
+        target(const target& other, const allocator_type& allocator)
+            : type(other.type),
+            string_value(other.string_value, allocator),
+            integer_value(other.integer_value),
+            list_container(other.list_container, allocator),
+            map_container(other.map_container, allocator),
+            latest_key(other.latest_key, allocator),
+            has_latest_key(other.has_latest_key),
+            source_begin(other.source_begin),
+            source_end(other.source_end) {}
+
+        target(target&& other, const allocator_type& allocator)
+            : type(other.type),
+            string_value(std::move(other.string_value), allocator),
+            integer_value(other.integer_value),
+            list_container(std::move(other.list_container), allocator),
+            map_container(std::move(other.map_container), allocator),
+            latest_key(std::move(other.latest_key), allocator),
+            has_latest_key(other.has_latest_key),
+            source_begin(other.source_begin),
+            source_end(other.source_end) {}
+
+        target(const target&) = default;
+        target(target&&) = default;
+        target& operator=(const target&) = default;
+        target& operator=(target&&) = default;
     };
 
     states m_previous_state { states::unknown };
     states m_state { states::unknown };
     size_t m_element_length = 0;
-    bool m_store_raw_bencode = false;
+    size_t m_element_begin = 0;
+    size_t m_offset = 0;
+    std::span<const std::byte> m_source {};
     std::string m_element {};
-    std::string m_element_length_string {};
+    int64_t m_integer = 0;
+    bool m_integer_negative = false;
+    bool m_failed = false;
     std::vector<target*> m_target_queue;
+    std::shared_ptr<std::pmr::monotonic_buffer_resource> m_arena {};
+    bool m_use_arena = false;
     const target* m_bracket_root {};
     target m_root {};
 
+    static const target& missing_target()
+    {
+        static const target missing {};
+        return missing;
+    }
+
+    target::allocator_type allocator()
+    {
+        if (m_arena) return m_arena.get();
+        return std::pmr::get_default_resource();
+    }
+
 protected:
     bool can_have_children(const target_type& type)
     {
         return (type == target_type::dictionaries || type == target_type::lists);
     }
 
-    void push_to_target(const target& child_target)
+    /* constructs the child in place inside its parent, returns
+     * nullptr if the child was consumed as a dictionary key */
+    target* push_to_target(const target_type& type, std::string_view string_value = {})
     {
         if (m_target_queue.size() == 0) {
-            m_root = child_target;
-            if (can_have_children(child_target.type))
+            /* the root is rebuilt in place so it uses the current allocator */
+            std::destroy_at(&m_root);
+            std::construct_at(&m_root, type, allocator());
+            if (can_have_children(type))
                 m_target_queue.push_back(&m_root);
-            return;
+            return &m_root;
         }
 
         target* parent_target = m_target_queue.back();
+        target* child_target = nullptr;
 
-        if (parent_target->type == target_type::lists) {
-            parent_target->list_container.push_back(child_target);
-            if (can_have_children(child_target.type))
-                m_target_queue.push_back(&parent_target->list_container.back());
-        }
+        if (parent_target->type == target_type::lists)
+            child_target = &parent_target->list_container.emplace_back(type);
 
         if (parent_target->type == target_type::dictionaries) {
-            std::string key = parent_target->latest_key;
-            if (key.empty()) {
-                if (child_target.type != target_type::strings) return;
-                parent_target->latest_key = child_target.string_value;
-            } else {
-                parent_target->map_container[key] = child_target;
-                parent_target->latest_key = {};
+            if (!parent_target->has_latest_key) {
+                if (type != target_type::strings) return nullptr;
+                parent_target->latest_key.assign(string_value);
+                parent_target->has_latest_key = true;
+                return nullptr;
             }
 
-            if (can_have_children(child_target.type)) {
-                m_target_queue.push_back(
-                    &parent_target->map_container[key]
-                );
-            }
+            auto [it, inserted] = parent_target->map_container.try_emplace(
+                parent_target->latest_key, type);
+            if (!inserted)
+                it->second = target(type, allocator());
+            parent_target->has_latest_key = false;
+            child_target = &it->second;
         }
+
+        if (child_target && can_have_children(type))
+            m_target_queue.push_back(child_target);
+        return child_target;
+    }
+
+    void push_scalar(const target_type& type, std::string_view string_value = {},
+        int64_t integer_value = 0)
+    {
+        target* scalar = push_to_target(type, string_value);
+        if (!scalar) return;
+        scalar->string_value.assign(string_value);
+        scalar->integer_value = integer_value;
+        scalar->source_begin = m_element_begin;
+        scalar->source_end = m_offset + 1;
+    }
+
+    void push_container(const target_type& type)
+    {
+        target* container = push_to_target(type);
+        if (!container) return;
+        container->source_begin = m_offset;
     }
 
     void end_target()
     {
+        if (m_target_queue.empty()) return;
+        m_target_queue.back()->source_end = m_offset + 1;
         m_target_queue.pop_back();
     }
 
@@ -108,18 +204,23 @@ protected:
         m_state = new_state;
 
         if (m_previous_state == states::parsing_word_length) {
-            m_element_length = std::stol(m_element_length_string);
-            m_element_length_string = "";
+            /* zero length string, there is no payload to consume */
+            if (m_state == states::parsing_word && !m_element_length) {
+                push_scalar(target_type::strings);
+                m_state = states::unknown;
+            }
+            /* the length prefix is untrusted, never reserve past the input */
+            m_element.reserve(std::min(m_element_length, m_source.size() - m_offset));
         }
 
         if (m_previous_state == states::parsing_word) {
-            push_to_target({ target_type::strings, m_element });
-            m_element = "";
+            push_scalar(target_type::strings, m_element);
+            m_element.clear();
         }
 
         if (m_previous_state == states::parsing_integer) {
-            push_to_target({ target_type::integers, {}, std::stol(m_element) });
-            m_element = "";
+            push_scalar(target_type::integers, {},
+                m_integer_negative ? -m_integer : m_integer);
         }
     }
     
@@ -128,14 +229,17 @@ protected:
         m_state = states::unknown;
         switch ((encoding)c) {
         case encoding::integers:
+            m_element_begin = m_offset;
+            m_integer = 0;
+            m_integer_negative = false;
             m_state = states::parsing_integer;
             break;
         case encoding::lists:
-            push_to_target({ target_type::lists });
+            push_container(target_type::lists);
             m_state = states::parsing_list;
             break;
         case encoding::dictionaries:
-            push_to_target({ target_type::dictionaries });
+            push_container(target_type::dictionaries);
             m_state = states::parsing_dictionary;
             break;
         case encoding::ending:
@@ -146,29 +250,32 @@ protected:
             break;
         default:
             if (isdigit((int)c)) {
+                m_element_begin = m_offset;
                 m_state = states::parsing_word_length;
-                m_element_length_string += (char)c;
+                m_element_length = (char)c - '0';
             }
             break;
         }
     }
 
-    void push_raw_bencode(const std::byte& c)
+    /* malformed input, parsing stops and the result is empty */
+    void fail()
     {
-        for (const auto& target : m_target_queue)
-            target->raw_bencode.push_back(c);
+        m_failed = true;
+        m_state = states::unknown;
     }
 
     void consume_byte(const std::byte& c)
     {
-        if (m_store_raw_bencode)
-            push_raw_bencode(c);
-
         switch (m_state) {
         case states::parsing_integer:
-            if (!isdigit((char)c) && (char)c != '-')
-                { return switch_state(states::unknown); }
-            m_element += (char)c;
+            /* a sign only right after the 'i' */
+            if ((char)c == '-' && m_offset == m_element_begin + 1) { m_integer_negative = true; break; }
+            if ((char)c == '-') { return fail(); }
+            if (!isdigit((char)c)) { return switch_state(states::unknown); }
+            if (m_integer > (std::numeric_limits<int64_t>::max() - ((char)c - '0')) / 10)
+                return fail();
+            m_integer = m_integer * 10 + ((char)c - '0');
             break;
 
         case states::parsing_word:
@@ -179,7 +286,7 @@ protected:
 
         case states::parsing_word_length:
             if (!isdigit((char)c)) { return switch_state(states::parsing_word); }
-            m_element_length_string += (char)c;
+            m_element_length = m_element_length * 10 + ((char)c - '0');
             break;
 
         case states::parsing_list:
@@ -196,24 +303,52 @@ public:
     bencode_map() {}
     ~bencode_map() {}
 
-    void store_raw_bencode() { m_store_raw_bencode = true; }
+    /* keep all nodes, keys and strings of the next parse in one
+     * monotonic arena, released at once with the bencode_map */
+    void use_arena() { m_use_arena = true; }
 
-    bencode_map& from_buffer(std::span<std::byte> data)
+    bencode_map& from_buffer(std::span<const std::byte> data)
     {
-        for (const auto& e : data) {
-            consume_byte(e);
+        if (m_use_arena) {
+            m_target_queue.clear();
+            m_bracket_root = nullptr;
+            std::destroy_at(&m_root);
+            std::construct_at(&m_root);
+            /* strings take about the input size, the arena
+             * grows geometrically from there for the nodes */
+            m_arena = std::make_shared<std::pmr::monotonic_buffer_resource>(
+                std::max<size_t>(data.size(), 1024));
+        }
+
+        m_source = data;
+        m_failed = false;
+        for (m_offset = 0; m_offset < data.size() && !m_failed; ++m_offset) {
+            /* copy string payloads in one jump, the last byte still
+             * goes through consume_byte() to finish the string */
+            if (m_state == states::parsing_word && m_element_length > 1) {
+                size_t run = std::min(m_element_length - 1, data.size() - m_offset);
+                m_element.append((const char*)data.data() + m_offset, run);
+                m_element_length -= run;
+                m_offset += run;
+                if (m_offset >= data.size()) break;
+            }
+            consume_byte(data[m_offset]);
+        }
+        if (m_failed) {
+            m_target_queue.clear();
+            std::destroy_at(&m_root);
+            std::construct_at(&m_root);
         }
         m_bracket_root = &m_root;
         return *this;
     }
 
+    /* the last from_buffer() stopped at malformed input */
+    bool failed() const { return m_failed; }
+
     bencode_map& from_string(const std::string& data)
     {
-        for (const auto& e : data) {
-            consume_byte((const std::byte)e);
-        }
-        m_bracket_root = &m_root;
-        return *this;
+        return from_buffer({ (const std::byte*)data.data(), data.size() });
     }
 
     bencode_map& operator[](const std::size_t& i)
@@ -223,10 +358,12 @@ public:
         return *this;
     }
 
-    bencode_map& operator[](const std::string& i)
+    bencode_map& operator[](std::string_view i)
     {
         if (m_bracket_root->type != target_type::dictionaries) return *this;
-        m_bracket_root = &m_bracket_root->map_container.at(i);
+        auto it = m_bracket_root->map_container.find(i);
+        m_bracket_root = (it != m_bracket_root->map_container.end())
+            ? &it->second : &missing_target();
         return *this;
     }
 
@@ -237,10 +374,10 @@ public:
         return type;
     }
 
-    const std::string& as_str()
+    std::string_view as_str()
     {
         assert(m_bracket_root->type == target_type::strings);
-        const auto& return_value = m_bracket_root->string_value;
+        std::string_view return_value = m_bracket_root->string_value;
         m_bracket_root = &m_root;
         return return_value;
     }
@@ -253,9 +390,25 @@ public:
         return return_value;
     }
 
-    const std::vector<std::byte>& as_raw()
+    /* exact source bytes of the element, including its delimiters,
+     * only valid while the buffer passed to from_buffer() is alive */
+    std::span<const std::byte> as_raw()
+    {
+        auto return_value = m_source.subspan(
+            m_bracket_root->source_begin,
+            m_bracket_root->source_end - m_bracket_root->source_begin
+        );
+        m_bracket_root = &m_root;
+        return return_value;
+    }
+
+    /* [begin, end) offsets of the element in the parsed buffer */
+    std::pair<size_t, size_t> source_range()
     {
-        const auto& return_value = m_bracket_root->raw_bencode;
+        auto return_value = std::make_pair(
+            m_bracket_root->source_begin,
+            m_bracket_root->source_end
+        );
         m_bracket_root = &m_root;
         return return_value;
     }
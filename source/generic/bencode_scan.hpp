@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENCODE_SCAN_X86 1
+#else
+#define BENCODE_SCAN_X86 0
+#endif
+
+/* Tokenizer primitives for the bencode parsers. Delimiter search
+ * runs 16 (SSE2) or 32 (AVX2) bytes at a time, picked at runtime,
+ * with a scalar fallback. Digit runs are converted 8 at a time. */
+namespace bencode_scan {
+
+enum class simd_level {
+    scalar = 0,
+    sse2 = 1,
+    avx2 = 2,
+};
+
+inline const char* find_byte_scalar(const char* first, const char* last, char c)
+{
+    for (; first < last; ++first)
+        if (*first == c) return first;
+    return last;
+}
+
+#if BENCODE_SCAN_X86
+__attribute__((target("sse2")))
+inline const char* find_byte_sse2(const char* first, const char* last, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; last - first >= 16; first += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)first);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) return first + __builtin_ctz(mask);
+    }
+    return find_byte_scalar(first, last, c);
+}
+
+__attribute__((target("avx2")))
+inline const char* find_byte_avx2(const char* first, const char* last, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    for (; last - first >= 32; first += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)first);
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask) return first + __builtin_ctz(mask);
+    }
+    return find_byte_sse2(first, last, c);
+}
+#endif
+
+inline simd_level detect_level()
+{
+#if BENCODE_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return simd_level::avx2;
+    if (__builtin_cpu_supports("sse2")) return simd_level::sse2;
+#endif
+    return simd_level::scalar;
+}
+
+inline simd_level& active_level()
+{
+    static simd_level level = detect_level();
+    return level;
+}
+
+/* lower the level in use, ex. to compare against the scalar path */
+inline void set_level(simd_level level)
+{
+    if (level <= detect_level())
+        active_level() = level;
+}
+
+/* first occurrence of c in [first, last), last if there is none */
+inline const char* find_byte(const char* first, const char* last, char c)
+{
+#if BENCODE_SCAN_X86
+    switch (active_level()) {
+    case simd_level::avx2:
+        return find_byte_avx2(first, last, c);
+    case simd_level::sse2:
+        return find_byte_sse2(first, last, c);
+    default:
+        break;
+    }
+#endif
+    return find_byte_scalar(first, last, c);
+}
+
+/* true if all 8 bytes of the little endian word are '0'..'9' */
+inline bool eight_digits(uint64_t word)
+{
+    return ((word & 0xF0F0F0F0F0F0F0F0) |
+        (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+        == 0x3333333333333333;
+}
+
+/* value of 8 ascii digits, first digit in the lowest byte */
+inline uint32_t eight_digits_value(uint64_t word)
+{
+    word -= 0x3030303030303030;
+    word = (word * 10) + (word >> 8);
+    word = (((word & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+        (((word >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+    return (uint32_t)word;
+}
+
+/* parses the unsigned decimal [first, last), false if a
+ * byte is not a digit, the range is empty or overflows */
+inline bool parse_digits(const char* first, const char* last, uint64_t& value)
+{
+    if (first >= last || last - first > 19)
+        return false;
+
+    value = 0;
+    if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+        for (; last - first >= 8; first += 8) {
+            uint64_t word;
+            memcpy(&word, first, sizeof(word));
+            if (!eight_digits(word)) return false;
+            value = value * 100000000 + eight_digits_value(word);
+        }
+    }
+
+    for (; first < last; ++first) {
+        if (*first < '0' || *first > '9') return false;
+        value = value * 10 + (*first - '0');
+    }
+    return true;
+}
+
+}
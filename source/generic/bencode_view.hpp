@@ -0,0 +1,284 @@
+#pragma once
+
+#include <generic/bencode_map.hpp>
+#include <generic/bencode_scan.hpp>
+#include <string_view>
+#include <expected>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <span>
+
+/* Read-only bencode parser, the input is parsed once into a flat
+ * table of offsets into the original buffer. Strings and integers
+ * are read straight from the buffer, which must outlive the view.
+ *
+ * Nodes are stored in pre-order, so the subtree of a container
+ * at index i occupies the nodes [i + 1, nodes[i].next). */
+class bencode_view {
+public:
+    using target_type = bencode_map::target_type;
+
+    struct node {
+        target_type type { target_type::unknown };
+        uint32_t begin {};
+        uint32_t end {};
+        uint32_t next {};
+        uint32_t value {};
+    };
+
+    class element {
+    private:
+        static constexpr uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+
+        const bencode_view* m_view = nullptr;
+        uint32_t m_index = invalid_index;
+
+        const node& self() const { return m_view->m_nodes[m_index]; }
+
+    public:
+        class iterator {
+        private:
+            const bencode_view* m_view = nullptr;
+            uint32_t m_index = 0;
+
+        public:
+            iterator(const bencode_view* view, uint32_t index)
+                : m_view(view), m_index(index) {}
+
+            element operator*() const { return { m_view, m_index }; }
+            iterator& operator++()
+            {
+                m_index = m_view->m_nodes[m_index].next;
+                return *this;
+            }
+            bool operator==(const iterator& other) const { return m_index == other.m_index; }
+        };
+
+        element() {}
+        element(const bencode_view* view, uint32_t index)
+            : m_view(view), m_index(index) {}
+
+        bool exists() const { return m_view && m_index != invalid_index; }
+
+        target_type type() const
+        {
+            if (!exists()) return target_type::unknown;
+            return self().type;
+        }
+
+        element operator[](std::string_view key) const
+        {
+            if (type() != target_type::dictionaries) return {};
+            uint32_t child = m_index + 1;
+            while (child < self().next) {
+                uint32_t value = m_view->m_nodes[child].next;
+                if (element(m_view, child).as_str() == key)
+                    return { m_view, value };
+                child = m_view->m_nodes[value].next;
+            }
+            return {};
+        }
+
+        element operator[](size_t i) const
+        {
+            if (type() != target_type::lists) return {};
+            for (const auto& e : *this)
+                if (!i--) return e;
+            return {};
+        }
+
+        /* iterates list items, or alternating keys and values of a dictionary */
+        iterator begin() const
+        {
+            if (type() != target_type::lists && type() != target_type::dictionaries)
+                return end();
+            return { m_view, m_index + 1 };
+        }
+
+        iterator end() const
+        {
+            if (!exists()) return { m_view, invalid_index };
+            return { m_view, self().next };
+        }
+
+        size_t size() const
+        {
+            size_t count = 0;
+            for (auto it = begin(); it != end(); ++it)
+                count++;
+            return (type() == target_type::dictionaries) ? count / 2 : count;
+        }
+
+        std::span<const std::byte> as_bytes() const
+        {
+            assert(type() == target_type::strings);
+            if (type() != target_type::strings) return {};
+            return m_view->m_data.subspan(self().value, self().end - self().value);
+        }
+
+        std::string_view as_str() const
+        {
+            auto bytes = as_bytes();
+            return { (const char*)bytes.data(), bytes.size() };
+        }
+
+        int64_t as_int() const
+        {
+            assert(type() == target_type::integers);
+            if (type() != target_type::integers) return 0;
+            int64_t value = 0;
+            const char* first = (const char*)m_view->m_data.data() + self().value;
+            parse_integer(first, first + (self().end - self().value - 1), value);
+            return value;
+        }
+
+        /* exact source bytes of the element, including its delimiters */
+        std::span<const std::byte> as_raw() const
+        {
+            if (!exists()) return {};
+            return m_view->m_data.subspan(self().begin, self().end - self().begin);
+        }
+    };
+
+private:
+    std::span<const std::byte> m_data {};
+    std::vector<node> m_nodes {};
+
+    static bool parse_integer(const char* first, const char* last, int64_t& value)
+    {
+        bool negative = (first < last && *first == '-');
+        uint64_t magnitude = 0;
+        if (!bencode_scan::parse_digits(first + negative, last, magnitude)
+            || magnitude > (uint64_t)std::numeric_limits<int64_t>::max())
+            return false;
+        value = negative ? -(int64_t)magnitude : (int64_t)magnitude;
+        return true;
+    }
+
+public:
+    bencode_view() {}
+    ~bencode_view() {}
+
+    std::expected<bencode_view*, const char*>
+        from_buffer(std::span<const std::byte> data)
+    {
+        m_data = data;
+        m_nodes.clear();
+
+        if (data.size() >= std::numeric_limits<uint32_t>::max())
+            return std::unexpected("bencode view: input too large");
+
+        struct open_container {
+            uint32_t index;
+            uint32_t children;
+        };
+
+        std::vector<open_container> open;
+        const char* base = (const char*)data.data();
+        size_t size = data.size();
+        size_t i = 0;
+
+        while (i < size) {
+            char c = base[i];
+            uint32_t index = m_nodes.size();
+
+            if (c == 'e') {
+                if (open.empty())
+                    return std::unexpected("bencode view: unexpected end of container");
+                node& container = m_nodes[open.back().index];
+                if (container.type == target_type::dictionaries && open.back().children % 2)
+                    return std::unexpected("bencode view: dictionary key without value");
+                container.end = i + 1;
+                container.next = index;
+                open.pop_back();
+                i++;
+                if (open.empty()) break;
+                continue;
+            }
+
+            if (!open.empty()) {
+                const auto& parent = open.back();
+                if (m_nodes[parent.index].type == target_type::dictionaries
+                    && parent.children % 2 == 0 && (c < '0' || c > '9'))
+                    return std::unexpected("bencode view: dictionary key is not a string");
+                open.back().children++;
+            }
+
+            switch (c) {
+            case 'i': {
+                const char* ending = bencode_scan::find_byte(base + i, base + size, 'e');
+                if (ending == base + size)
+                    return std::unexpected("bencode view: unterminated integer");
+                int64_t ignored;
+                if (!parse_integer(base + i + 1, ending, ignored))
+                    return std::unexpected("bencode view: invalid integer");
+                uint32_t end = ending - base + 1;
+                m_nodes.push_back({ target_type::integers, (uint32_t)i, end, index + 1, (uint32_t)i + 1 });
+                i = end;
+                break;
+            }
+
+            case 'l':
+            case 'd':
+                m_nodes.push_back({
+                    (c == 'l') ? target_type::lists : target_type::dictionaries,
+                    (uint32_t)i, 0, 0, (uint32_t)i + 1
+                });
+                open.push_back({ index, 0 });
+                i++;
+                break;
+
+            default: {
+                if (c < '0' || c > '9')
+                    return std::unexpected("bencode view: unexpected byte");
+
+                const char* colon = bencode_scan::find_byte(base + i, base + size, ':');
+                if (colon == base + size)
+                    return std::unexpected("bencode view: unterminated string length");
+
+                uint64_t length = 0;
+                if (!bencode_scan::parse_digits(base + i, colon, length))
+                    return std::unexpected("bencode view: invalid string length");
+
+                size_t value = colon - base + 1;
+                if (length > size - value)
+                    return std::unexpected("bencode view: string exceeds input");
+
+                uint32_t end = value + length;
+                m_nodes.push_back({ target_type::strings, (uint32_t)i, end, index + 1, (uint32_t)value });
+                i = end;
+                break;
+            }
+            }
+
+            if (open.empty()) break;
+        }
+
+        if (!open.empty())
+            return std::unexpected("bencode view: unexpected end of input");
+        if (m_nodes.empty())
+            return std::unexpected("bencode view: empty input");
+        return this;
+    }
+
+    bencode_view& from_string(std::string_view data)
+    {
+        from_buffer({ (const std::byte*)data.data(), data.size() });
+        return *this;
+    }
+
+    element root() const
+    {
+        if (m_nodes.empty()) return {};
+        return { this, 0 };
+    }
+
+    element operator[](std::string_view key) const { return root()[key]; }
+    element operator[](size_t i) const { return root()[i]; }
+
+    const std::vector<node>& nodes() const { return m_nodes; }
+    std::span<const std::byte> data() const { return m_data; }
+};
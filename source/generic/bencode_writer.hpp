@@ -0,0 +1,279 @@
+#pragma once
+
+#include <string_view>
+#include <algorithm>
+#include <expected>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <span>
+
+/* Bencode encoder writing into a caller provided buffer, either a
+ * growable vector (appended to) or a fixed span. Nothing is allocated
+ * per element, containers are tracked on a fixed depth stack.
+ *
+ * Dictionary entries may be written in any order, each finished
+ * entry is rotated into its sorted position in place, so the
+ * output is always canonical (keys sorted as raw byte strings). */
+class bencode_writer {
+public:
+    static constexpr size_t max_depth = 32;
+
+private:
+    struct frame {
+        bool dictionary {};
+        size_t children {};
+        size_t begin {};
+        /* start of the entry whose position is not yet settled */
+        size_t entry_begin {};
+        bool entry_pending {};
+        /* the greatest key so far, which is always the last entry */
+        size_t last_key_begin {};
+        size_t last_key_length {};
+    };
+
+    std::vector<std::byte>* m_growable = nullptr;
+    std::span<std::byte> m_fixed {};
+    size_t m_base = 0;
+    size_t m_size = 0;
+    const char* m_error = nullptr;
+    std::array<frame, max_depth> m_frames {};
+    size_t m_depth = 0;
+
+    std::byte* data()
+    {
+        if (m_growable) return m_growable->data() + m_base;
+        return m_fixed.data();
+    }
+
+    std::byte* reserve(size_t length)
+    {
+        if (m_error) return nullptr;
+        if (m_growable) {
+            m_growable->resize(m_base + m_size + length);
+        } else if (m_size + length > m_fixed.size()) {
+            m_error = "bencode writer: buffer too small";
+            return nullptr;
+        }
+        std::byte* out = data() + m_size;
+        m_size += length;
+        return out;
+    }
+
+    void write(const void* bytes, size_t length)
+    {
+        std::byte* out = reserve(length);
+        if (out && length) memcpy(out, bytes, length);
+    }
+
+    void write_length(size_t length)
+    {
+        char digits[24];
+        auto [last, error] = std::to_chars(digits, digits + sizeof(digits), length);
+        write(digits, last - digits);
+        write(":", 1);
+    }
+
+    bool expecting_key() const
+    {
+        return m_depth
+            && m_frames[m_depth - 1].dictionary
+            && m_frames[m_depth - 1].children % 2 == 0;
+    }
+
+    bool begin_value()
+    {
+        if (m_error) return false;
+        if (expecting_key()) {
+            m_error = "bencode writer: dictionary key must be a string";
+            return false;
+        }
+        return true;
+    }
+
+    void end_value()
+    {
+        if (m_depth) m_frames[m_depth - 1].children++;
+    }
+
+    /* reads the string starting at offset, returns the offset past it */
+    size_t read_string(size_t offset, std::string_view& out)
+    {
+        const char* base = (const char*)data();
+        size_t length = 0;
+        auto [colon, error] = std::from_chars(base + offset, base + m_size, length);
+        size_t value = colon - base + 1;
+        out = { base + value, length };
+        return value + length;
+    }
+
+    /* returns the offset past the element starting at offset */
+    size_t skip_element(size_t offset)
+    {
+        const char* base = (const char*)data();
+        size_t depth = 0;
+        do {
+            char c = base[offset];
+            if (c == 'e') {
+                depth--;
+                offset++;
+            } else if (c == 'l' || c == 'd') {
+                depth++;
+                offset++;
+            } else if (c == 'i') {
+                offset = (const char*)memchr(base + offset, 'e', m_size - offset) - base + 1;
+            } else {
+                std::string_view ignored;
+                offset = read_string(offset, ignored);
+            }
+        } while (depth);
+        return offset;
+    }
+
+    void settle_entry(frame& dictionary)
+    {
+        if (!dictionary.entry_pending || m_error)
+            return;
+        dictionary.entry_pending = false;
+
+        std::string_view key;
+        read_string(dictionary.entry_begin, key);
+        size_t key_begin = key.data() - (const char*)data();
+
+        if (dictionary.entry_begin == dictionary.begin) {
+            dictionary.last_key_begin = key_begin;
+            dictionary.last_key_length = key.size();
+            return;
+        }
+
+        std::string_view last_key {
+            (const char*)data() + dictionary.last_key_begin,
+            dictionary.last_key_length
+        };
+
+        if (key == last_key) {
+            m_error = "bencode writer: duplicate dictionary key";
+            return;
+        }
+
+        if (key > last_key) {
+            dictionary.last_key_begin = key_begin;
+            dictionary.last_key_length = key.size();
+            return;
+        }
+
+        /* out of order, find the first entry with a greater key */
+        size_t position = dictionary.begin;
+        while (position < dictionary.entry_begin) {
+            std::string_view existing_key;
+            size_t value = read_string(position, existing_key);
+            if (key == existing_key) {
+                m_error = "bencode writer: duplicate dictionary key";
+                return;
+            }
+            if (key < existing_key) break;
+            position = skip_element(value);
+        }
+
+        std::rotate(data() + position, data() + dictionary.entry_begin, data() + m_size);
+        dictionary.last_key_begin += m_size - dictionary.entry_begin;
+    }
+
+    bencode_writer& begin_container(bool dictionary)
+    {
+        if (!begin_value()) return *this;
+        if (m_depth >= max_depth) {
+            m_error = "bencode writer: maximum depth exceeded";
+            return *this;
+        }
+        write(dictionary ? "d" : "l", 1);
+        m_frames[m_depth++] = { dictionary, 0, m_size };
+        return *this;
+    }
+
+public:
+    explicit bencode_writer(std::vector<std::byte>& buffer)
+        : m_growable(&buffer), m_base(buffer.size()) {}
+    explicit bencode_writer(std::span<std::byte> buffer)
+        : m_fixed(buffer) {}
+    ~bencode_writer() {}
+
+    bencode_writer& integer(int64_t value)
+    {
+        if (!begin_value()) return *this;
+        char digits[24];
+        auto [last, error] = std::to_chars(digits, digits + sizeof(digits), value);
+        write("i", 1);
+        write(digits, last - digits);
+        write("e", 1);
+        end_value();
+        return *this;
+    }
+
+    bencode_writer& string(std::span<const std::byte> value)
+    {
+        if (m_error) return *this;
+        if (expecting_key()) {
+            frame& dictionary = m_frames[m_depth - 1];
+            settle_entry(dictionary);
+            dictionary.entry_begin = m_size;
+            dictionary.entry_pending = true;
+        }
+        write_length(value.size());
+        write(value.data(), value.size());
+        end_value();
+        return *this;
+    }
+
+    bencode_writer& string(std::string_view value)
+    {
+        return string({ (const std::byte*)value.data(), value.size() });
+    }
+
+    /* same as string(), reads better when writing dictionaries */
+    bencode_writer& key(std::string_view value)
+    {
+        if (!m_error && !expecting_key())
+            m_error = "bencode writer: key written outside of dictionary key position";
+        return string(value);
+    }
+
+    bencode_writer& begin_list() { return begin_container(false); }
+    bencode_writer& begin_dictionary() { return begin_container(true); }
+
+    bencode_writer& end()
+    {
+        if (m_error) return *this;
+        if (!m_depth) {
+            m_error = "bencode writer: end() without open container";
+            return *this;
+        }
+
+        frame& container = m_frames[m_depth - 1];
+        if (container.dictionary && container.children % 2) {
+            m_error = "bencode writer: dictionary key without value";
+            return *this;
+        }
+
+        if (container.dictionary)
+            settle_entry(container);
+        write("e", 1);
+        m_depth--;
+        end_value();
+        return *this;
+    }
+
+    std::expected<std::span<const std::byte>, const char*> finish()
+    {
+        if (m_error)
+            return std::unexpected(m_error);
+        if (m_depth)
+            return std::unexpected("bencode writer: unterminated container");
+        return std::span<const std::byte> { data(), m_size };
+    }
+
+    size_t size() const { return m_size; }
+    const char* error() const { return m_error; }
+};
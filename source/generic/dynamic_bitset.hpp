@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <optional>
 #include <cstdint>
+#include <cstring>
 #include <random>
 #include <print>
 
@@ -23,7 +25,7 @@ inline void bitset_u8_bit_toggle(uint8_t* b, uint8_t pos, bool toggle)
 
 class dynamic_bitset {
 private:
-    std::unique_ptr<std::byte> m_bytes = nullptr;
+    std::unique_ptr<std::byte[]> m_bytes = nullptr;
     uint8_t* m_alternate_bytes = 0;
     size_t m_bytes_size = 0;
     size_t m_bits_size = 0;
@@ -37,7 +39,9 @@ public:
         target.m_alternate_bytes = source.m_alternate_bytes;
         target.m_bytes_size = source.m_bytes_size;
         target.m_bits_size = source.m_bits_size;
-        target.m_bytes = std::unique_ptr<std::byte>(new std::byte[target.m_bytes_size]);
+        target.m_bytes = std::unique_ptr<std::byte[]>(new std::byte[target.m_bytes_size]());
+        if (!source.m_alternate_bytes && source.m_bytes)
+            memcpy(target.m_bytes.get(), source.m_bytes.get(), target.m_bytes_size);
     }
 
     dynamic_bitset(const dynamic_bitset& source)
@@ -103,14 +107,54 @@ public:
     {
         m_bytes_size = bytes;
         m_bits_size = bytes * 8;
-        m_bytes = std::unique_ptr<std::byte>(new std::byte[bytes]);
+        m_bytes = std::unique_ptr<std::byte[]>(new std::byte[bytes]());
     }
 
-    void from_existing_buffer(uint8_t* bytes, size_t size_in_bytes)
+    /* size to exactly bits, trailing bits of the last byte are out of bounds */
+    void resize_bits(size_t bits)
+    {
+        resize((bits + 7) / 8);
+        m_bits_size = bits;
+    }
+
+    void from_existing_buffer(uint8_t* bytes, size_t size_in_bytes, size_t size_in_bits = 0)
     {
         m_alternate_bytes = bytes;
         m_bytes_size = size_in_bytes;
-        m_bits_size = size_in_bytes * 8;
+        m_bits_size = size_in_bits ? size_in_bits : size_in_bytes * 8;
+    }
+
+    /* the peer wire orders bits most significant first, bit 0 is the
+     * high bit of the first byte, bits are stored least significant first */
+    void assign_msb_first(const uint8_t* bytes, size_t size_in_bytes)
+    {
+        size_t count = std::min(size_in_bytes, bytes_size());
+        for (size_t i = 0; i < count; ++i)
+            data()[i] = reverse_bits(bytes[i]);
+        for (size_t i = count; i < bytes_size(); ++i)
+            data()[i] = 0;
+        clear_trailing_bits();
+    }
+
+    void copy_msb_first(uint8_t* out) const
+    {
+        for (size_t i = 0; i < bytes_size(); ++i)
+            out[i] = reverse_bits(const_data()[i]);
+    }
+
+    static uint8_t reverse_bits(uint8_t b)
+    {
+        b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+        b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+        b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+        return b;
+    }
+
+    /* bits past bits_size() in the last byte are kept zero */
+    void clear_trailing_bits()
+    {
+        if (bits_size() % 8 && bytes_size())
+            data()[bytes_size() - 1] &= (uint8_t)((1 << (bits_size() % 8)) - 1);
     }
 
     /* Find the occurence where
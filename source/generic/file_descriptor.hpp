@@ -0,0 +1,42 @@
+#pragma once
+
+#include <unistd.h>
+
+/* owns an open file descriptor, closed on destruction */
+class file_descriptor {
+private:
+    int m_fd = -1;
+
+public:
+    file_descriptor() {}
+    explicit file_descriptor(int fd) : m_fd(fd) {}
+    ~file_descriptor() { reset(); }
+
+    file_descriptor(const file_descriptor&) = delete;
+    file_descriptor& operator=(const file_descriptor&) = delete;
+
+    file_descriptor(file_descriptor&& other) : m_fd(other.release()) {}
+    file_descriptor& operator=(file_descriptor&& other)
+    {
+        if (this != &other)
+            reset(other.release());
+        return *this;
+    }
+
+    void reset(int fd = -1)
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = fd;
+    }
+
+    int release()
+    {
+        int fd = m_fd;
+        m_fd = -1;
+        return fd;
+    }
+
+    int get() const { return m_fd; }
+    bool valid() const { return m_fd >= 0; }
+};
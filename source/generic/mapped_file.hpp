@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <expected>
+#include <cstddef>
+#include <span>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Read-only memory mapping of a whole file,
+ * the mapping lives as long as the mapped_file object */
+class mapped_file {
+private:
+    std::byte* m_data = nullptr;
+    size_t m_size = 0;
+
+    void unmap()
+    {
+        if (m_data)
+            munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+public:
+    mapped_file() {}
+    ~mapped_file() { unmap(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    std::expected<mapped_file*, const char*>
+        from_path(const std::filesystem::path& file_path)
+    {
+        unmap();
+
+        int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return std::unexpected("mapped file: open() failed");
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) < 0) {
+            close(fd);
+            return std::unexpected("mapped file: fstat() failed");
+        }
+
+        if (file_stat.st_size <= 0) {
+            close(fd);
+            return std::unexpected("mapped file: file is empty");
+        }
+
+        void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return std::unexpected("mapped file: mmap() failed");
+
+        /* files are parsed front to back exactly once */
+        madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+        m_data = (std::byte*)data;
+        m_size = file_stat.st_size;
+        return this;
+    }
+
+    std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+    size_t size() const { return m_size; }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <span>
+
+/* Byte ring buffer with a power of two capacity. The free space is
+ * exposed as (at most) two regions so a single readv() can fill it,
+ * read and write positions only ever grow and are masked on access. */
+class ring_buffer {
+private:
+    std::vector<std::byte> m_data {};
+    size_t m_mask = 0;
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+
+public:
+    ring_buffer() {}
+    explicit ring_buffer(size_t capacity) { resize(capacity); }
+    ~ring_buffer() {}
+
+    /* capacity is rounded up to a power of two, drops buffered bytes */
+    void resize(size_t capacity)
+    {
+        size_t rounded = 1;
+        while (rounded < capacity)
+            rounded <<= 1;
+        m_data.assign(rounded, std::byte {});
+        m_mask = rounded - 1;
+        m_head = m_tail = 0;
+    }
+
+    size_t capacity() const { return m_data.size(); }
+    size_t size() const { return m_tail - m_head; }
+    size_t free() const { return capacity() - size(); }
+    bool empty() const { return m_head == m_tail; }
+
+    /* free space in write order, the second region is empty unless it wraps */
+    std::array<std::span<std::byte>, 2> writable_regions()
+    {
+        size_t position = m_tail & m_mask;
+        size_t first = std::min(free(), capacity() - position);
+        return {
+            std::span<std::byte> { m_data.data() + position, first },
+            std::span<std::byte> { m_data.data(), free() - first },
+        };
+    }
+
+    /* marks length bytes of the writable regions as written */
+    void commit(size_t length) { m_tail += std::min(length, free()); }
+
+    size_t write(std::span<const std::byte> data)
+    {
+        size_t length = std::min(data.size(), free());
+        size_t written = 0;
+        for (auto region : writable_regions()) {
+            size_t chunk = std::min(region.size(), length - written);
+            if (chunk) memcpy(region.data(), data.data() + written, chunk);
+            written += chunk;
+        }
+        commit(length);
+        return length;
+    }
+
+    /* copies length bytes at offset from the read position, no consume */
+    bool peek(void* out, size_t length, size_t offset = 0) const
+    {
+        if (offset + length > size())
+            return false;
+        size_t position = (m_head + offset) & m_mask;
+        size_t first = std::min(length, capacity() - position);
+        memcpy(out, m_data.data() + position, first);
+        memcpy((std::byte*)out + first, m_data.data(), length - first);
+        return true;
+    }
+
+    /* length bytes at offset as one span, points into the buffer unless
+     * the range wraps, in which case it is copied into scratch */
+    std::span<const std::byte> contiguous(size_t length, size_t offset,
+        std::vector<std::byte>& scratch) const
+    {
+        if (offset + length > size())
+            return {};
+        size_t position = (m_head + offset) & m_mask;
+        if (position + length <= capacity())
+            return { m_data.data() + position, length };
+        scratch.resize(length);
+        peek(scratch.data(), length, offset);
+        return scratch;
+    }
+
+    void consume(size_t length)
+    {
+        m_head += std::min(length, size());
+        if (m_head == m_tail)
+            m_head = m_tail = 0;
+    }
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+#include <array>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+/* Hashed hierarchical timing wheel. Time advances in ticks of a fixed
+ * resolution on a monotonic clock. A timer is hashed into the slot of
+ * its expiry tick on the lowest level whose span reaches it, the slots
+ * of a higher level are redistributed downwards whenever the level
+ * below wraps around. Scheduling and cancelling are O(1), advancing is
+ * O(1) per tick plus the expired timers, nothing is ever sorted. A
+ * timer never fires early and at most one tick late. Timers carry a
+ * value which advance() hands back, ex. a connection and what to do. */
+template <typename T>
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+    /* generation and node index, 0 is never a valid id */
+    using timer_id = uint64_t;
+
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+    static constexpr uint64_t slot_mask = TIMER_WHEEL_SLOTS - 1;
+    /* timers further out fire at the horizon */
+    static constexpr uint64_t horizon = (1ull << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    /* the level of nodes taken out of the wheel to be fired */
+    static constexpr uint8_t expiring = TIMER_WHEEL_LEVELS;
+
+    /* nodes are pooled and linked by index, freed nodes are reused */
+    struct node {
+        T value {};
+        uint64_t expires {};
+        uint32_t previous { none };
+        uint32_t next { none };
+        uint32_t generation { 1 };
+        uint16_t slot {};
+        uint8_t level {};
+        bool active {};
+    };
+
+    std::vector<node> m_nodes {};
+    std::vector<uint32_t> m_free {};
+    std::array<std::array<uint32_t, TIMER_WHEEL_SLOTS>, TIMER_WHEEL_LEVELS> m_slots {};
+    std::array<size_t, TIMER_WHEEL_LEVELS> m_level_size {};
+    uint32_t m_expiring = none;
+    clock::duration m_resolution;
+    clock::time_point m_start;
+    /* every tick before this one has been processed */
+    uint64_t m_tick = 0;
+    size_t m_size = 0;
+
+    uint32_t& head(const node& timer)
+    {
+        return timer.level == expiring ? m_expiring : m_slots[timer.level][timer.slot];
+    }
+
+    void push(uint32_t index)
+    {
+        node& timer = m_nodes[index];
+        uint32_t& first = head(timer);
+        timer.previous = none;
+        timer.next = first;
+        if (first != none)
+            m_nodes[first].previous = index;
+        first = index;
+        if (timer.level != expiring)
+            m_level_size[timer.level]++;
+    }
+
+    void link(uint32_t index)
+    {
+        node& timer = m_nodes[index];
+        uint64_t delta = timer.expires - m_tick;
+        uint8_t level = 0;
+        while (level + 1 < TIMER_WHEEL_LEVELS && delta >> (TIMER_WHEEL_SLOT_BITS * (level + 1)))
+            level++;
+        timer.level = level;
+        timer.slot = (timer.expires >> (TIMER_WHEEL_SLOT_BITS * level)) & slot_mask;
+        push(index);
+    }
+
+    void unlink(uint32_t index)
+    {
+        node& timer = m_nodes[index];
+        if (timer.previous != none)
+            m_nodes[timer.previous].next = timer.next;
+        else
+            head(timer) = timer.next;
+        if (timer.next != none)
+            m_nodes[timer.next].previous = timer.previous;
+        if (timer.level != expiring)
+            m_level_size[timer.level]--;
+        timer.previous = timer.next = none;
+    }
+
+    void release(uint32_t index)
+    {
+        node& timer = m_nodes[index];
+        timer.value = T {};
+        timer.active = false;
+        timer.generation++;
+        m_free.push_back(index);
+        m_size--;
+    }
+
+    /* takes a whole slot list, the nodes are relinked one by one */
+    uint32_t take_slot(uint8_t level, size_t slot)
+    {
+        uint32_t first = m_slots[level][slot];
+        m_slots[level][slot] = none;
+        for (uint32_t index = first; index != none; index = m_nodes[index].next)
+            m_level_size[level]--;
+        return first;
+    }
+
+    /* when a level wraps, the next slot of the level above moves down */
+    void cascade(uint64_t tick)
+    {
+        for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            if (tick & ((1ull << (TIMER_WHEEL_SLOT_BITS * level)) - 1))
+                return;
+            size_t slot = (tick >> (TIMER_WHEEL_SLOT_BITS * level)) & slot_mask;
+            for (uint32_t index = take_slot(level, slot); index != none;) {
+                uint32_t next = m_nodes[index].next;
+                link(index);
+                index = next;
+            }
+        }
+    }
+
+    /* the first tick at or after a point in time */
+    uint64_t tick_of(clock::time_point when) const
+    {
+        if (when <= m_start)
+            return 0;
+        auto elapsed = (when - m_start).count();
+        return (elapsed + m_resolution.count() - 1) / m_resolution.count();
+    }
+
+    clock::time_point time_of(uint64_t tick) const
+    {
+        return m_start + m_resolution * tick;
+    }
+
+public:
+    explicit timer_wheel(clock::duration resolution = std::chrono::milliseconds(10),
+        clock::time_point start = clock::now())
+        : m_resolution(resolution), m_start(start)
+    {
+        for (auto& level : m_slots)
+            level.fill(none);
+    }
+    ~timer_wheel() {}
+
+    timer_id schedule(clock::time_point when, T value)
+    {
+        uint32_t index;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else {
+            index = (uint32_t)m_nodes.size();
+            m_nodes.emplace_back();
+        }
+
+        node& timer = m_nodes[index];
+        timer.value = std::move(value);
+        timer.expires = std::clamp(tick_of(when), m_tick, m_tick + horizon);
+        timer.active = true;
+        link(index);
+        m_size++;
+        return ((uint64_t)timer.generation << 32) | index;
+    }
+
+    timer_id schedule_after(clock::duration delay, T value, clock::time_point now = clock::now())
+    {
+        return schedule(now + delay, std::move(value));
+    }
+
+    /* false if the timer already fired or was cancelled */
+    bool cancel(timer_id id)
+    {
+        if (!pending(id))
+            return false;
+        uint32_t index = (uint32_t)id;
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    bool pending(timer_id id) const
+    {
+        uint32_t index = (uint32_t)id;
+        return index < m_nodes.size() && m_nodes[index].active &&
+            m_nodes[index].generation == (uint32_t)(id >> 32);
+    }
+
+    /* fires every timer due by now, expire(T&) may schedule and cancel */
+    template <typename F>
+    size_t advance(clock::time_point now, F&& expire)
+    {
+        if (now < m_start)
+            return 0;
+        uint64_t target = (now - m_start).count() / m_resolution.count();
+
+        size_t fired = 0;
+        while (m_tick <= target) {
+            /* nothing to cascade or fire, idle time is skipped at once */
+            if (!m_size) {
+                m_tick = target + 1;
+                break;
+            }
+
+            uint64_t tick = m_tick;
+            cascade(tick);
+            for (uint32_t index = take_slot(0, tick & slot_mask); index != none;) {
+                uint32_t next = m_nodes[index].next;
+                m_nodes[index].level = expiring;
+                push(index);
+                index = next;
+            }
+            m_tick++;
+
+            /* timers scheduled from expire() land past this tick */
+            while (m_expiring != none) {
+                uint32_t index = m_expiring;
+                unlink(index);
+                T value = std::move(m_nodes[index].value);
+                release(index);
+                fired++;
+                expire(value);
+            }
+        }
+        return fired;
+    }
+
+    /* not later than the earliest timer, none if the wheel is empty */
+    std::optional<clock::time_point> next_expiry() const
+    {
+        if (!m_size)
+            return {};
+
+        bool higher = m_size > m_level_size[0];
+        for (uint64_t tick = m_tick; tick < m_tick + TIMER_WHEEL_SLOTS; ++tick) {
+            if (m_slots[0][tick & slot_mask] != none)
+                return time_of(tick);
+            /* a higher level may move timers down here */
+            if (higher && !(tick & slot_mask))
+                return time_of(tick);
+        }
+        return time_of(m_tick + TIMER_WHEEL_SLOTS);
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return !m_size; }
+    clock::duration resolution() const { return m_resolution; }
+};
@@ -1,20 +1,44 @@
 #include <generic/try.hpp>
 #include <multiproc/multiproc.hpp>
 #include <multiproc/sandbox.h>
-#include <thread>
+#include <algorithm>
 #include <print>
 #include <span>
-#include <fstream>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <memory.h>
 
-torr::multiproc_task::multiproc_task(peer& ourself, const torrent_peer& them)
-    : m_bitfield_pieces("bitfield_pieces", 2048),
+/* one bit per piece, shared between the main process and tasks */
+static size_t bitfield_pieces_bytes(const torr::peer& ourself)
+{
+    size_t piece_count = ourself.download_target().piece_count().value_or(0);
+    return std::max<size_t>((piece_count + 7) / 8, 1);
+}
+
+/* tasks enforce the limits in their own copy of the buckets, each
+ * bucket up to the root keeps an even share of its rate */
+static void share_rate_limits(torr::token_bucket* bucket, size_t task_count)
+{
+    for (; bucket; bucket = bucket->parent()) {
+        if (!bucket->rate())
+            continue;
+        bucket->set_rate(std::max<size_t>(bucket->rate() / task_count, 1),
+            std::max<size_t>(bucket->burst() / task_count, 1));
+    }
+}
+
+torr::multiproc_task::multiproc_task(peer& ourself, std::unique_ptr<torrent_peer> them,
+    size_t task_count)
+    : m_bitfield_pieces("bitfield_pieces", bitfield_pieces_bytes(ourself)),
     m_ourself(ourself),
-    m_peer(them)
+    m_peer(std::move(them))
 {
+    share_rate_limits(&m_ourself.download_limit(), std::max<size_t>(task_count, 1));
+    share_rate_limits(&m_ourself.upload_limit(), std::max<size_t>(task_count, 1));
+    m_peer->attach_rate_limits(m_ourself);
+    m_peer->attach_storage(m_ourself);
     m_main_channel.set_pid(getppid());
     m_main_channel.connect_channel();
     m_main_channel_mutex = sem_open(
@@ -25,10 +49,12 @@ torr::multiproc_task::multiproc_task(peer& ourself, const torrent_peer& them)
 torr::multiproc_task::~multiproc_task() {}
 
 torr::multiproc::multiproc(peer& ourself, tracker& track)
-    : m_bitfield_pieces("bitfield_pieces", 2048),
+    : m_bitfield_pieces("bitfield_pieces", bitfield_pieces_bytes(ourself)),
+    m_connector(ourself),
     m_ourself(ourself),
     m_tracker(track)
 {
+    mkdir(DOWNLOAD_DIRECTORY, 0755);
     m_main_channel.create_channel();
     m_main_channel_mutex = sem_open(
         "torr.main_channel_mutex", O_CREAT, 0644, 0);
@@ -43,7 +69,10 @@ torr::multiproc::multiproc(peer& ourself, tracker& track)
 
     /* FIXME: pass multiple trackers */
     auto announcer = MUST(track.announce(m_ourself));
-    m_addresses = announcer->peers();
+    MUST(m_connector.open());
+    m_connector.add_candidates(announcer->peers());
+    for (const auto& address : announcer->peers())
+        m_ourself.peer_exchange().add_known(address);
 }
 
 torr::multiproc::~multiproc()
@@ -58,7 +87,7 @@ void torr::multiproc_task::quit()
 
 void torr::multiproc_task::sandbox()
 {
-    if (!sandbox_landlock_process())
+    if (!sandbox_landlock_process(DOWNLOAD_DIRECTORY))
         SANDBOX_FAILED();
     if (!sandbox_seccomp_filter_process())
         SANDBOX_FAILED();
@@ -67,15 +96,44 @@ void torr::multiproc_task::sandbox()
 bool torr::multiproc_task::work()
 {
     for (;;) {
-        m_peer.receive_message(m_ourself);
+        m_peer->receive_message(m_ourself);
+
+        /* the piece of a remote that stopped sending is given up and
+         * a new one is requested, one block at a time if snubbed, a
+         * remote that keeps stalling loses its task */
+        if (m_peer->check_request_timeouts(m_ourself)) {
+            if (m_peer->request_timeouts() >= MULTIPROC_TASK_MAX_REQUEST_TIMEOUTS)
+                quit();
+            m_peer->download_next_piece(m_ourself);
+        }
 
-        const auto& piece = m_peer.download_piece();
+        /* the main process connects to peers the remote told about */
+        m_peer->exchange_peers(m_ourself);
+        if (m_ourself.peer_exchange().discovered())
+            notify_discovered_peers();
+
+        const auto& piece = m_peer->download_piece();
         if (piece.downloaded && piece.downloaded >= piece.piece_size) {
+            m_peer->announce_piece(piece.piece_index);
             notify_downloaded_piece();
-            m_peer.download_next_piece(m_ourself);
+            m_peer->download_next_piece(m_ourself);
+        }
+
+        /* a task hosts a single connection, the choker decides
+         * whether it gets one of the unchoke slots */
+        if (m_ourself.choker().due()) {
+            choker::candidate candidate {
+                0, m_peer->peer_interested(),
+                m_peer->estimator().rate(), m_peer->upload_estimator().rate()
+            };
+            m_ourself.choker().evaluate({ &candidate, 1 }, m_ourself.seeding());
+            m_peer->set_choking(!candidate.unchoke);
         }
 
-        if (!m_peer.socket_healthy())
+        /* everything queued this turn leaves in one write */
+        m_peer->flush();
+
+        if (!m_peer->socket_healthy())
             quit();
     }
     return true;
@@ -84,45 +142,49 @@ bool torr::multiproc_task::work()
 void torr::multiproc_task::notify_downloaded_piece()
 {
     std::span<std::byte> output_data = {
-        (std::byte*)m_peer.download_piece().data.data(),
-        m_peer.download_piece().data.capacity()
+        (std::byte*)m_peer->download_piece().buffer.data().data(),
+        m_peer->download_piece().buffer.size()
     };
 
     multiproc_message message;
     message.type = multiproc_message_type::download_piece_done;
     message.payload_size = output_data.size();
-    message.field0 = m_peer.download_piece().piece_index;
+    message.field0 = m_peer->download_piece().piece_index;
 
     sem_wait(m_main_channel_mutex);
     m_main_channel.write({ (std::byte*)&message, sizeof(message) });
     m_main_channel.write(output_data);
     sem_post(m_main_channel_mutex);
 
-    m_peer.empty_download_piece();
+    m_peer->empty_download_piece();
 }
 
-pid_t torr::multiproc::spawn()
+void torr::multiproc_task::notify_discovered_peers()
 {
-    torrent_peer peer;
-    bool has_found_peer = false;
+    std::vector<std::byte> compact;
+    auto discovered = m_ourself.peer_exchange().take_discovered();
+    for (const auto& address : discovered)
+        peer_exchange::append_compact(compact, address);
 
-    for (std::vector<peer_ip_touple>::iterator it = m_addresses.begin();
-            it != m_addresses.end(); ) {
-        const auto& address = *it;
-        peer.set_ip_and_port(address.address, address.port);
-        std::println("testing peer {}:{}", peer.ip_address_as_string(), peer.port());
+    multiproc_message message;
+    message.type = multiproc_message_type::discovered_peers;
+    message.payload_size = compact.size();
+    message.field0 = discovered.size();
 
-        if (peer.handshake(m_ourself)) {
-            has_found_peer = true;
-            m_addresses.erase(it);
-            break;
-        }
-        
-        it = m_addresses.erase(it);
-    }
+    sem_wait(m_main_channel_mutex);
+    m_main_channel.write({ (std::byte*)&message, sizeof(message) });
+    m_main_channel.write(compact);
+    sem_post(m_main_channel_mutex);
+}
 
-    if (!has_found_peer)
-        return 0;
+pid_t torr::multiproc::spawn(std::unique_ptr<torrent_peer> connection)
+{
+    /* tasks receive blocking */
+    connection->set_blocking(true);
+    connection->set_receive_timeout(MULTIPROC_TASK_RECEIVE_TIMEOUT);
+    /* tasks advertise the connections made before they were forked */
+    peer_ip_touple address = connection->address();
+    m_ourself.peer_exchange().add_connected(address);
 
     pid_t c_pid = fork(); 
     if (c_pid == -1) {
@@ -133,10 +195,13 @@ pid_t torr::multiproc::spawn()
     }
     else if (c_pid > 0) {
         m_tasks.push_back(c_pid);
+        m_task_addresses[c_pid] = address;
         return c_pid;
     }
     else {
-        multiproc_task task(m_ourself, peer);
+        /* attempts still in flight belong to the main process */
+        m_connector.clear();
+        multiproc_task task(m_ourself, std::move(connection), m_spawn_children_count);
 
         /* sandbox after multiproc_task constructor
          * due to shmget, and the alike */
@@ -157,22 +222,20 @@ void torr::multiproc::respawner()
         const auto& pid = *it;
         int pid_status = waitpid(pid, 0, WNOHANG);
         if (pid_status < 0) {
+            m_ourself.peer_exchange().remove_connected(m_task_addresses[pid]);
+            m_task_addresses.erase(pid);
             it = m_tasks.erase(it);
             std::println("dead {} ", pid);
-            spawn();
-            break;
+            continue;
         }
 
         ++it;
     }
-}
 
-void torr::multiproc::spawner()
-{
-    m_is_spawning = true;
-    for (int i = 0; i < m_spawn_children_count; i++)
-        pid_t child_pid = spawn();
-    m_is_spawning = false;
+    /* handshaked peers, also those discovered with ut_pex,
+     * fill the slots tasks left */
+    while (m_tasks.size() < m_spawn_children_count && m_connector.ready())
+        spawn(m_connector.take());
 }
 
 void torr::multiproc::start()
@@ -180,16 +243,18 @@ void torr::multiproc::start()
     m_ourself.construct_handshake_string();
     m_main_channel.resize_capacity(65536);
 
-    std::thread(&multiproc::spawner, this).detach();
-
+    /* the connector and the peer exchange are owned by this loop,
+     * tasks hand discovered peers over through the main channel */
     while (true) {
+        /* attempts are driven and expired between messages,
+         * never blocking the channel */
+        m_connector.poll(0);
+        respawner();
+
         multiproc_message message;
-        int length = m_main_channel.read(sizeof(message), 1000);
-        if (length < sizeof(message)) {
-            if (!m_is_spawning)
-                respawner();
+        int length = m_main_channel.read(sizeof(message), MULTIPROC_POLL_INTERVAL);
+        if (length < sizeof(message))
             continue;
-        }
 
         memcpy(&message, m_main_channel.read_data().data(), sizeof(message));
 
@@ -200,6 +265,12 @@ void torr::multiproc::start()
             sem_post(m_main_channel_mutex);
             break;
 
+        case multiproc_message_type::discovered_peers:
+            sem_wait(m_main_channel_mutex);
+            handle_discovered_peers(message);
+            sem_post(m_main_channel_mutex);
+            break;
+
         case multiproc_message_type::unkown:
         default:
             break;
@@ -207,19 +278,45 @@ void torr::multiproc::start()
     }
 }
 
-void torr::multiproc::handle_downloaded_piece(const multiproc_message& message)
+std::vector<std::byte> torr::multiproc::read_payload(size_t payload_size)
 {
-    m_main_channel.resize_capacity(message.payload_size);
-    std::ofstream out_file(std::format("./.pieces/piece_{}.txt", message.field0), std::ios::binary);
-    int receive_left = message.payload_size;
+    m_main_channel.resize_capacity(payload_size);
+    std::vector<std::byte> payload;
+    payload.reserve(payload_size);
+    int receive_left = payload_size;
 
     while (receive_left > 0) {
         size_t read_size = m_main_channel.read();
-        out_file.write((char*)m_main_channel.read_data().data(), read_size);
+        const auto& read_data = m_main_channel.read_data();
+        payload.insert(payload.end(), read_data.data(), read_data.data() + read_size);
         receive_left -= read_size;
     }
+    return payload;
+}
+
+void torr::multiproc::handle_discovered_peers(const multiproc_message& message)
+{
+    auto compact = read_payload(message.payload_size);
 
-    out_file.close();
+    /* every task may report the same peer, each is connected to once */
+    for (const auto& address : peer_exchange::parse_compact(compact))
+        if (m_ourself.peer_exchange().add_known(address))
+            m_connector.add_candidate(address);
+}
+
+void torr::multiproc::handle_downloaded_piece(const multiproc_message& message)
+{
+    auto piece_data = read_payload(message.payload_size);
+
+    if (!m_ourself.verify_piece(message.field0, piece_data)) {
+        std::println("piece {} failed hash check", message.field0);
+        return;
+    }
+
+    if (!m_ourself.storage().write_piece(message.field0, piece_data)) {
+        std::println("piece {} could not be stored", message.field0);
+        return;
+    }
     m_ourself.piece_download_complete(message.field0);
 }
 
@@ -3,15 +3,28 @@
 #include <torrent.hpp>
 #include <ipc/ipc.hpp>
 #include <network/peer/peer.hpp>
+#include <network/peer/connector.hpp>
 #include <network/tracker.hpp>
 #include <semaphore.h>
+#include <unordered_map>
 #include <vector>
 
+/* tasks wake up at least this often, in micro seconds, to time
+ * out requests a remote left unanswered */
+#define MULTIPROC_TASK_RECEIVE_TIMEOUT 1000000
+/* a task whose remote let this many request timeouts in a row
+ * pass quits, so the main process reuses its slot */
+#define MULTIPROC_TASK_MAX_REQUEST_TIMEOUTS 3
+/* how long the main loop waits for a message before driving the connector */
+#define MULTIPROC_POLL_INTERVAL 100
+
 namespace torr {
 
 enum class multiproc_message_type {
     unkown = 0,
     download_piece_done = 1,
+    /* compact addresses learned with ut_pex, field0 is the count */
+    discovered_peers = 2,
 };
 
 struct multiproc_message {
@@ -25,13 +38,15 @@ private:
     ipc_channel m_main_channel;
     ipc_shared_memory m_bitfield_pieces;
     sem_t* m_main_channel_mutex;
-    torrent_peer m_peer;
+    std::unique_ptr<torrent_peer> m_peer;
     peer& m_ourself;
 
     void notify_downloaded_piece();
+    void notify_discovered_peers();
 
 public:
-    multiproc_task(peer&, const torrent_peer&);
+    /* the rate limits are split evenly between task_count tasks */
+    multiproc_task(peer&, std::unique_ptr<torrent_peer>, size_t task_count);
     ~multiproc_task();
 
     void sandbox();
@@ -45,18 +60,19 @@ private:
     ipc_shared_memory m_bitfield_pieces;
     sem_t* m_main_channel_mutex;
 
-    std::vector<peer_ip_touple> m_addresses;
+    connector m_connector;
     std::vector<pid_t> m_tasks;
+    std::unordered_map<pid_t, peer_ip_touple> m_task_addresses;
     uint8_t m_spawn_children_count { 5 };
-    bool m_is_spawning { false };
 
     peer& m_ourself;
     tracker& m_tracker;
 
-    pid_t spawn();
-    void spawner();
+    pid_t spawn(std::unique_ptr<torrent_peer> connection);
     void respawner();
+    std::vector<std::byte> read_payload(size_t payload_size);
     void handle_downloaded_piece(const multiproc_message& message);
+    void handle_discovered_peers(const multiproc_message& message);
 
 public:
     multiproc(peer& ourself, tracker& track);
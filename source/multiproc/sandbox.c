@@ -1,6 +1,7 @@
 #include "sandbox.h"
 #include <seccomp.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <cstring>
@@ -52,9 +53,21 @@ static const int seccomp_filter_whitelist[] {
     SCMP_SYS(socket),
     SCMP_SYS(connect),
     SCMP_SYS(recvfrom),
+    SCMP_SYS(readv),
     SCMP_SYS(sendto),
+    SCMP_SYS(sendmsg),
+    SCMP_SYS(setsockopt),
+
+    /* necessary for serving pieces, landlock only
+     * permits reading files beneath the pieces directory */
+    SCMP_SYS(openat),
+    SCMP_SYS(sendfile),
     SCMP_SYS(sched_yield),
 
+    /* necessary for waiting on bandwidth limits */
+    SCMP_SYS(nanosleep),
+    SCMP_SYS(clock_nanosleep),
+
     /* necessary for heap allocations
      * NOTE: mseal() memory to harden security? */
     SCMP_SYS(msync),
@@ -95,6 +108,15 @@ static inline int landlock_create_ruleset(const struct landlock_ruleset_attr* co
 }
 #endif
 
+#ifndef landlock_add_rule
+static inline int landlock_add_rule(const int ruleset_fd,
+	const enum landlock_rule_type rule_type,
+	const void* const rule_attr, const __u32 flags)
+{
+	return syscall(__NR_landlock_add_rule, ruleset_fd, rule_type, rule_attr, flags);
+}
+#endif
+
 #ifndef landlock_restrict_self
 static inline int landlock_restrict_self(const int ruleset_fd,
 	const __u32 flags)
@@ -103,10 +125,22 @@ static inline int landlock_restrict_self(const int ruleset_fd,
 }
 #endif
 
-bool sandbox_landlock_process()
+bool sandbox_landlock_process(const char* readable_directory)
 {
 	int ruleset_fd = landlock_create_ruleset(&landlock_rules_blacklist,
         sizeof(landlock_rules_blacklist), 0);
+
+    if (readable_directory) {
+        struct landlock_path_beneath_attr path_beneath = {
+            .allowed_access = LANDLOCK_ACCESS_FS_READ_FILE,
+            .parent_fd = open(readable_directory, O_PATH | O_CLOEXEC),
+        };
+        if (path_beneath.parent_fd >= 0) {
+            landlock_add_rule(ruleset_fd, LANDLOCK_RULE_PATH_BENEATH, &path_beneath, 0);
+            close(path_beneath.parent_fd);
+        }
+    }
+
 	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0))
         return false;
 	return (!landlock_restrict_self(ruleset_fd, 0));
@@ -8,8 +8,9 @@ bool sandbox_seccomp_filter_process();
 
 /* landlock since Linux 5.13 see https://man7.org/linux/man-pages/man7/landlock.7.html
  * NOTE: should be called before sandbox_seccomp_filter_process()
- * as seccomp will block the landlock syscall */
-bool sandbox_landlock_process();
+ * as seccomp will block the landlock syscall
+ * files beneath readable_directory stay readable, ex. to serve pieces */
+bool sandbox_landlock_process(const char* readable_directory = 0);
 
 /* install a SIGSYS handler to debug process exits envoked by seccomp */
 bool sandbox_install_sigsys_handler();
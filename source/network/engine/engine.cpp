@@ -0,0 +1,735 @@
+#include <network/engine/engine.hpp>
+#include <generic/try.hpp>
+#include <algorithm>
+#include <print>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/* ring user data, the connection or write id above the operation */
+enum class ring_operation : uint8_t {
+    receive = 1,
+    receive_poll = 2,
+    send = 3,
+    send_poll = 4,
+    write = 5,
+    timeout = 6,
+    throttle = 7,
+    timer = 8,
+};
+
+static uint64_t ring_user_data(uint64_t id, ring_operation operation)
+{
+    return (id << 8) | (uint64_t)operation;
+}
+
+torr::engine::engine(peer& ourself)
+    : m_ourself(ourself)
+{
+}
+
+torr::engine::~engine()
+{
+}
+
+std::expected<bool, const char*> torr::engine::open(engine_backend backend)
+{
+    if (m_ourself.handshake().empty())
+        m_ourself.construct_handshake_string();
+    mkdir(DOWNLOAD_DIRECTORY, 0755);
+    m_has_metadata = m_ourself.has_metadata();
+    m_timers.schedule(clock::now(), { timer_kind::choke });
+
+    if (backend != engine_backend::epoll) {
+        auto opened = open_ring();
+        if (opened.has_value()) {
+            m_backend = engine_backend::io_uring;
+            return true;
+        }
+        if (backend == engine_backend::io_uring)
+            return std::unexpected(opened.error());
+        std::println("{}, falling back to epoll", opened.error());
+    }
+
+    m_epoll.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (!m_epoll.valid())
+        return std::unexpected("engine: epoll_create1 failed");
+    m_backend = engine_backend::epoll;
+    return true;
+}
+
+std::expected<bool, const char*> torr::engine::open_ring()
+{
+    if (!io_ring::available())
+        return std::unexpected("engine: io_uring is unavailable");
+    TRY(m_ring.open(IO_RING_ENTRIES));
+
+    m_ring_slab.resize(ENGINE_RING_SLOTS * ENGINE_RING_SLOT_SIZE);
+    struct iovec slab = { m_ring_slab.data(), m_ring_slab.size() };
+    /* buffers over RLIMIT_MEMLOCK cannot be pinned, the
+     * slots are then used with plain receives */
+    if (!m_ring.register_buffers({ &slab, 1 }).has_value())
+        std::println("engine: io_uring buffers not registered, using plain receives");
+
+    m_free_slots.clear();
+    for (int slot = ENGINE_RING_SLOTS - 1; slot >= 0; --slot)
+        m_free_slots.push_back(slot);
+    return true;
+}
+
+torr::engine_backend torr::engine::backend() const
+{
+    return m_backend;
+}
+
+std::expected<int, const char*>
+    torr::engine::connect(const in_addr& address, size_t port)
+{
+    m_ourself.peer_exchange().add_known({ address, port });
+    auto connection = std::make_unique<torrent_peer>();
+    connection->set_ip_and_port(address, port);
+    TRY(connection->connect_non_blocking(m_ourself));
+    return add(std::move(connection));
+}
+
+std::expected<int, const char*>
+    torr::engine::add(std::unique_ptr<torrent_peer> connection)
+{
+    int fd = connection->socket_file_descriptor();
+    if (fd < 0)
+        return std::unexpected("engine: connection has no socket");
+
+    if (m_backend == engine_backend::io_uring) {
+        if (!m_ring.is_open())
+            return std::unexpected("engine: not opened");
+
+        ring_connection state;
+        if (!m_free_slots.empty()) {
+            state.slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        } else {
+            state.buffer.resize(ENGINE_RING_SLOT_SIZE);
+        }
+        m_ring_connections[fd] = std::move(state);
+    } else {
+        if (!m_epoll.valid())
+            return std::unexpected("engine: not opened");
+
+        struct epoll_event event {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0)
+            return std::unexpected("engine: epoll_ctl failed");
+    }
+
+    torrent_peer& adopted = *connection;
+    adopted.attach_rate_limits(m_ourself);
+    adopted.attach_storage(m_ourself);
+    m_connections[fd] = std::move(connection);
+
+    bool connected = adopted.state() == torrent_peer::connection_state::connected;
+    connection_timers& timers = m_connection_timers[fd];
+    timers.keep_alive = m_timers.schedule_after(keep_alive_interval, { timer_kind::keep_alive, fd });
+    timers.deadline = m_timers.schedule_after(connected ? idle_timeout : connect_timeout,
+        { timer_kind::deadline, fd });
+    timers.requests = m_timers.schedule_after(request_check_interval, { timer_kind::requests, fd });
+
+    /* a peer handshaked elsewhere, ex. by a connector, may already
+     * have messages buffered or waiting in the socket */
+    if (adopted.state() == torrent_peer::connection_state::connected) {
+        if (!adopted.on_readable(m_ourself) || !adopted.socket_healthy()) {
+            detach(fd);
+            return std::unexpected("engine: connection closed");
+        }
+    }
+    return fd;
+}
+
+void torr::engine::detach(int fd)
+{
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end())
+        return;
+
+    it->second->detach(m_ourself);
+    m_ourself.peer_exchange().remove_connected(it->second->address());
+
+    auto timers = m_connection_timers.find(fd);
+    if (timers != m_connection_timers.end()) {
+        m_timers.cancel(timers->second.keep_alive);
+        m_timers.cancel(timers->second.deadline);
+        m_timers.cancel(timers->second.requests);
+        m_connection_timers.erase(timers);
+    }
+
+    if (m_backend == engine_backend::io_uring) {
+        /* requests in flight still point at the socket and its buffers,
+         * shutting down completes them and the connection is freed after */
+        shutdown(fd, SHUT_RDWR);
+        m_closing[fd] = std::move(it->second);
+        m_connections.erase(it);
+        ring_release(fd);
+        return;
+    }
+
+    epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, fd, 0);
+    m_connections.erase(it);
+}
+
+void torr::engine::ring_release(int fd)
+{
+    auto state = m_ring_connections.find(fd);
+    if (state == m_ring_connections.end())
+        return;
+    if (state->second.receiving || state->second.sending || state->second.polling)
+        return;
+
+    if (state->second.slot >= 0)
+        m_free_slots.push_back(state->second.slot);
+    m_ring_connections.erase(state);
+    m_closing.erase(fd);
+}
+
+void torr::engine::handle_completed_piece(torrent_peer& connection)
+{
+    const auto& piece = connection.download_piece();
+    if (!piece.exists || piece.downloaded < piece.piece_size)
+        return;
+
+    size_t piece_index = piece.piece_index;
+    piece_buffer buffer = connection.take_piece_buffer();
+
+    /* an endgame copy completed while the first one is written */
+    if (m_ourself.has_piece(piece_index) || m_ourself.picker().storing(piece_index)) {
+        m_ourself.add_wasted_bytes(buffer.size());
+        m_ourself.release_piece(piece_index);
+    } else if (m_ourself.verify_piece(piece_index, buffer.data())) {
+        m_ourself.picker().set_storing(piece_index, true);
+        store_piece(piece_index, std::move(buffer));
+    } else {
+        std::println("piece {} failed hash check", piece_index);
+        m_ourself.release_piece(piece_index);
+    }
+
+    connection.download_next_piece(m_ourself);
+}
+
+void torr::engine::store_piece(size_t piece_index, piece_buffer buffer)
+{
+    file_storage& storage = m_ourself.storage();
+    if (m_backend != engine_backend::io_uring) {
+        finish_piece(piece_index, storage.write_piece(piece_index, buffer.data()));
+        return;
+    }
+
+    /* one write per file the piece spans, the piece is stored once all completed */
+    uint64_t id = m_next_write++;
+    pending_write& write = m_pending_writes[id];
+    write.buffer = std::move(buffer);
+    write.piece_index = piece_index;
+
+    auto data = std::as_bytes(write.buffer.data());
+    auto slices = storage.map_block(piece_index, 0, data.size());
+    write.stored = !slices.empty();
+    for (const auto& slice : slices) {
+        auto file = storage.file(slice.file_index, true);
+        if (!file || !m_ring.write(file->get(), data.first(slice.length), slice.file_offset,
+            ring_user_data(id, ring_operation::write))) {
+            write.stored = false;
+            break;
+        }
+        write.files.push_back(std::move(file));
+        data = data.subspan(slice.length);
+    }
+
+    if (write.files.empty()) {
+        m_pending_writes.erase(id);
+        finish_piece(piece_index, false);
+    }
+}
+
+void torr::engine::finish_piece(size_t piece_index, bool stored)
+{
+    if (!stored) {
+        std::println("piece {} could not be stored", piece_index);
+        m_ourself.picker().set_storing(piece_index, false);
+        m_ourself.release_piece(piece_index);
+        return;
+    }
+
+    m_ourself.piece_download_complete(piece_index);
+    for (auto& [fd, other] : m_connections)
+        if (other->state() == torrent_peer::connection_state::connected)
+            other->announce_piece(piece_index);
+}
+
+void torr::engine::handle_event(int fd, uint32_t events)
+{
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end())
+        return;
+    torrent_peer& connection = *it->second;
+
+    bool healthy = !(events & (EPOLLERR | EPOLLHUP));
+    if (healthy && (events & EPOLLOUT))
+        healthy = connection.on_writable(m_ourself);
+    if (healthy && (events & (EPOLLIN | EPOLLRDHUP)))
+        healthy = connection.on_readable(m_ourself);
+
+    if (healthy && connection.socket_healthy()) {
+        handle_completed_piece(connection);
+        return;
+    }
+    detach(fd);
+}
+
+void torr::engine::run_choker()
+{
+    if (!m_ourself.choker().due())
+        return;
+
+    std::vector<choker::candidate> candidates;
+    candidates.reserve(m_connections.size());
+    for (const auto& [fd, connection] : m_connections) {
+        if (connection->state() != torrent_peer::connection_state::connected)
+            continue;
+        candidates.push_back({
+            (size_t)fd, connection->peer_interested(),
+            connection->estimator().rate(), connection->upload_estimator().rate()
+        });
+    }
+
+    m_ourself.choker().evaluate(candidates, m_ourself.seeding());
+    for (const auto& candidate : candidates)
+        m_connections[(int)candidate.id]->set_choking(!candidate.unchoke);
+}
+
+void torr::engine::run_timers()
+{
+    m_timers.advance(clock::now(), [this](const timer& expired) {
+        handle_timer(expired);
+    });
+}
+
+void torr::engine::handle_timer(const timer& expired)
+{
+    if (expired.kind == timer_kind::choke) {
+        run_choker();
+        m_timers.schedule_after(choker::round_interval, { timer_kind::choke });
+        return;
+    }
+
+    auto it = m_connections.find(expired.fd);
+    auto timers = m_connection_timers.find(expired.fd);
+    if (it == m_connections.end() || timers == m_connection_timers.end())
+        return;
+    torrent_peer& connection = *it->second;
+    bool connected = connection.state() == torrent_peer::connection_state::connected;
+
+    switch (expired.kind) {
+    case timer_kind::keep_alive:
+        if (connected)
+            connection.send_message_keep_alive();
+        timers->second.keep_alive = m_timers.schedule_after(keep_alive_interval, expired);
+        break;
+
+    case timer_kind::deadline: {
+        /* the idle timeout is checked lazily, a received message
+         * only moves the time the timer is scheduled again for */
+        auto idle_until = connection.last_received() + idle_timeout;
+        if (connected && idle_until > clock::now()) {
+            timers->second.deadline = m_timers.schedule(idle_until, expired);
+            break;
+        }
+        std::println("{}:{} {}", connection.ip_address_as_string(), connection.port(),
+            connected ? "timed out" : "connect timed out");
+        detach(expired.fd);
+        break;
+    }
+
+    case timer_kind::requests:
+        check_requests(expired.fd, connection, timers->second);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void torr::engine::check_requests(int fd, torrent_peer& connection, connection_timers& timers)
+{
+    if (connection.check_request_timeouts(m_ourself)) {
+        /* the piece went back to the picker, connections without a
+         * piece resume it, the stalled one picks on its next message */
+        for (auto& [other_fd, other] : m_connections) {
+            if (other_fd == fd || other->download_piece().exists ||
+                other->state() != torrent_peer::connection_state::connected)
+                continue;
+            other->download_next_piece(m_ourself);
+        }
+    }
+
+    /* checked again once the oldest request is due, the deadline
+     * only moves later as blocks arrive */
+    auto now = clock::now();
+    auto deadline = connection.request_deadline().value_or(now + request_check_interval);
+    timers.requests = m_timers.schedule(deadline, { timer_kind::requests, fd });
+}
+
+int torr::engine::timer_timeout(int timeout_ms) const
+{
+    auto next = m_timers.next_expiry();
+    if (!next.has_value())
+        return timeout_ms;
+
+    /* rounded up, waking before the timer is due would spin */
+    auto until = std::chrono::ceil<std::chrono::milliseconds>(next.value() - clock::now()).count();
+    until = std::max<decltype(until)>(until, 0);
+    return timeout_ms < 0 ? (int)until : (int)std::min<decltype(until)>(until, timeout_ms);
+}
+
+void torr::engine::exchange_metadata()
+{
+    if (m_has_metadata)
+        return;
+
+    /* a magnet downloads nothing until one connection completed the
+     * info dictionary, every connection then learns the piece count */
+    m_has_metadata = m_ourself.has_metadata();
+    for (auto& [fd, connection] : m_connections) {
+        if (connection->state() != torrent_peer::connection_state::connected)
+            continue;
+        if (m_has_metadata)
+            connection->on_metadata(m_ourself);
+        else
+            connection->request_metadata(m_ourself);
+    }
+}
+
+void torr::engine::exchange_peers()
+{
+    auto& exchange = m_ourself.peer_exchange();
+    for (auto& [fd, connection] : m_connections) {
+        if (connection->state() != torrent_peer::connection_state::connected)
+            continue;
+        exchange.add_connected(connection->address());
+        connection->exchange_peers(m_ourself);
+    }
+
+    /* peers learned from the swarm fill free connection slots
+     * right away, instead of waiting for the next announce */
+    size_t slots = ENGINE_MAX_CONNECTIONS - std::min<size_t>(ENGINE_MAX_CONNECTIONS, m_connections.size());
+    for (const auto& address : exchange.take_discovered(slots)) {
+        auto connected = connect(address.address, address.port);
+        if (!connected.has_value())
+            std::println("{}", connected.error());
+    }
+}
+
+std::expected<size_t, const char*> torr::engine::run_once(int timeout_ms)
+{
+    if (m_backend == engine_backend::io_uring)
+        return run_once_ring(timeout_ms);
+    return run_once_epoll(timeout_ms);
+}
+
+std::expected<size_t, const char*> torr::engine::run_once_epoll(int timeout_ms)
+{
+    if (!m_epoll.valid())
+        return std::unexpected("engine: not opened");
+
+    /* edge-triggered readiness does not repeat for data left in the
+     * socket at a rate limit, throttled connections are driven again
+     * once the buckets refilled */
+    std::vector<int> throttled;
+    for (const auto& [fd, connection] : m_connections)
+        if (connection->throttled())
+            throttled.push_back(fd);
+    if (!throttled.empty()) {
+        int refill_ms = std::chrono::milliseconds(TOKEN_BUCKET_REFILL_INTERVAL).count();
+        timeout_ms = timeout_ms < 0 ? refill_ms : std::min(timeout_ms, refill_ms);
+    }
+
+    struct epoll_event events[ENGINE_MAX_EVENTS];
+    int count = epoll_wait(m_epoll.get(), events, ENGINE_MAX_EVENTS, timer_timeout(timeout_ms));
+    if (count < 0) {
+        if (errno == EINTR)
+            return 0;
+        return std::unexpected("engine: epoll_wait failed");
+    }
+
+    for (int i = 0; i < count; ++i)
+        handle_event(events[i].data.fd, events[i].events);
+    for (int fd : throttled)
+        handle_event(fd, EPOLLIN | EPOLLOUT);
+
+    exchange_metadata();
+    exchange_peers();
+    run_timers();
+
+    /* everything queued this turn leaves in one write per connection,
+     * a partial write is resumed by the next EPOLLOUT edge */
+    std::vector<int> unhealthy;
+    for (auto& [fd, connection] : m_connections)
+        if (!connection->flush() || !connection->socket_healthy())
+            unhealthy.push_back(fd);
+    for (int fd : unhealthy)
+        detach(fd);
+
+    return count;
+}
+
+void torr::engine::ring_arm(int fd, torrent_peer& connection, ring_connection& state)
+{
+    bool connecting = connection.state() == torrent_peer::connection_state::connecting;
+    state.throttled = false;
+
+    if (!state.receiving && !connecting) {
+        /* the receive is sized to what the rate limits grant */
+        state.receive_grant = connection.download_limit().request(ENGINE_RING_SLOT_SIZE);
+        if (state.receive_grant) {
+            std::byte* buffer = state.slot >= 0
+                ? m_ring_slab.data() + (size_t)state.slot * ENGINE_RING_SLOT_SIZE
+                : state.buffer.data();
+            std::span<std::byte> region { buffer, state.receive_grant };
+            uint64_t user_data = ring_user_data(fd, ring_operation::receive);
+            state.receiving = (state.slot >= 0 && m_ring.buffers_registered())
+                ? m_ring.receive_fixed(fd, region, 0, user_data)
+                : m_ring.receive(fd, region, user_data);
+        } else {
+            state.throttled = true;
+        }
+    }
+
+    if (state.sending || state.polling)
+        return;
+
+    /* a send stopped at the upload limit is finished first */
+    if (state.send_offset < state.send_buffer.size()) {
+        ring_send(fd, connection, state);
+        return;
+    }
+
+    /* all messages queued since the last send leave in one request */
+    state.send_buffer.clear();
+    state.send_offset = 0;
+    if (connection.take_outgoing(state.send_buffer)) {
+        ring_send(fd, connection, state);
+        return;
+    }
+
+    /* the connect result, and file ranges sent with sendfile(),
+     * wait for the socket to turn writable. A sendfile() stopped at
+     * the upload limit is retried once the throttle timeout expired */
+    if (connection.has_outgoing() && connection.throttled() && m_throttle_armed) {
+        state.throttled = true;
+        return;
+    }
+    if (connecting || connection.has_outgoing())
+        state.polling = m_ring.poll(fd, POLLOUT, ring_user_data(fd, ring_operation::send_poll));
+}
+
+void torr::engine::ring_send(int fd, torrent_peer& connection, ring_connection& state)
+{
+    std::span<const std::byte> rest { state.send_buffer };
+    rest = rest.subspan(state.send_offset);
+    state.send_grant = connection.upload_limit().request(rest.size());
+    if (!state.send_grant) {
+        state.throttled = true;
+        return;
+    }
+    state.sending = m_ring.send(fd, rest.first(state.send_grant),
+        ring_user_data(fd, ring_operation::send));
+}
+
+void torr::engine::ring_complete(const io_ring::completion& completion)
+{
+    auto operation = (ring_operation)(completion.user_data & 0xff);
+    uint64_t id = completion.user_data >> 8;
+
+    if (operation == ring_operation::timeout) {
+        m_ring_timeout_armed = false;
+        return;
+    }
+    if (operation == ring_operation::throttle) {
+        m_throttle_armed = false;
+        return;
+    }
+    if (operation == ring_operation::timer) {
+        m_timer_armed = false;
+        return;
+    }
+
+    if (operation == ring_operation::write) {
+        auto write = m_pending_writes.find(id);
+        if (write == m_pending_writes.end())
+            return;
+        pending_write& pending = write->second;
+        if (completion.result > 0)
+            pending.written += completion.result;
+        if (++pending.completed < pending.files.size())
+            return;
+        finish_piece(pending.piece_index,
+            pending.stored && pending.written == pending.buffer.size());
+        m_pending_writes.erase(write);
+        return;
+    }
+
+    int fd = (int)id;
+    auto state = m_ring_connections.find(fd);
+    if (state == m_ring_connections.end())
+        return;
+
+    switch (operation) {
+    case ring_operation::receive:
+    case ring_operation::receive_poll:
+        state->second.receiving = false;
+        break;
+    case ring_operation::send:
+        state->second.sending = false;
+        break;
+    case ring_operation::send_poll:
+        state->second.polling = false;
+        break;
+    default:
+        break;
+    }
+
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end()) {
+        ring_release(fd);
+        return;
+    }
+    torrent_peer& connection = *it->second;
+    ring_connection& ring_state = state->second;
+    bool healthy = true;
+
+    switch (operation) {
+    case ring_operation::receive:
+        connection.download_limit().refund(
+            ring_state.receive_grant - std::clamp<int32_t>(completion.result, 0, ring_state.receive_grant));
+        ring_state.receive_grant = 0;
+        if (completion.result == -EAGAIN) {
+            /* the socket had nothing, wait for it before receiving again */
+            ring_state.receiving = m_ring.poll(fd, POLLIN,
+                ring_user_data(fd, ring_operation::receive_poll));
+        } else if (completion.result > 0) {
+            std::byte* buffer = ring_state.slot >= 0
+                ? m_ring_slab.data() + (size_t)ring_state.slot * ENGINE_RING_SLOT_SIZE
+                : ring_state.buffer.data();
+            healthy = connection.on_received(m_ourself, { buffer, (size_t)completion.result });
+        } else {
+            healthy = false;
+        }
+        break;
+
+    case ring_operation::send:
+        connection.upload_limit().refund(
+            ring_state.send_grant - std::clamp<int32_t>(completion.result, 0, ring_state.send_grant));
+        ring_state.send_grant = 0;
+        if (completion.result < 0 && completion.result != -EAGAIN) {
+            healthy = false;
+            break;
+        }
+        if (completion.result > 0)
+            ring_state.send_offset += completion.result;
+        /* a partial send is resumed from where it stopped */
+        if (ring_state.send_offset < ring_state.send_buffer.size())
+            ring_send(fd, connection, ring_state);
+        break;
+
+    case ring_operation::send_poll:
+        if (completion.result < 0 || (completion.result & (POLLERR | POLLHUP)))
+            healthy = false;
+        else
+            healthy = connection.on_writable(m_ourself);
+        break;
+
+    default:
+        break;
+    }
+
+    if (healthy && connection.socket_healthy()) {
+        handle_completed_piece(connection);
+        return;
+    }
+    detach(fd);
+}
+
+std::expected<size_t, const char*> torr::engine::run_once_ring(int timeout_ms)
+{
+    if (!m_ring.is_open())
+        return std::unexpected("engine: not opened");
+
+    bool throttled = false;
+    for (auto& [fd, connection] : m_connections) {
+        ring_connection& state = m_ring_connections[fd];
+        ring_arm(fd, *connection, state);
+        throttled |= state.throttled;
+    }
+
+    if (!m_ring_timeout_armed) {
+        m_ring_timeout.tv_sec = timeout_ms / 1000;
+        m_ring_timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        m_ring_timeout_armed = m_ring.timeout(&m_ring_timeout,
+            ring_user_data(0, ring_operation::timeout));
+    }
+
+    /* requests held back by the rate limits are armed again after a refill */
+    if (throttled && !m_throttle_armed) {
+        auto refill = std::chrono::nanoseconds(TOKEN_BUCKET_REFILL_INTERVAL);
+        m_throttle_timeout.tv_sec = 0;
+        m_throttle_timeout.tv_nsec = refill.count();
+        m_throttle_armed = m_ring.timeout(&m_throttle_timeout,
+            ring_user_data(0, ring_operation::throttle));
+    }
+
+    /* a timeout armed for a later timer still completes, it only wakes a turn */
+    auto next = m_timers.next_expiry();
+    if (next.has_value() && (!m_timer_armed || next.value() < m_timer_deadline)) {
+        auto until = std::max<clock::duration>(next.value() - clock::now(), clock::duration::zero());
+        auto seconds = std::chrono::floor<std::chrono::seconds>(until);
+        m_timer_timeout.tv_sec = seconds.count();
+        m_timer_timeout.tv_nsec = std::chrono::nanoseconds(until - seconds).count();
+        m_timer_armed = m_ring.timeout(&m_timer_timeout, ring_user_data(0, ring_operation::timer));
+        m_timer_deadline = next.value();
+    }
+
+    /* the single syscall of the turn, submits and waits */
+    TRY(m_ring.submit(1));
+
+    size_t handled = 0;
+    io_ring::completion completions[ENGINE_MAX_EVENTS];
+    for (;;) {
+        size_t count = m_ring.reap(completions);
+        for (size_t i = 0; i < count; ++i)
+            ring_complete(completions[i]);
+        handled += count;
+        if (count < ENGINE_MAX_EVENTS)
+            break;
+    }
+
+    exchange_metadata();
+    exchange_peers();
+    run_timers();
+    return handled;
+}
+
+void torr::engine::run()
+{
+    m_running = true;
+    while (m_running && !m_connections.empty())
+        MUST(run_once(1000));
+}
+
+void torr::engine::stop()
+{
+    m_running = false;
+}
+
+size_t torr::engine::connection_count() const
+{
+    return m_connections.size();
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <network/peer/peer.hpp>
+#include <network/socket/io_ring.hpp>
+#include <generic/file_descriptor.hpp>
+#include <generic/timer_wheel.hpp>
+#include <unordered_map>
+#include <expected>
+#include <memory>
+#include <vector>
+
+#define ENGINE_MAX_EVENTS 256
+#define ENGINE_RING_SLOTS 1024
+#define ENGINE_RING_SLOT_SIZE 16384
+/* peers learned with ut_pex are connected to up to this many connections */
+#define ENGINE_MAX_CONNECTIONS 64
+#define ENGINE_TIMER_RESOLUTION std::chrono::milliseconds(10)
+
+namespace torr {
+
+enum class engine_backend {
+    /* io_uring if the kernel offers it, epoll otherwise */
+    automatic = 0,
+    epoll = 1,
+    io_uring = 2,
+};
+
+/* Drives many peer connections from a single thread. With epoll the
+ * sockets are non-blocking and registered edge-triggered, each
+ * torrent_peer reacts to readiness events as a state machine. With
+ * io_uring receives land in registered buffers, sends and piece writes
+ * are submitted to the ring, and one io_uring_enter() per turn both
+ * submits and waits. All connections share one peer, so the picker,
+ * the choker and endgame see the whole swarm. Keep-alives, deadlines
+ * and choke rounds are timers on a wheel advanced once per turn, the
+ * turn never waits past the earliest of them. */
+class engine {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::duration keep_alive_interval = std::chrono::seconds(90);
+    static constexpr clock::duration connect_timeout = std::chrono::seconds(10);
+    /* a connection silent for this long, keep-alives included, is dropped */
+    static constexpr clock::duration idle_timeout = std::chrono::seconds(180);
+    /* how often a connection without outstanding requests is checked */
+    static constexpr clock::duration request_check_interval = std::chrono::seconds(1);
+
+private:
+    enum class timer_kind : uint8_t {
+        choke = 0,
+        keep_alive = 1,
+        /* connect and handshake, then the idle timeout */
+        deadline = 2,
+        requests = 3,
+    };
+
+    struct timer {
+        timer_kind kind {};
+        int fd { -1 };
+    };
+
+    /* cancelled when the connection is detached, its fd may be reused */
+    struct connection_timers {
+        timer_wheel<timer>::timer_id keep_alive {};
+        timer_wheel<timer>::timer_id deadline {};
+        timer_wheel<timer>::timer_id requests {};
+    };
+
+    /* per connection io_uring state, a receive is always in flight */
+    struct ring_connection {
+        /* registered buffer slot, -1 if the receive uses buffer */
+        int slot { -1 };
+        std::vector<std::byte> buffer;
+        std::vector<std::byte> send_buffer;
+        size_t send_offset {};
+        /* tokens taken for the requests in flight */
+        size_t receive_grant {};
+        size_t send_grant {};
+        bool receiving {};
+        bool sending {};
+        bool polling {};
+        /* a request waits for the rate limits to refill */
+        bool throttled {};
+    };
+
+    struct pending_write {
+        /* the files written to, kept open until every write completed */
+        std::vector<std::shared_ptr<file_descriptor>> files;
+        piece_buffer buffer;
+        size_t piece_index {};
+        size_t completed {};
+        size_t written {};
+        /* every write was submitted */
+        bool stored {};
+    };
+
+    peer& m_ourself;
+    engine_backend m_backend { engine_backend::epoll };
+    bool m_running { false };
+    bool m_has_metadata { false };
+    std::unordered_map<int, std::unique_ptr<torrent_peer>> m_connections;
+    timer_wheel<timer> m_timers { ENGINE_TIMER_RESOLUTION };
+    std::unordered_map<int, connection_timers> m_connection_timers;
+
+    file_descriptor m_epoll;
+
+    io_ring m_ring;
+    std::vector<std::byte> m_ring_slab;
+    std::vector<int> m_free_slots;
+    std::unordered_map<int, ring_connection> m_ring_connections;
+    /* detached connections whose requests have not completed yet */
+    std::unordered_map<int, std::unique_ptr<torrent_peer>> m_closing;
+    std::unordered_map<uint64_t, pending_write> m_pending_writes;
+    uint64_t m_next_write {};
+    struct __kernel_timespec m_ring_timeout {};
+    bool m_ring_timeout_armed { false };
+    struct __kernel_timespec m_throttle_timeout {};
+    bool m_throttle_armed { false };
+    /* woken for the earliest timer, re-armed if an earlier one appears */
+    struct __kernel_timespec m_timer_timeout {};
+    clock::time_point m_timer_deadline {};
+    bool m_timer_armed { false };
+
+    std::expected<bool, const char*> open_ring();
+    std::expected<size_t, const char*> run_once_epoll(int timeout_ms);
+    std::expected<size_t, const char*> run_once_ring(int timeout_ms);
+    void handle_event(int fd, uint32_t events);
+    void ring_arm(int fd, torrent_peer& connection, ring_connection& state);
+    void ring_send(int fd, torrent_peer& connection, ring_connection& state);
+    void ring_complete(const io_ring::completion& completion);
+    void ring_release(int fd);
+
+    void handle_completed_piece(torrent_peer& connection);
+    void store_piece(size_t piece_index, piece_buffer buffer);
+    void finish_piece(size_t piece_index, bool stored);
+    void run_choker();
+    void run_timers();
+    void handle_timer(const timer& expired);
+    void check_requests(int fd, torrent_peer& connection, connection_timers& timers);
+    /* the turn's wait, shortened to the earliest timer */
+    int timer_timeout(int timeout_ms) const;
+    void exchange_metadata();
+    void exchange_peers();
+    void detach(int fd);
+
+public:
+    engine(peer& ourself);
+    ~engine();
+
+    std::expected<bool, const char*> open(engine_backend backend = engine_backend::automatic);
+    engine_backend backend() const;
+    /* starts a non-blocking connect, the handshake follows once writable */
+    std::expected<int, const char*> connect(const in_addr& address, size_t port);
+    /* adopts a non-blocking peer, ex. one handed back by a connector */
+    std::expected<int, const char*> add(std::unique_ptr<torrent_peer> connection);
+
+    /* waits up to timeout_ms and handles one batch of events or completions */
+    std::expected<size_t, const char*> run_once(int timeout_ms);
+    void run();
+    void stop();
+
+    size_t connection_count() const;
+};
+
+}
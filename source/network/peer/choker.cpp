@@ -0,0 +1,78 @@
+#include "choker.hpp"
+#include <algorithm>
+#include <vector>
+
+torr::choker::choker()
+    : m_random(std::random_device {}())
+{
+}
+
+torr::choker::~choker() {}
+
+void torr::choker::set_unchoke_slots(size_t slots)
+{
+    m_unchoke_slots = slots;
+}
+
+size_t torr::choker::unchoke_slots() const
+{
+    return m_unchoke_slots;
+}
+
+bool torr::choker::due(clock::time_point now)
+{
+    if (now < m_next_round)
+        return false;
+    m_next_round = now + round_interval;
+    return true;
+}
+
+void torr::choker::evaluate(std::span<candidate> candidates, bool seeding)
+{
+    std::vector<candidate*> interested;
+    for (auto& c : candidates) {
+        c.unchoke = false;
+        if (c.interested)
+            interested.push_back(&c);
+    }
+
+    auto rate = [seeding](const candidate* c) {
+        return seeding ? c->upload_rate : c->download_rate;
+    };
+
+    std::stable_sort(interested.begin(), interested.end(),
+        [&](const candidate* a, const candidate* b) { return rate(a) > rate(b); });
+
+    size_t regular = std::min(m_unchoke_slots, interested.size());
+    for (size_t i = 0; i < regular; ++i)
+        interested[i]->unchoke = true;
+
+    /* the optimistic slot rotates every few rounds, or earlier if its
+     * peer left, lost interest or earned a regular slot */
+    auto optimistic = std::find_if(interested.begin() + regular, interested.end(),
+        [&](const candidate* c) { return m_has_optimistic && c->id == m_optimistic_id; });
+
+    bool rotate = (m_round++ % CHOKER_OPTIMISTIC_ROUNDS == 0);
+    if (optimistic == interested.end() || rotate) {
+        m_has_optimistic = false;
+        size_t remaining = interested.size() - regular;
+        if (remaining) {
+            optimistic = interested.begin() + regular + m_random() % remaining;
+            m_optimistic_id = (*optimistic)->id;
+            m_has_optimistic = true;
+        }
+    }
+
+    if (m_has_optimistic)
+        (*optimistic)->unchoke = true;
+}
+
+bool torr::choker::has_optimistic() const
+{
+    return m_has_optimistic;
+}
+
+size_t torr::choker::optimistic_id() const
+{
+    return m_optimistic_id;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <span>
+
+#define CHOKER_UNCHOKE_SLOTS 4
+#define CHOKER_OPTIMISTIC_ROUNDS 3
+
+namespace torr {
+
+/* Tit-for-tat choking. Every round the interested peers that gave us
+ * the most, by download rate, or that took the most once we seed, by
+ * upload rate, are unchoked. One more slot rotates optimistically over
+ * the remaining interested peers every few rounds, so new peers get a
+ * chance to prove themselves. */
+class choker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::duration round_interval = std::chrono::seconds(10);
+
+    struct candidate {
+        /* caller chosen, stable across rounds */
+        size_t id {};
+        bool interested {};
+        double download_rate {};
+        double upload_rate {};
+        /* decision of the last evaluate() */
+        bool unchoke {};
+    };
+
+private:
+    size_t m_unchoke_slots { CHOKER_UNCHOKE_SLOTS };
+    clock::time_point m_next_round {};
+    size_t m_round {};
+    size_t m_optimistic_id {};
+    bool m_has_optimistic {};
+    std::minstd_rand m_random;
+
+public:
+    choker();
+    ~choker();
+
+    void set_unchoke_slots(size_t slots);
+    size_t unchoke_slots() const;
+
+    /* true once per round interval */
+    bool due(clock::time_point now = clock::now());
+
+    /* decides candidate.unchoke for every candidate */
+    void evaluate(std::span<candidate> candidates, bool seeding);
+
+    bool has_optimistic() const;
+    size_t optimistic_id() const;
+};
+
+}
@@ -0,0 +1,188 @@
+#include "connector.hpp"
+#include <generic/try.hpp>
+#include <algorithm>
+#include <print>
+#include <sys/epoll.h>
+
+torr::connector::connector(peer& ourself, size_t max_in_flight, clock::duration timeout,
+    clock::duration ready_timeout)
+    : m_ourself(ourself),
+    m_max_in_flight(std::max<size_t>(max_in_flight, 1)),
+    m_timeout(timeout),
+    m_ready_timeout(ready_timeout)
+{
+}
+
+torr::connector::~connector()
+{
+}
+
+std::expected<bool, const char*> torr::connector::open()
+{
+    m_epoll.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (!m_epoll.valid())
+        return std::unexpected("connector: epoll_create1 failed");
+    return true;
+}
+
+void torr::connector::add_candidate(const peer_ip_touple& address)
+{
+    m_candidates.push_back(address);
+}
+
+void torr::connector::add_candidates(std::span<const peer_ip_touple> addresses)
+{
+    m_candidates.insert(m_candidates.end(), addresses.begin(), addresses.end());
+}
+
+void torr::connector::start_attempts()
+{
+    while (m_attempts.size() < m_max_in_flight && !m_candidates.empty()) {
+        peer_ip_touple address = m_candidates.front();
+        m_candidates.pop_front();
+
+        auto connection = std::make_unique<torrent_peer>();
+        connection->set_ip_and_port(address.address, address.port);
+        auto fd = connection->connect_non_blocking(m_ourself);
+        if (!fd.has_value())
+            continue;
+
+        struct epoll_event event {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        event.data.fd = fd.value();
+        if (epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, fd.value(), &event) < 0)
+            continue;
+
+        std::println("testing peer {}:{}", connection->ip_address_as_string(), connection->port());
+        m_attempts[fd.value()] = { std::move(connection), clock::now() + m_timeout };
+    }
+}
+
+void torr::connector::drop(int fd)
+{
+    epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, fd, 0);
+    m_attempts.erase(fd);
+}
+
+void torr::connector::expire_attempts(clock::time_point now)
+{
+    for (auto it = m_attempts.begin(); it != m_attempts.end();) {
+        if (it->second.deadline > now) {
+            ++it;
+            continue;
+        }
+        epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, it->first, 0);
+        it = m_attempts.erase(it);
+    }
+}
+
+void torr::connector::expire_ready(clock::time_point now)
+{
+    /* handed back in order, the oldest peers are in front */
+    while (!m_ready.empty() && now - m_ready.front().since >= m_ready_timeout)
+        m_ready.pop_front();
+}
+
+void torr::connector::handle_event(int fd, uint32_t events)
+{
+    auto it = m_attempts.find(fd);
+    if (it == m_attempts.end())
+        return;
+    torrent_peer& connection = *it->second.connection;
+
+    bool healthy = !(events & (EPOLLERR | EPOLLHUP));
+    if (healthy && (events & EPOLLOUT))
+        healthy = connection.on_writable(m_ourself);
+    if (healthy && (events & (EPOLLIN | EPOLLRDHUP)))
+        healthy = connection.on_handshake_readable(m_ourself);
+
+    if (!healthy || !connection.socket_healthy()) {
+        drop(fd);
+        return;
+    }
+
+    if (connection.state() == torrent_peer::connection_state::connected) {
+        epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, fd, 0);
+        m_ready.push_back({ std::move(it->second.connection), clock::now() });
+        m_attempts.erase(it);
+    }
+}
+
+std::expected<size_t, const char*> torr::connector::poll(int timeout_ms)
+{
+    if (!m_epoll.valid())
+        return std::unexpected("connector: not opened");
+
+    expire_ready(clock::now());
+    start_attempts();
+    if (m_attempts.empty())
+        return 0;
+
+    /* never sleep past the nearest deadline */
+    auto now = clock::now();
+    auto nearest = std::min_element(m_attempts.begin(), m_attempts.end(),
+        [](const auto& a, const auto& b) { return a.second.deadline < b.second.deadline; });
+    auto until_deadline = std::chrono::duration_cast<std::chrono::milliseconds>(
+        nearest->second.deadline - now).count();
+    timeout_ms = std::clamp<int>(until_deadline, 0, timeout_ms);
+
+    size_t ready = m_ready.size();
+    struct epoll_event events[CONNECTOR_MAX_IN_FLIGHT];
+    int count = epoll_wait(m_epoll.get(), events, CONNECTOR_MAX_IN_FLIGHT, timeout_ms);
+    if (count < 0 && errno != EINTR)
+        return std::unexpected("connector: epoll_wait failed");
+
+    for (int i = 0; i < count; ++i)
+        handle_event(events[i].data.fd, events[i].events);
+
+    expire_attempts(clock::now());
+    start_attempts();
+    return m_ready.size() - ready;
+}
+
+std::unique_ptr<torr::torrent_peer> torr::connector::take()
+{
+    if (m_ready.empty())
+        return nullptr;
+    auto connection = std::move(m_ready.front().connection);
+    m_ready.pop_front();
+    return connection;
+}
+
+std::expected<std::unique_ptr<torr::torrent_peer>, const char*> torr::connector::next()
+{
+    while (m_ready.empty() && !exhausted())
+        TRY(poll(1000));
+    if (m_ready.empty())
+        return std::unexpected("connector: no candidate completed the handshake");
+    return take();
+}
+
+void torr::connector::clear()
+{
+    /* no EPOLL_CTL_DEL, after a fork the epoll set is shared with the
+     * parent, closed sockets leave it once no process holds them */
+    m_attempts.clear();
+    m_candidates.clear();
+    m_ready.clear();
+}
+
+size_t torr::connector::in_flight() const
+{
+    return m_attempts.size();
+}
+
+size_t torr::connector::candidates() const
+{
+    return m_candidates.size();
+}
+
+size_t torr::connector::ready() const
+{
+    return m_ready.size();
+}
+
+bool torr::connector::exhausted() const
+{
+    return m_candidates.empty() && m_attempts.empty() && m_ready.empty();
+}
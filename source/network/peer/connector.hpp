@@ -0,0 +1,81 @@
+#pragma once
+
+#include <network/peer/peer.hpp>
+#include <generic/file_descriptor.hpp>
+#include <unordered_map>
+#include <expected>
+#include <chrono>
+#include <memory>
+#include <deque>
+#include <span>
+
+#define CONNECTOR_MAX_IN_FLIGHT 32
+#define CONNECTOR_ATTEMPT_TIMEOUT std::chrono::seconds(3)
+#define CONNECTOR_READY_TIMEOUT std::chrono::seconds(30)
+
+namespace torr {
+
+/* Connects to candidate peers in parallel. Up to max_in_flight
+ * non-blocking connects and handshakes run at once, each with its own
+ * deadline, so dead addresses cost a slot for a few seconds instead of
+ * blocking the next attempt. Peers are handed back in the order their
+ * handshakes complete, peers nobody takes are closed after a while
+ * since they get no keep-alives. */
+class connector {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct attempt {
+        std::unique_ptr<torrent_peer> connection;
+        clock::time_point deadline;
+    };
+
+    struct ready_peer {
+        std::unique_ptr<torrent_peer> connection;
+        clock::time_point since;
+    };
+
+    peer& m_ourself;
+    file_descriptor m_epoll;
+    std::deque<peer_ip_touple> m_candidates;
+    std::unordered_map<int, attempt> m_attempts;
+    std::deque<ready_peer> m_ready;
+    size_t m_max_in_flight;
+    clock::duration m_timeout;
+    clock::duration m_ready_timeout;
+
+    void start_attempts();
+    void expire_attempts(clock::time_point now);
+    void expire_ready(clock::time_point now);
+    void handle_event(int fd, uint32_t events);
+    void drop(int fd);
+
+public:
+    connector(peer& ourself, size_t max_in_flight = CONNECTOR_MAX_IN_FLIGHT,
+        clock::duration timeout = CONNECTOR_ATTEMPT_TIMEOUT,
+        clock::duration ready_timeout = CONNECTOR_READY_TIMEOUT);
+    ~connector();
+
+    std::expected<bool, const char*> open();
+    void add_candidate(const peer_ip_touple& address);
+    void add_candidates(std::span<const peer_ip_touple> addresses);
+
+    /* drives the attempts for at most timeout_ms, returns how many
+     * peers completed their handshake */
+    std::expected<size_t, const char*> poll(int timeout_ms);
+    /* a handshaked, non-blocking peer, nullptr if none is ready */
+    std::unique_ptr<torrent_peer> take();
+    /* polls until a peer is ready or every candidate failed */
+    std::expected<std::unique_ptr<torrent_peer>, const char*> next();
+
+    /* closes every attempt and forgets the candidates */
+    void clear();
+
+    size_t in_flight() const;
+    size_t candidates() const;
+    size_t ready() const;
+    bool exhausted() const;
+};
+
+}
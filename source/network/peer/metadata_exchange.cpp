@@ -0,0 +1,121 @@
+#include "metadata_exchange.hpp"
+#include <algorithm>
+#include <cstring>
+#include <openssl/sha.h>
+
+torr::metadata_exchange::metadata_exchange() {}
+torr::metadata_exchange::~metadata_exchange() {}
+
+void torr::metadata_exchange::set_info_hash(std::span<const std::byte> info_hash)
+{
+    m_info_hash.assign(info_hash.begin(), info_hash.end());
+}
+
+void torr::metadata_exchange::reset(size_t size)
+{
+    m_data.assign(size, {});
+    m_pieces.assign((size + METADATA_PIECE_SIZE - 1) / METADATA_PIECE_SIZE, {});
+    m_received = 0;
+    m_complete = false;
+}
+
+bool torr::metadata_exchange::set_size(size_t size)
+{
+    if (!size || size > METADATA_MAX_SIZE)
+        return false;
+    if (m_complete || m_sizes.size() >= METADATA_MAX_SIZES ||
+        std::ranges::find(m_sizes, size) != m_sizes.end())
+        return true;
+
+    m_sizes.push_back(size);
+    if (m_sizes.size() == 1)
+        reset(size);
+    return true;
+}
+
+bool torr::metadata_exchange::has_size() const
+{
+    return !m_data.empty();
+}
+
+std::optional<size_t> torr::metadata_exchange::pick(clock::time_point now)
+{
+    if (m_complete)
+        return {};
+
+    for (size_t i = 0; i < m_pieces.size(); ++i) {
+        auto& piece = m_pieces[i];
+        if (piece.received)
+            continue;
+        if (piece.requested && now - piece.sent < request_timeout)
+            continue;
+        piece.requested = true;
+        piece.sent = now;
+        return i;
+    }
+    return {};
+}
+
+void torr::metadata_exchange::release(size_t piece)
+{
+    if (piece < m_pieces.size())
+        m_pieces[piece].requested = false;
+}
+
+std::expected<bool, const char*>
+    torr::metadata_exchange::receive(size_t piece, std::span<const std::byte> data)
+{
+    if (m_complete)
+        return true;
+    if (piece >= m_pieces.size() || data.size() != piece_size(piece))
+        return std::unexpected("metadata exchange: invalid piece");
+    if (m_pieces[piece].received)
+        return false;
+
+    memcpy(m_data.data() + piece * METADATA_PIECE_SIZE, data.data(), data.size());
+    m_pieces[piece].received = true;
+    m_pieces[piece].requested = false;
+    if (++m_received < m_pieces.size())
+        return false;
+
+    std::byte digest[SHA_DIGEST_LENGTH];
+    SHA1((const uint8_t*)m_data.data(), m_data.size(), (uint8_t*)digest);
+    if (m_info_hash.size() != sizeof(digest) ||
+        memcmp(digest, m_info_hash.data(), sizeof(digest)) != 0) {
+        /* either a piece or the size was garbage, the next announced
+         * size is tried and this one again after the others */
+        std::rotate(m_sizes.begin(), m_sizes.begin() + 1, m_sizes.end());
+        reset(m_sizes.front());
+        return std::unexpected("metadata exchange: info-hash mismatch");
+    }
+
+    m_complete = true;
+    return true;
+}
+
+bool torr::metadata_exchange::complete() const
+{
+    return m_complete;
+}
+
+size_t torr::metadata_exchange::size() const
+{
+    return m_data.size();
+}
+
+size_t torr::metadata_exchange::piece_count() const
+{
+    return m_pieces.size();
+}
+
+size_t torr::metadata_exchange::piece_size(size_t piece) const
+{
+    if (piece >= m_pieces.size())
+        return 0;
+    return std::min<size_t>(METADATA_PIECE_SIZE, m_data.size() - piece * METADATA_PIECE_SIZE);
+}
+
+std::span<const std::byte> torr::metadata_exchange::data() const
+{
+    return m_data;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <vector>
+#include <span>
+
+/* BEP 9, the info dictionary is exchanged in 16 KiB pieces */
+#define METADATA_PIECE_SIZE 16384
+#define METADATA_MAX_SIZE 8388608
+#define METADATA_REQUESTS_PER_PEER 2
+#define METADATA_MAX_SIZES 8
+
+namespace torr {
+
+/* Assembles the info dictionary of a magnet from ut_metadata pieces.
+ * Each piece is handed to one connection at a time, so several peers
+ * download different pieces in parallel, and a piece whose request
+ * timed out is handed out again. The assembled dictionary is only
+ * accepted if its SHA1 is the info-hash, otherwise it starts over with
+ * the next size peers announced, a wrong size never wins for good. */
+class metadata_exchange {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::duration request_timeout = std::chrono::seconds(10);
+
+private:
+    struct metadata_piece {
+        bool received {};
+        bool requested {};
+        clock::time_point sent {};
+    };
+
+    std::vector<std::byte> m_info_hash;
+    /* distinct announced sizes, the first one is being downloaded */
+    std::vector<size_t> m_sizes;
+    std::vector<std::byte> m_data;
+    std::vector<metadata_piece> m_pieces;
+    size_t m_received {};
+    bool m_complete {};
+
+    void reset(size_t size);
+
+public:
+    metadata_exchange();
+    ~metadata_exchange();
+
+    void set_info_hash(std::span<const std::byte> info_hash);
+    /* the size announced in an extended handshake, the first valid one
+     * is downloaded, others are tried on a hash mismatch, false if invalid */
+    bool set_size(size_t size);
+    bool has_size() const;
+    /* a piece nobody is downloading, marked as requested at now */
+    std::optional<size_t> pick(clock::time_point now = clock::now());
+    /* the piece was rejected or its connection is gone */
+    void release(size_t piece);
+    /* true once every piece arrived and the hash matched */
+    std::expected<bool, const char*> receive(size_t piece, std::span<const std::byte> data);
+
+    bool complete() const;
+    size_t size() const;
+    size_t piece_count() const;
+    size_t piece_size(size_t piece) const;
+    std::span<const std::byte> data() const;
+};
+
+}
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <random>
 #include <print>
+#include <format>
 #include <utility>
 #include <climits>
 #include <cstring>
@@ -10,7 +11,12 @@
 #include <string.h>
 #include <algorithm>
 #include <functional>
+#include <fcntl.h>
 #include <arpa/inet.h>
+#include <openssl/sha.h>
+#include <generic/try.hpp>
+#include <generic/bencode_view.hpp>
+#include <generic/bencode_writer.hpp>
 
 #define MAX_BYTES_IN_BITMAP 1024
 #define HANDSHAKE_PREFIX \
@@ -66,18 +72,125 @@ size_t torr::peer::construct_handshake_string()
         m_identifier.end()
     );
 
+    m_handshake[HANDSHAKE_RESERVED_FAST_BYTE] |= (std::byte)HANDSHAKE_RESERVED_FAST;
+    m_handshake[HANDSHAKE_RESERVED_EXTENDED_BYTE] |= (std::byte)HANDSHAKE_RESERVED_EXTENDED;
+
     std::println("handshake length {} ", m_handshake.size());
     return m_handshake.size();
 }
 
 void torr::peer::set_shared_bitfield(uint8_t* shared_pointer, size_t bytes_size)
 {
-    m_bitfield_pieces.from_existing_buffer(shared_pointer, bytes_size);
+    size_t piece_count = 0;
+    if (m_download_target)
+        piece_count = m_download_target->piece_count().value_or(0);
+    m_bitfield_pieces.from_existing_buffer(shared_pointer, bytes_size,
+        std::min(piece_count, bytes_size * 8));
+}
+
+bool torr::peer::verify_piece(size_t piece_index, std::span<const std::byte> data) const
+{
+    if (!m_download_target)
+        return false;
+
+    auto hashes = m_download_target->piece_hashes();
+    auto size = m_download_target->piece_size(piece_index);
+    if (!hashes || !size || piece_index >= hashes->size() || data.size() != *size)
+        return false;
+
+    piece_hash digest;
+    SHA1((const uint8_t*)data.data(), data.size(), (uint8_t*)digest.bytes);
+    return memcmp(digest.bytes, (*hashes)[piece_index].bytes, sizeof(digest.bytes)) == 0;
 }
 
 void torr::peer::piece_download_complete(size_t piece_index)
 {
     m_bitfield_pieces.bit_set(piece_index);
+    m_picker.set_have(piece_index);
+    m_partial_pieces.erase(piece_index);
+}
+
+std::optional<size_t> torr::peer::pick_piece(const dynamic_bitset& remote)
+{
+    /* pieces finished by other tasks only show up in the shared bitfield */
+    for (;;) {
+        /* in endgame a piece another connection is downloading is
+         * requested again, whichever copy completes first wins */
+        auto piece = m_picker.pick(remote);
+        if (!piece.has_value())
+            piece = m_picker.pick_endgame(remote);
+        if (!piece.has_value())
+            return {};
+        if (m_bitfield_pieces.bit_get(*piece)) {
+            m_picker.set_have(*piece);
+            continue;
+        }
+        m_picker.add_downloader(*piece);
+        return piece;
+    }
+}
+
+bool torr::peer::claim_piece(size_t piece_index)
+{
+    if (piece_index >= m_picker.piece_count() || has_piece(piece_index) ||
+        m_picker.downloaders(piece_index))
+        return false;
+    m_picker.add_downloader(piece_index);
+    return true;
+}
+
+void torr::peer::release_piece(size_t piece_index)
+{
+    m_picker.remove_downloader(piece_index);
+}
+
+void torr::peer::keep_partial_piece(size_t piece_index, piece_buffer buffer)
+{
+    if (buffer.empty() || !buffer.received() || has_piece(piece_index))
+        return;
+
+    /* one copy per piece, blocks past the limit are lost */
+    if (m_partial_pieces.contains(piece_index) || m_partial_pieces.size() >= MAX_PARTIAL_PIECES) {
+        add_wasted_bytes(buffer.received());
+        return;
+    }
+    m_partial_pieces.emplace(piece_index, std::move(buffer));
+}
+
+torr::piece_buffer torr::peer::take_partial_piece(size_t piece_index)
+{
+    auto it = m_partial_pieces.find(piece_index);
+    if (it == m_partial_pieces.end())
+        return {};
+    piece_buffer buffer = std::move(it->second);
+    m_partial_pieces.erase(it);
+    return buffer;
+}
+
+std::optional<size_t> torr::peer::pick_partial_piece(const dynamic_bitset& remote)
+{
+    /* pieces finished meanwhile, ex. by an endgame copy, are dropped */
+    std::erase_if(m_partial_pieces, [&](const auto& partial) { return has_piece(partial.first); });
+
+    for (const auto& [piece_index, buffer] : m_partial_pieces)
+        if (remote.bit_get(piece_index) && claim_piece(piece_index))
+            return piece_index;
+    return {};
+}
+
+bool torr::peer::has_piece(size_t piece_index) const
+{
+    return m_bitfield_pieces.bit_get(piece_index) || m_picker.have(piece_index);
+}
+
+void torr::peer::add_wasted_bytes(size_t bytes)
+{
+    m_wasted_bytes += bytes;
+}
+
+size_t torr::peer::wasted_bytes() const
+{
+    return m_wasted_bytes;
 }
 
 const std::vector<std::byte>& torr::peer::identifier() const
@@ -100,14 +213,98 @@ const dynamic_bitset& torr::peer::bitfield_pieces() const
     return m_bitfield_pieces;
 }
 
+torr::piece_picker& torr::peer::picker()
+{
+    return m_picker;
+}
+
+torr::piece_buffer_pool& torr::peer::piece_buffers()
+{
+    return m_piece_buffers;
+}
+
+torr::file_storage& torr::peer::storage()
+{
+    return m_storage;
+}
+
+const torr::piece_picker& torr::peer::picker() const
+{
+    return m_picker;
+}
+
+torr::metadata_exchange& torr::peer::metadata()
+{
+    return m_metadata;
+}
+
+torr::peer_exchange& torr::peer::peer_exchange()
+{
+    return m_peer_exchange;
+}
+
+torr::token_bucket& torr::peer::download_limit()
+{
+    return m_download_limit;
+}
+
+torr::token_bucket& torr::peer::upload_limit()
+{
+    return m_upload_limit;
+}
+
+void torr::peer::set_global_limits(token_bucket* download, token_bucket* upload)
+{
+    m_download_limit.set_parent(download);
+    m_upload_limit.set_parent(upload);
+}
+
+torr::choker& torr::peer::choker()
+{
+    return m_choker;
+}
+
+bool torr::peer::seeding() const
+{
+    size_t piece_count = m_bitfield_pieces.bits_size();
+    for (size_t i = 0; i < piece_count; ++i)
+        if (!has_piece(i)) return false;
+    return piece_count > 0;
+}
+
 void torr::peer::set_download_target(const torrent_source& ts)
 {
     m_download_target = ts.copy();
-    m_bitfield_pieces.resize(1024); /* FIXME: how many pieces in file actually */
+    m_bitfield_pieces.resize_bits(ts.piece_count().value_or(0));
+    m_picker.resize(ts.piece_count().value_or(0));
+    m_piece_buffers.configure(ts.piece_length().value_or(0), MAX_BLOCK_SIZE);
+    m_storage.set_layout(m_download_target->files().value_or(nullptr));
+    if (ts.file_hash().has_value())
+        m_metadata.set_info_hash(*ts.file_hash().value());
+}
+
+std::expected<bool, const char*> torr::peer::set_metadata(std::span<const std::byte> info)
+{
+    if (!m_download_target)
+        return std::unexpected("peer: no download target");
+    if (has_metadata())
+        return true;
+
+    auto target = m_download_target->copy();
+    TRY(target->set_info(info));
+    set_download_target(*target);
+    return true;
+}
+
+bool torr::peer::has_metadata() const
+{
+    return m_download_target && m_download_target->piece_count().has_value();
 }
 
 torr::torrent_peer::torrent_peer()
+    : m_last_received(transfer_estimator::clock::now())
 {
+    m_tcp.set_rate_limits(&m_download_limit, &m_upload_limit);
 }
 
 torr::torrent_peer::~torrent_peer()
@@ -141,112 +338,354 @@ bool torr::torrent_peer::handshake(const peer& ourself)
     if (!m_tcp.receive((uint8_t*)receive_handshake.data(), max_handshake_length))
         return false;
 
-    for (const auto& e : receive_handshake)
-        std::print("{}",(char)e);
-    std::println();
+    return verify_handshake(ourself, receive_handshake);
+}
 
-    if (receive_handshake.size() < 68)
+bool torr::torrent_peer::verify_handshake(const peer& ourself,
+    std::span<const std::byte> received)
+{
+    if (received.size() < 68)
         return false;
-    if (strncmp((char*)(receive_handshake.data()), HANDSHAKE_PREFIX, 28) != 0)
+    /* only the protocol string, the reserved bytes are capabilities */
+    if (memcmp(received.data(), HANDSHAKE_PREFIX, 20) != 0)
         return false;
-    if (strncmp((char*)(receive_handshake.data() + 28),
+    if (strncmp((char*)(received.data() + 28),
         (char*)ourself.download_target().file_hash().value()->data(), 20) != 0)
         return false;
 
+    m_bitfield.resize_bits(ourself.download_target().piece_count().value_or(0));
+    m_supports_fast =
+        ((uint8_t)received[HANDSHAKE_RESERVED_FAST_BYTE] & HANDSHAKE_RESERVED_FAST) &&
+        ((uint8_t)ourself.handshake()[HANDSHAKE_RESERVED_FAST_BYTE] & HANDSHAKE_RESERVED_FAST);
+    m_supports_extended =
+        ((uint8_t)received[HANDSHAKE_RESERVED_EXTENDED_BYTE] & HANDSHAKE_RESERVED_EXTENDED) &&
+        ((uint8_t)ourself.handshake()[HANDSHAKE_RESERVED_EXTENDED_BYTE] & HANDSHAKE_RESERVED_EXTENDED);
     m_handshake_complete = true;
     m_socket_healthy = true;
+    m_state = connection_state::connected;
     std::println("handshake is complete!");
 
+    /* availability is the first message after the handshake */
+    send_message_availability(ourself);
+    if (m_supports_extended)
+        send_message_extended_handshake(ourself);
+    return true;
+}
+
+std::expected<int, const char*>
+    torr::torrent_peer::connect_non_blocking(const peer& ourself)
+{
+    if (ourself.handshake().empty())
+        return std::unexpected("torrent peer: handshake not constructed");
+
+    int fd = TRY(m_tcp.connect_non_blocking(m_ip_address, m_port));
+    m_writer.clear();
+    m_writer.queue(ourself.handshake());
+    m_socket_healthy = true;
+    m_state = connection_state::connecting;
+    return fd;
+}
+
+bool torr::torrent_peer::on_writable(peer& ourself)
+{
+    if (m_state == connection_state::connecting) {
+        if (!m_tcp.connect_result().has_value()) {
+            m_socket_healthy = false;
+            return false;
+        }
+        m_state = connection_state::handshaking;
+    }
+    return flush();
+}
+
+bool torr::torrent_peer::on_readable(peer& ourself)
+{
+    /* edge triggered, the socket is drained until it would block */
+    for (;;) {
+        auto received = m_reader.fill(m_tcp);
+        if (!received.has_value()) {
+            m_socket_healthy = false;
+            return false;
+        }
+
+        if (!process_received(ourself))
+            return false;
+
+        if (!received.value())
+            break;
+    }
+
+    if (cancel_finished_piece(ourself))
+        download_next_piece(ourself);
+    return true;
+}
+
+bool torr::torrent_peer::on_handshake_readable(const peer& ourself)
+{
+    if (m_state != connection_state::handshaking)
+        return true;
+
+    std::byte received_handshake[68];
+    for (;;) {
+        auto received = m_reader.fill(m_tcp);
+        if (!received.has_value()) {
+            m_socket_healthy = false;
+            return false;
+        }
+
+        if (m_reader.take(received_handshake)) {
+            if (verify_handshake(ourself, received_handshake))
+                return true;
+            m_socket_healthy = false;
+            return false;
+        }
+
+        if (!received.value())
+            return true;
+    }
+}
+
+bool torr::torrent_peer::on_received(peer& ourself, std::span<const std::byte> data)
+{
+    /* a completed receive of zero bytes means the remote closed */
+    if (data.empty() || m_reader.append(data) < data.size()) {
+        m_socket_healthy = false;
+        return false;
+    }
+
+    if (!process_received(ourself))
+        return false;
+
+    if (cancel_finished_piece(ourself))
+        download_next_piece(ourself);
     return true;
 }
 
-bool torr::torrent_peer::receive_message(const peer& ourself)
+bool torr::torrent_peer::process_received(peer& ourself)
+{
+    if (m_state == connection_state::handshaking) {
+        std::byte received_handshake[68];
+        if (m_reader.take(received_handshake) &&
+            !verify_handshake(ourself, received_handshake)) {
+            m_socket_healthy = false;
+            return false;
+        }
+    }
+
+    if (m_state == connection_state::connected)
+        return process_messages(ourself);
+    return true;
+}
+
+bool torr::torrent_peer::receive_message(peer& ourself)
 {
     if (!m_handshake_complete)
         return false;
 
-    peer::message message;
-    if (!m_tcp.receive((uint8_t*)&message, sizeof(peer::message)))
+    /* messages buffered along with the handshake go first, and
+     * the replies they queue are flushed before blocking to receive */
+    size_t buffered = m_reader.buffered();
+    if (buffered) {
+        if (!process_messages(ourself))
+            return false;
+        if (m_reader.buffered() < buffered)
+            return true;
+    }
+
+    auto received = m_reader.fill(m_tcp);
+    if (!received.has_value()) {
+        m_socket_healthy = false;
         return false;
+    }
+    /* the receive timed out, the owner checks for unanswered requests */
+    if (!received.value())
+        return true;
 
-    std::println("recv message {}", std::to_underlying(message.type));
+    if (!process_messages(ourself))
+        return false;
 
-    switch (message.type) {
+    if (cancel_finished_piece(ourself))
+        download_next_piece(ourself);
+    return true;
+}
+
+bool torr::torrent_peer::process_messages(peer& ourself)
+{
+    /* frame out every complete message buffered so far */
+    wire_message message;
+    for (;;) {
+        auto framed = m_reader.next(message);
+        if (!framed.has_value()) {
+            std::println("{}", framed.error());
+            m_socket_healthy = false;
+            return false;
+        }
+        if (!framed.value())
+            return true;
+
+        /* a protocol violation ends the connection */
+        if (!handle_message(ourself, message)) {
+            std::println("{}:{} protocol error in message {}", m_ip_address_string, m_port, message.id);
+            m_socket_healthy = false;
+            return false;
+        }
+    }
+}
+
+bool torr::torrent_peer::handle_message(peer& ourself, const wire_message& message)
+{
+    m_last_received = transfer_estimator::clock::now();
+    if (message.keep_alive) {
+        m_socket_healthy = receive_message_keep_alive();
+        return m_socket_healthy;
+    }
+
+    switch ((peer::message_type)message.id) {
     case peer::message_type::choke:
-        if (message.length.as_small_endian() == 1)
-            receive_message_choke();
-        else
-            m_socket_healthy = receive_message_keep_alive(message);
-        break;
+        return receive_message_choke();
 
     case peer::message_type::unchoke:
-        receive_message_unchoke(ourself);
-        break;
+        return receive_message_unchoke(ourself);
 
     case peer::message_type::interested:
-        m_peer_intersted = 1;
-        break;
+        m_peer_interested = 1;
+        return true;
 
     case peer::message_type::not_interested:
-        m_peer_intersted = 0;
-        break;
+        m_peer_interested = 0;
+        return true;
 
     case peer::message_type::have:
-        receive_message_have(message);
-        break;
+        return receive_message_have(ourself, message.payload);
 
     case peer::message_type::bitfield:
-        receive_message_bitfield(message);
-        break;
+        return receive_message_bitfield(ourself, message.payload);
 
     case peer::message_type::request:
-        receive_message_request(message);
-        break;
+        return receive_message_request(ourself, message.payload);
 
     case peer::message_type::block:
-        receive_message_block(ourself, message);
-        break;
+        return receive_message_block(ourself, message.payload);
 
     case peer::message_type::cancel:
-        receive_message_cancel(message);
-        break;
+        return receive_message_cancel(message.payload);
+
+    case peer::message_type::suggest_piece:
+        return m_supports_fast && receive_message_suggest(message.payload);
+
+    case peer::message_type::have_all:
+        return m_supports_fast && receive_message_have_all(ourself);
+
+    case peer::message_type::have_none:
+        return m_supports_fast && receive_message_have_none(ourself);
+
+    case peer::message_type::reject_request:
+        return m_supports_fast && receive_message_reject(message.payload);
+
+    case peer::message_type::allowed_fast:
+        return m_supports_fast && receive_message_allowed_fast(ourself, message.payload);
+
+    case peer::message_type::extended:
+        return m_supports_extended && receive_message_extended(ourself, message.payload);
 
     default:
-        std::println("unexpected message {}{}",
-            std::to_underlying(message.type),
-            message.length.as_small_endian());
-        break;
+        std::println("unexpected message {} length {}", message.id, message.length);
+        return false;
+    }
+}
+
+bool torr::torrent_peer::flush()
+{
+    /* the handshake waits in the queue until the connect completes */
+    if (m_state == connection_state::connecting)
+        return true;
+
+    /* waiting requests are served as the socket takes the queue */
+    for (;;) {
+        serve_upload_requests();
+        if (m_writer.empty())
+            return true;
+
+        auto sent = m_writer.flush(m_tcp);
+        if (!sent.has_value()) {
+            std::println("{}", sent.error());
+            m_socket_healthy = false;
+            return false;
+        }
+        if (!m_writer.empty() || m_upload_requests.empty())
+            return true;
     }
+}
+
+size_t torr::torrent_peer::take_outgoing(std::vector<std::byte>& out)
+{
+    if (m_state == connection_state::connecting)
+        return 0;
 
-    return 0;
+    serve_upload_requests();
+    return m_writer.drain(out);
+}
+
+bool torr::torrent_peer::has_outgoing() const
+{
+    return !m_writer.empty();
 }
 
 void torr::torrent_peer::determine_outstanding_requests(const peer& ourself)
 {
-    /* TODO: m_outstanding_requests = download_rate * queue_time */
-    m_outstanding_requests = 90;
+    m_request_queue_depth = m_snubbed ? 1 : m_estimator.queue_depth(MAX_BLOCK_SIZE);
 }
 
-bool torr::torrent_peer::determine_download_piece(const peer& ourself)
+bool torr::torrent_peer::determine_download_piece(peer& ourself)
 {
-    std::optional<size_t> found =
-        ourself.bitfield_pieces().find_positive_bit_compliment(m_bitfield, true);
+    /* while choked only allowed fast pieces can be requested, otherwise
+     * the remote's suggestions go before the picker's rarest piece */
+    std::optional<size_t> found;
+    const auto& hints = m_peer_choking ? m_allowed_fast : m_suggested;
+    for (uint32_t piece_index : hints) {
+        if (m_bitfield.boundary(piece_index) && m_bitfield.bit_get(piece_index) &&
+            ourself.claim_piece(piece_index)) {
+            found = piece_index;
+            break;
+        }
+    }
+
+    /* pieces another connection gave up are resumed first */
+    if (!found.has_value() && !m_peer_choking)
+        found = ourself.pick_partial_piece(m_bitfield);
+    if (!found.has_value() && !m_peer_choking)
+        found = ourself.pick_piece(m_bitfield);
     if (!found.has_value())
         return false;
 
     size_t index_to_download = found.value();
-    memset(&m_download_piece, 0, sizeof(m_download_piece));
+    size_t piece_size = ourself.download_target().piece_size(index_to_download).value();
+
+    /* blocks are received straight into a pooled, piece sized slab,
+     * or into the kept one of a piece that is resumed */
+    m_download_piece.buffer = ourself.take_partial_piece(index_to_download);
+    if (m_download_piece.buffer.empty())
+        m_download_piece.buffer = ourself.piece_buffers().acquire(piece_size);
+    if (m_download_piece.buffer.empty()) {
+        ourself.release_piece(index_to_download);
+        return false;
+    }
+
+    m_download_piece.returned.clear();
+    m_download_piece.downloaded = m_download_piece.buffer.received();
+    m_download_piece.requested = 0;
     m_download_piece.piece_index = index_to_download;
-    m_download_piece.piece_size = ourself.download_target().piece_length().value();
+    m_download_piece.piece_size = piece_size;
     m_download_piece.exists = true;
 
     std::println("decided on download piece at index {}", index_to_download);
     return true;
 }
 
-bool torr::torrent_peer::download_next_piece(const peer& ourself)
+bool torr::torrent_peer::download_next_piece(peer& ourself)
 {
-    if (m_am_choking)
+    cancel_finished_piece(ourself);
+    if (m_peer_choking && m_allowed_fast.empty())
         return false;
 
     if (!m_download_piece.exists) {
@@ -254,6 +693,9 @@ bool torr::torrent_peer::download_next_piece(const peer& ourself)
             return false;
     }
 
+    if (!can_request())
+        return false;
+
     if (m_download_piece.downloaded &&
         m_download_piece.downloaded >=
         m_download_piece.piece_size)
@@ -266,184 +708,455 @@ bool torr::torrent_peer::download_next_piece(const peer& ourself)
 
 bool torr::torrent_peer::receive_message_choke()
 {
-    m_am_choking = 1;
-    return m_am_choking;
+    m_peer_choking = 1;
+
+    /* with the fast extension every dropped request is rejected
+     * explicitly, requests for allowed fast pieces stay valid */
+    if (m_supports_fast)
+        return true;
+
+    /* a choking peer discards our queued requests */
+    m_download_piece.returned.insert(m_download_piece.returned.end(),
+        m_requests.begin(), m_requests.end());
+    m_requests.clear();
+    return true;
 }
 
-bool torr::torrent_peer::receive_message_unchoke(const peer& ourself)
+bool torr::torrent_peer::receive_message_unchoke(peer& ourself)
 {
     std::println("receive unchoke!");
-    m_am_choking = 0;
-    return download_next_piece(ourself);
+    m_peer_choking = 0;
+    download_next_piece(ourself);
+    return true;
 }
 
-bool torr::torrent_peer::receive_message_have(const peer::message& message)
+bool torr::torrent_peer::receive_message_have(peer& ourself, std::span<const std::byte> payload)
 {
-    std::println("receive message have type={} length={}", (int)message.type, message.length.as_small_endian());
-
-    if (message.length.as_small_endian() != sizeof(uint32_t) + 1)
+    big_endian_uint32_t has_piece_index;
+    if (payload.size() != sizeof(has_piece_index))
         return false;
 
-    uint32_t has_piece_index;
-    if (!m_tcp.receive((uint8_t*)&has_piece_index, sizeof(uint32_t)))
+    memcpy(&has_piece_index, payload.data(), sizeof(has_piece_index));
+    size_t piece_index = has_piece_index.as_small_endian();
+
+    /* without metadata the piece count is unknown, the bitfield grows
+     * to hold whatever the remote announces, doubling so a stream of
+     * increasing HAVEs costs only a few copies */
+    if (!ourself.has_metadata() && !m_bitfield.boundary(piece_index) &&
+        piece_index < WIRE_READER_MAX_MESSAGE * 8) {
+        std::vector<uint8_t> announced(m_bitfield.bytes_size());
+        m_bitfield.copy_msb_first(announced.data());
+        m_bitfield.resize_bits(std::min<size_t>(WIRE_READER_MAX_MESSAGE * 8,
+            std::max(piece_index + 1, m_bitfield.bits_size() * 2)));
+        m_bitfield.assign_msb_first(announced.data(), announced.size());
+    }
+
+    if (!m_bitfield.boundary(piece_index))
         return false;
+    if (m_bitfield.bit_get(piece_index))
+        return true;
 
-    m_bitfield.bit_set(has_piece_index);
-    return false;
+    m_bitfield.bit_set(piece_index);
+    ourself.picker().increment(piece_index);
+    return true;
 }
 
-bool torr::torrent_peer::receive_message_bitfield(const peer::message& message)
+bool torr::torrent_peer::receive_message_bitfield(peer& ourself, std::span<const std::byte> payload)
 {
-    std::println("receive message bitfield type={} length={}", (int)message.type, message.length.as_small_endian());
+    std::println("receive message bitfield length={}", payload.size());
 
-    size_t bitfield_size = message.length.as_small_endian() - 1;
-    m_bitfield.resize(bitfield_size);
-    if (!m_tcp.receive((uint8_t*)m_bitfield.data(), bitfield_size))
+    if (ourself.has_metadata() && payload.size() != m_bitfield.bytes_size())
         return false;
 
+    /* a bitfield replaces whatever availability this peer announced */
+    ourself.picker().remove_bitfield(m_bitfield);
+    if (!ourself.has_metadata())
+        m_bitfield.resize(payload.size());
+    m_bitfield.assign_msb_first((const uint8_t*)payload.data(), payload.size());
+    ourself.picker().add_bitfield(m_bitfield);
+
     std::println("sending message interested");
     return send_message_interested();
 }
 
-bool torr::torrent_peer::receive_message_request(const peer::message& message)
+bool torr::torrent_peer::receive_message_request(const peer& ourself,
+    std::span<const std::byte> payload)
 {
-    std::println("receive message request type={} length={}", (int)message.type, message.length.as_small_endian());
-
-    struct block_payload {
-        big_endian_uint32_t block_index;
-        big_endian_uint32_t block_offset;
-        big_endian_uint32_t block_length;
-    } __attribute__((packed));
-
-    block_payload payload;
-
-    if (message.length.as_small_endian() - 1 != sizeof(payload))
+    peer::block_request_payload request;
+    if (payload.size() != sizeof(request))
         return false;
+    memcpy(&request, payload.data(), sizeof(request));
+
+    uint32_t piece_index = request.piece_index.as_small_endian();
+    uint32_t begin = request.begin.as_small_endian();
+    uint32_t length = request.length.as_small_endian();
+
+    /* requests while choked are dropped, as the remote was told,
+     * a remote with the fast extension is told about each one */
+    block_request dropped { piece_index, begin, length };
+    if (m_am_choking || m_upload_requests.size() >= MAX_UPLOAD_REQUESTS) {
+        if (m_supports_fast)
+            send_message_reject(dropped);
+        return true;
+    }
 
-    std::println("a peer wants block=%d, off=%d, length=%d",
-        payload.block_index.as_small_endian(), payload.block_offset.as_small_endian(), payload.block_length.as_small_endian());
-
-    /* TODO */
-    std::println("TODO request not impl");
+    auto piece_size = ourself.download_target().piece_size(piece_index);
+    if (!piece_size || !ourself.has_piece(piece_index) ||
+        !length || length > MAX_REQUEST_SIZE ||
+        (size_t)begin + length > *piece_size) {
+        if (m_supports_fast)
+            send_message_reject(dropped);
+        return false;
+    }
 
-    return false;
+    m_upload_requests.push_back({ piece_index, begin, length });
+    return true;
 }
 
-bool torr::torrent_peer::receive_message_block(const peer& ourself,
-    const peer::message& message)
+bool torr::torrent_peer::receive_message_block(peer& ourself,
+    std::span<const std::byte> payload)
 {
-    std::println("receive message block type={} length={}", (int)message.type, message.length.as_small_endian());
-
     struct block_payload {
         big_endian_uint32_t block_index;
         big_endian_uint32_t block_offset;
     } __attribute__((packed));
 
-    block_payload payload;
-    size_t packet_size = message.length.as_small_endian() - 1;
-    size_t block_length = packet_size - sizeof(block_payload);
-
-    if (!m_tcp.receive((uint8_t*)&payload, sizeof(block_payload)))
+    block_payload block;
+    if (payload.size() < sizeof(block))
         return false;
+    memcpy(&block, payload.data(), sizeof(block));
 
-    std::println("piece={} block index={} offset={} length={}",
-        m_download_piece.piece_index,
-        payload.block_index.as_small_endian(),
-        payload.block_offset.as_small_endian(),
-        block_length
-    );
+    auto block_data = payload.subspan(sizeof(block));
+    size_t block_offset = block.block_offset.as_small_endian();
 
-    if (payload.block_index.as_small_endian() != m_download_piece.piece_index)
-        return false;
+    auto request = std::find_if(m_requests.begin(), m_requests.end(),
+        [&](const block_request& r) {
+            return r.piece_index == block.block_index.as_small_endian()
+                && r.offset == block_offset && r.length == block_data.size();
+        });
 
-    m_download_piece.data.resize(m_download_piece.downloaded + block_length);
+    /* unrequested, cancelled or already received blocks are dropped */
+    if (request == m_requests.end() || !m_download_piece.exists ||
+        request->piece_index != m_download_piece.piece_index) {
+        ourself.add_wasted_bytes(block_data.size());
+        return true;
+    }
 
-    size_t packet_offset = 0;
-    while (packet_offset < block_length) {
-        uint8_t* download_buffer = (uint8_t*)m_download_piece.data.data() + m_download_piece.downloaded + packet_offset;
-        auto receive_or_error = m_tcp.receive(download_buffer, block_length - packet_offset);
-        if (!receive_or_error.has_value())
-            return false;
-        packet_offset += receive_or_error.value();
+    auto now = transfer_estimator::clock::now();
+    m_estimator.add_rtt_sample(now - request->sent, now);
+    m_estimator.add_bytes(block_data.size(), now);
+    m_requests.erase(request);
+    m_last_block = now;
+    m_requests_timed_out = false;
+    m_request_timeouts = 0;
+    if (m_snubbed) {
+        std::println("{}:{} no longer snubbed", m_ip_address_string, m_port);
+        m_snubbed = false;
     }
 
-    m_download_piece.downloaded += block_length;
+    /* blocks land at their offset, the bitmap rejects duplicates */
+    if (!m_download_piece.buffer.write_block(block_offset, block_data)) {
+        ourself.add_wasted_bytes(block_data.size());
+        return true;
+    }
+    m_download_piece.downloaded = m_download_piece.buffer.received();
 
-    if (m_download_piece.downloaded >= m_download_piece.piece_size) {
-        /* ourself.piece_download_complete(
-            m_download_piece.piece_index,
-            m_download_piece.data
-        ); */
+    /* the owner verifies the piece and announces it with HAVE */
+    if (m_download_piece.downloaded >= m_download_piece.piece_size)
+        return true;
 
-        /* FIXME: let multiproc send */
-        send_message_have(m_download_piece);
-        send_message_interested();
+    /* keep the pipeline full as blocks arrive */
+    if (can_request()) {
+        determine_outstanding_requests(ourself);
+        fill_outstanding_requests(ourself);
     }
+    return true;
+}
 
+bool torr::torrent_peer::receive_message_cancel(std::span<const std::byte> payload)
+{
+    peer::block_request_payload cancel;
+    if (payload.size() != sizeof(cancel))
+        return false;
+    memcpy(&cancel, payload.data(), sizeof(cancel));
+
+    /* requests are only turned into data when the queue is flushed */
+    std::erase_if(m_upload_requests, [&](const block_request& r) {
+        return r.piece_index == cancel.piece_index.as_small_endian()
+            && r.offset == cancel.begin.as_small_endian()
+            && r.length == cancel.length.as_small_endian();
+    });
     return true;
 }
 
-bool torr::torrent_peer::receive_message_cancel(const peer::message& message)
+bool torr::torrent_peer::cancel_finished_piece(peer& ourself)
 {
-    /* TODO */
-    std::println("TODO cancel not impl");
+    auto& piece = m_download_piece;
+    if (!piece.exists || piece.downloaded >= piece.piece_size ||
+        !ourself.has_piece(piece.piece_index))
+        return false;
 
-    return false;
+    /* another connection completed the piece first, whatever this
+     * connection received of it and still receives is wasted */
+    std::println("cancel {} requests of finished piece {}", m_requests.size(), piece.piece_index);
+    for (const auto& request : m_requests)
+        send_message_cancel(request);
+    ourself.add_wasted_bytes(piece.downloaded);
+    ourself.release_piece(piece.piece_index);
+
+    m_requests.clear();
+    piece.returned.clear();
+    empty_download_piece();
+    return true;
 }
 
-bool torr::torrent_peer::receive_message_keep_alive(const peer::message& message)
+bool torr::torrent_peer::receive_message_keep_alive()
 {
-    if (message.length.as_small_endian() != 0)
+    /* send keep-alive back, at most once a second */
+    auto now = transfer_estimator::clock::now();
+    if (now - m_last_keep_alive < std::chrono::seconds(1))
         return true;
+    m_last_keep_alive = now;
+    return send_message_keep_alive();
+}
+
+bool torr::torrent_peer::send_message_keep_alive()
+{
+    /* a keep-alive is only the zero length prefix */
+    big_endian_uint32_t keep_alive = 0;
+    m_writer.queue_value(keep_alive);
+    return true;
+}
 
-    time_t now = time(NULL);
-    if ((now - m_time_of_last_keep_alive_message) == 0)
+bool torr::torrent_peer::check_request_timeouts(peer& ourself,
+    transfer_estimator::clock::time_point now)
+{
+    if (m_requests.empty())
         return false;
-    m_time_of_last_keep_alive_message = now;
 
-    /* send keep-alive back */
-    if (!m_tcp.send((uint8_t*)&message, sizeof(peer::message)))
+    if (!m_snubbed && now - blocks_waiting_since() >= snub_timeout) {
+        std::println("{}:{} snubbed", m_ip_address_string, m_port);
+        m_snubbed = true;
+        m_request_queue_depth = 1;
+    }
+
+    /* requests are answered in order, only the oldest is checked and
+     * queued blocks get the full timeout once the one before arrived */
+    auto waiting_since = std::max(m_requests.front().sent, blocks_waiting_since());
+    if (now - waiting_since < m_estimator.request_timeout())
         return false;
+
+    auto& piece = m_download_piece;
+    std::println("{} requests of piece {} timed out", m_requests.size(), piece.piece_index);
+    for (const auto& request : m_requests)
+        send_message_cancel(request);
+    m_requests.clear();
+    m_requests_timed_out = true;
+    m_request_timeouts++;
+
+    /* the piece goes back to the picker, another connection
+     * resumes it from the blocks received so far */
+    if (piece.exists && piece.downloaded < piece.piece_size) {
+        ourself.release_piece(piece.piece_index);
+        ourself.keep_partial_piece(piece.piece_index, std::move(piece.buffer));
+    }
+    piece.returned.clear();
+    empty_download_piece();
     return true;
 }
 
+std::optional<torr::transfer_estimator::clock::time_point>
+    torr::torrent_peer::request_deadline() const
+{
+    if (m_requests.empty())
+        return {};
+
+    auto waiting_since = blocks_waiting_since();
+    auto deadline = std::max(m_requests.front().sent, waiting_since) + m_estimator.request_timeout();
+    if (!m_snubbed)
+        deadline = std::min(deadline, waiting_since + snub_timeout);
+    return deadline;
+}
+
+torr::transfer_estimator::clock::time_point torr::torrent_peer::blocks_waiting_since() const
+{
+    return std::max(m_last_block, m_download_limit.limited_at());
+}
+
+bool torr::torrent_peer::snubbed() const
+{
+    return m_snubbed;
+}
+
+size_t torr::torrent_peer::request_timeouts() const
+{
+    return m_request_timeouts;
+}
+
 bool torr::torrent_peer::fill_outstanding_requests(const peer& ourself)
 {
-    std::println("filling outstanding requests!");
-    uint32_t outstanding_requests =
-        ourself.download_target().piece_length().value() /
-        MAX_BLOCK_SIZE;
+    auto& piece = m_download_piece;
+    while (m_requests.size() < m_request_queue_depth && !piece.returned.empty()) {
+        block_request request = piece.returned.back();
+        piece.returned.pop_back();
+        send_message_request(request.offset, request.length);
+    }
 
-    for (uint32_t i = 0; i < outstanding_requests; ++i)
-        send_message_request(MAX_BLOCK_SIZE * i);
+    /* the last block of the last piece is shorter, blocks of a
+     * resumed piece received by another connection are skipped */
+    while (m_requests.size() < m_request_queue_depth && piece.requested < piece.piece_size) {
+        uint32_t length = std::min<size_t>(MAX_BLOCK_SIZE, piece.piece_size - piece.requested);
+        if (!piece.buffer.has_block(piece.requested))
+            send_message_request(piece.requested, length);
+        piece.requested += length;
+    }
     return true;
 }
 
-bool torr::torrent_peer::send_message_request(uint32_t offset)
+bool torr::torrent_peer::send_message_request(uint32_t offset, uint32_t length)
 {
     struct request_payload {
         peer::message message;
-        big_endian_uint32_t piece_index;
-        big_endian_uint32_t begin;
-        big_endian_uint32_t length;
+        peer::block_request_payload block;
     } __attribute__((packed));
 
     request_payload payload;
-    payload.piece_index = m_download_piece.piece_index;
-    payload.begin = m_download_piece.downloaded + offset;
-    payload.length = MAX_BLOCK_SIZE;
+    payload.block.piece_index = m_download_piece.piece_index;
+    payload.block.begin = offset;
+    payload.block.length = length;
     payload.message.length = sizeof(payload) - sizeof(uint32_t);
     payload.message.type = peer::message_type::request;
 
-    std::println("request length={} offset={} piece_index={}",
-        payload.message.length.as_small_endian(),
-        payload.begin.as_small_endian(),
-        m_download_piece.piece_index);
+    auto now = transfer_estimator::clock::now();
+    if (m_requests.empty() && !m_requests_timed_out)
+        m_last_block = now;
 
-    if (!m_tcp.send((uint8_t*)&payload, sizeof(payload)))
-        return false;
+    m_writer.queue_value(payload);
+    m_requests.push_back({
+        (uint32_t)m_download_piece.piece_index, offset, length, now
+    });
+    return true;
+}
+
+bool torr::torrent_peer::send_message_cancel(const block_request& request)
+{
+    struct cancel_payload {
+        peer::message message;
+        peer::block_request_payload block;
+    } __attribute__((packed));
+
+    cancel_payload payload;
+    payload.message.length = sizeof(payload) - sizeof(uint32_t);
+    payload.message.type = peer::message_type::cancel;
+    payload.block.piece_index = request.piece_index;
+    payload.block.begin = request.offset;
+    payload.block.length = request.length;
+
+    m_writer.queue_value(payload);
+    return true;
+}
+
+bool torr::torrent_peer::serve_upload_requests()
+{
+    struct block_header {
+        peer::message message;
+        big_endian_uint32_t piece_index;
+        big_endian_uint32_t begin;
+    } __attribute__((packed));
+
+    /* requests past the high-water mark wait, still counted against
+     * MAX_UPLOAD_REQUESTS and still cancelled or rejected by a choke */
+    size_t served = 0;
+    for (; served < m_upload_requests.size() && m_writer.queued() < UPLOAD_QUEUE_HIGH_WATER; ++served) {
+        const auto& request = m_upload_requests[served];
+        auto slices = m_storage ? m_storage->map_block(request.piece_index,
+            request.offset, request.length) : std::span<const file_slice> {};
+
+        /* every file is opened before the header is queued */
+        bool opened = !slices.empty();
+        for (const auto& slice : slices)
+            opened = opened && m_storage->file(slice.file_index, false);
+        if (!opened) {
+            std::println("could not open piece {} to serve", request.piece_index);
+            if (m_supports_fast)
+                send_message_reject(request);
+            continue;
+        }
+
+        /* the header is queued in memory, the data follows from the file */
+        block_header header;
+        header.message.length = sizeof(header) - sizeof(uint32_t) + request.length;
+        header.message.type = peer::message_type::block;
+        header.piece_index = request.piece_index;
+        header.begin = request.offset;
+        m_writer.queue_value(header);
+        for (const auto& slice : slices)
+            m_writer.queue_file(m_storage->file(slice.file_index, false),
+                slice.file_offset, slice.length);
+        m_upload_estimator.add_bytes(request.length);
+    }
+
+    m_upload_requests.erase(m_upload_requests.begin(), m_upload_requests.begin() + served);
+    return true;
+}
+
+bool torr::torrent_peer::set_choking(bool choke)
+{
+    if (choke == m_am_choking)
+        return true;
+    return choke ? send_message_choke() : send_message_unchoke();
+}
 
-    std::println("sent message request succesfully");
+void torr::torrent_peer::attach_rate_limits(peer& ourself)
+{
+    m_download_limit.set_parent(&ourself.download_limit());
+    m_upload_limit.set_parent(&ourself.upload_limit());
+}
+
+void torr::torrent_peer::attach_storage(peer& ourself)
+{
+    m_storage = &ourself.storage();
+}
+
+torr::token_bucket& torr::torrent_peer::download_limit()
+{
+    return m_download_limit;
+}
+
+torr::token_bucket& torr::torrent_peer::upload_limit()
+{
+    return m_upload_limit;
+}
+
+bool torr::torrent_peer::throttled() const
+{
+    return m_tcp.receive_throttled() || m_tcp.send_throttled();
+}
+
+bool torr::torrent_peer::send_message_choke()
+{
+    peer::message message;
+    message.length = 1;
+    message.type = peer::message_type::choke;
+    m_writer.queue_value(message);
+    m_am_choking = 1;
+
+    /* a choked remote knows its pending requests are dropped,
+     * with the fast extension each one is rejected */
+    if (m_supports_fast)
+        for (const auto& request : m_upload_requests)
+            send_message_reject(request);
+    m_upload_requests.clear();
+    return true;
+}
+
+bool torr::torrent_peer::send_message_unchoke()
+{
+    peer::message message;
+    message.length = 1;
+    message.type = peer::message_type::unchoke;
+    m_writer.queue_value(message);
+    m_am_choking = 0;
     return true;
 }
 
@@ -452,11 +1165,7 @@ bool torr::torrent_peer::send_message_interested()
     peer::message message;
     message.length = 1;
     message.type = peer::message_type::interested;
-    size_t total_size = sizeof(message);
-    if (!m_tcp.send((uint8_t*)&message, sizeof(message)))
-        return false;
-
-    std::println("sent message is_interested succesfully");
+    m_writer.queue_value(message);
     return true;
 }
 
@@ -465,16 +1174,423 @@ bool torr::torrent_peer::send_message_bitfield(const peer& ourself)
     peer::message message;
     message.length = 1 + ourself.bitfield_pieces().bytes_size();
     message.type = peer::message_type::bitfield;
-    const uint8_t* data = ourself.bitfield_pieces().const_data();
 
-    if (!m_tcp.send((uint8_t*)&message, sizeof(message)) ||
-        !m_tcp.send(data, ourself.bitfield_pieces().bytes_size()))
+    std::vector<std::byte> bitfield(ourself.bitfield_pieces().bytes_size());
+    ourself.bitfield_pieces().copy_msb_first((uint8_t*)bitfield.data());
+
+    m_writer.queue_value(message);
+    m_writer.queue(bitfield);
+    return true;
+}
+
+
+bool torr::torrent_peer::send_message_availability(const peer& ourself)
+{
+    const auto& pieces = ourself.bitfield_pieces();
+    bool have_none = true;
+    for (size_t i = 0; i < pieces.bits_size() && have_none; ++i)
+        have_none = !pieces.bit_get(i);
+
+    if (m_supports_fast && (have_none || ourself.seeding())) {
+        /* a seed or a new download is one byte instead of a bitfield */
+        peer::message message;
+        message.length = 1;
+        message.type = have_none ? peer::message_type::have_none : peer::message_type::have_all;
+        m_writer.queue_value(message);
+        return true;
+    }
+
+    /* without the extension the bitfield is optional when empty */
+    if (have_none)
+        return true;
+    return send_message_bitfield(ourself);
+}
+
+bool torr::torrent_peer::send_message_reject(const block_request& request)
+{
+    struct reject_payload {
+        peer::message message;
+        peer::block_request_payload block;
+    } __attribute__((packed));
+
+    reject_payload payload;
+    payload.message.length = sizeof(payload) - sizeof(uint32_t);
+    payload.message.type = peer::message_type::reject_request;
+    payload.block.piece_index = request.piece_index;
+    payload.block.begin = request.offset;
+    payload.block.length = request.length;
+    m_writer.queue_value(payload);
+    return true;
+}
+
+bool torr::torrent_peer::receive_message_have_all(peer& ourself)
+{
+    m_have_all = true;
+    ourself.picker().remove_bitfield(m_bitfield);
+    for (size_t i = 0; i < m_bitfield.bits_size(); ++i)
+        m_bitfield.bit_set(i);
+    ourself.picker().add_bitfield(m_bitfield);
+    return send_message_interested();
+}
+
+bool torr::torrent_peer::receive_message_have_none(peer& ourself)
+{
+    m_have_all = false;
+    ourself.picker().remove_bitfield(m_bitfield);
+    for (size_t i = 0; i < m_bitfield.bits_size(); ++i)
+        m_bitfield.bit_clear(i);
+    return true;
+}
+
+bool torr::torrent_peer::receive_message_reject(std::span<const std::byte> payload)
+{
+    peer::block_request_payload reject;
+    if (payload.size() != sizeof(reject))
+        return false;
+    memcpy(&reject, payload.data(), sizeof(reject));
+
+    auto request = std::find_if(m_requests.begin(), m_requests.end(),
+        [&](const block_request& r) {
+            return r.piece_index == reject.piece_index.as_small_endian()
+                && r.offset == reject.begin.as_small_endian()
+                && r.length == reject.length.as_small_endian();
+        });
+    /* the request may have been cancelled meanwhile */
+    if (request == m_requests.end())
+        return true;
+
+    /* the block goes out again with the next refill or unchoke,
+     * instead of waiting for the request to time out */
+    if (m_download_piece.exists && request->piece_index == m_download_piece.piece_index)
+        m_download_piece.returned.push_back(*request);
+    m_requests.erase(request);
+    return true;
+}
+
+bool torr::torrent_peer::receive_message_allowed_fast(peer& ourself,
+    std::span<const std::byte> payload)
+{
+    big_endian_uint32_t piece_index;
+    if (payload.size() != sizeof(piece_index))
+        return false;
+    memcpy(&piece_index, payload.data(), sizeof(piece_index));
+
+    uint32_t index = piece_index.as_small_endian();
+    if (!m_bitfield.boundary(index) || m_allowed_fast.size() >= MAX_ALLOWED_FAST ||
+        std::find(m_allowed_fast.begin(), m_allowed_fast.end(), index) != m_allowed_fast.end())
+        return true;
+    m_allowed_fast.push_back(index);
+
+    /* a choked connection can start downloading right away */
+    if (m_peer_choking && !m_download_piece.exists)
+        download_next_piece(ourself);
+    return true;
+}
+
+bool torr::torrent_peer::receive_message_suggest(std::span<const std::byte> payload)
+{
+    big_endian_uint32_t piece_index;
+    if (payload.size() != sizeof(piece_index))
+        return false;
+    memcpy(&piece_index, payload.data(), sizeof(piece_index));
+
+    uint32_t index = piece_index.as_small_endian();
+    if (!m_bitfield.boundary(index))
+        return true;
+    std::erase(m_suggested, index);
+    if (m_suggested.size() >= MAX_SUGGESTED_PIECES)
+        m_suggested.erase(m_suggested.begin());
+    m_suggested.push_back(index);
+    return true;
+}
+
+bool torr::torrent_peer::send_message_extended(uint8_t id, std::span<const std::byte> payload)
+{
+    struct extended_header {
+        peer::message message;
+        uint8_t id;
+    } __attribute__((packed));
+
+    extended_header header;
+    header.message.length = sizeof(header) - sizeof(uint32_t) + payload.size();
+    header.message.type = peer::message_type::extended;
+    header.id = id;
+    m_writer.queue_value(header);
+    m_writer.queue(payload);
+    return true;
+}
+
+bool torr::torrent_peer::send_message_extended_handshake(const peer& ourself)
+{
+    std::vector<std::byte> payload;
+    bencode_writer writer(payload);
+    writer.begin_dictionary()
+        .key("m").begin_dictionary()
+            .key("ut_metadata").integer(EXTENDED_UT_METADATA_ID)
+            .key("ut_pex").integer(EXTENDED_UT_PEX_ID)
+        .end();
+
+    /* only a peer that knows the info dictionary can serve it */
+    auto info = ourself.download_target().info_dictionary();
+    if (info.has_value())
+        writer.key("metadata_size").integer(info->size());
+    writer.end();
+
+    if (!writer.finish().has_value())
+        return false;
+    return send_message_extended(EXTENDED_HANDSHAKE_ID, payload);
+}
+
+bool torr::torrent_peer::send_message_metadata_request(size_t piece)
+{
+    std::vector<std::byte> payload;
+    bencode_writer writer(payload);
+    writer.begin_dictionary()
+        .key("msg_type").integer(0)
+        .key("piece").integer(piece)
+    .end();
+
+    if (!writer.finish().has_value())
+        return false;
+    return send_message_extended(m_remote_ut_metadata, payload);
+}
+
+bool torr::torrent_peer::send_message_metadata(const peer& ourself, size_t piece)
+{
+    if (!m_remote_ut_metadata)
+        return false;
+
+    std::vector<std::byte> payload;
+    bencode_writer writer(payload);
+    auto info = ourself.download_target().info_dictionary();
+    size_t offset = piece * METADATA_PIECE_SIZE;
+
+    if (!info.has_value() || offset >= info->size()) {
+        writer.begin_dictionary()
+            .key("msg_type").integer(2)
+            .key("piece").integer(piece)
+        .end();
+        if (!writer.finish().has_value())
+            return false;
+        return send_message_extended(m_remote_ut_metadata, payload);
+    }
+
+    /* the piece follows the dictionary, outside of the bencoding */
+    writer.begin_dictionary()
+        .key("msg_type").integer(1)
+        .key("piece").integer(piece)
+        .key("total_size").integer(info->size())
+    .end();
+    if (!writer.finish().has_value())
+        return false;
+
+    auto data = info->subspan(offset, std::min<size_t>(METADATA_PIECE_SIZE, info->size() - offset));
+    payload.insert(payload.end(), data.begin(), data.end());
+    return send_message_extended(m_remote_ut_metadata, payload);
+}
+
+bool torr::torrent_peer::receive_message_extended(peer& ourself,
+    std::span<const std::byte> payload)
+{
+    if (payload.empty())
+        return false;
+
+    /* ids of our extensions, as we assigned them in our handshake */
+    switch ((uint8_t)payload[0]) {
+    case EXTENDED_HANDSHAKE_ID:
+        return receive_extended_handshake(ourself, payload.subspan(1));
+    case EXTENDED_UT_METADATA_ID:
+        return receive_message_metadata(ourself, payload.subspan(1));
+    case EXTENDED_UT_PEX_ID:
+        return receive_message_pex(ourself, payload.subspan(1));
+    default:
+        return true;
+    }
+}
+
+bool torr::torrent_peer::receive_extended_handshake(peer& ourself,
+    std::span<const std::byte> payload)
+{
+    using target_type = bencode_view::target_type;
+
+    if (payload.size() > MAX_EXTENDED_HANDSHAKE_SIZE)
+        return false;
+
+    bencode_view handshake;
+    if (!handshake.from_buffer(payload).has_value() ||
+        handshake.root().type() != target_type::dictionaries)
+        return false;
+
+    /* a later handshake may change ids, zero disables an extension */
+    auto extension_id = [&](std::string_view name, uint8_t& id) {
+        auto assigned = handshake["m"][name];
+        if (assigned.type() == target_type::integers)
+            id = (assigned.as_int() > 0 && assigned.as_int() <= UINT8_MAX) ? assigned.as_int() : 0;
+    };
+    extension_id("ut_metadata", m_remote_ut_metadata);
+    extension_id("ut_pex", m_remote_ut_pex);
+
+    auto metadata_size = handshake["metadata_size"];
+    if (metadata_size.type() == target_type::integers && metadata_size.as_int() > 0 &&
+        !ourself.has_metadata())
+        ourself.metadata().set_size(metadata_size.as_int());
+
+    return request_metadata(ourself);
+}
+
+bool torr::torrent_peer::receive_message_metadata(peer& ourself,
+    std::span<const std::byte> payload)
+{
+    using target_type = bencode_view::target_type;
+
+    bencode_view message;
+    if (!message.from_buffer(payload).has_value())
         return false;
+
+    auto type = message["msg_type"];
+    auto piece = message["piece"];
+    if (type.type() != target_type::integers || piece.type() != target_type::integers ||
+        piece.as_int() < 0)
+        return false;
+
+    size_t index = piece.as_int();
+    auto request = std::find_if(m_metadata_requests.begin(), m_metadata_requests.end(),
+        [&](const block_request& r) { return r.piece_index == index; });
+
+    switch (type.as_int()) {
+    case 0:
+        return send_message_metadata(ourself, index);
+
+    case 1: {
+        /* only requested pieces are taken, data for a timed out request
+         * or one made for another size is dropped */
+        if (request == m_metadata_requests.end())
+            return true;
+        bool stale = request->length != ourself.metadata().piece_size(index);
+        m_metadata_requests.erase(request);
+        if (stale)
+            return request_metadata(ourself);
+
+        auto data = payload.subspan(message.root().as_raw().size());
+        auto complete = ourself.metadata().receive(index, data);
+        if (!complete.has_value()) {
+            std::println("{}", complete.error());
+            return false;
+        }
+        if (!complete.value())
+            return request_metadata(ourself);
+
+        auto applied = ourself.set_metadata(ourself.metadata().data());
+        if (!applied.has_value()) {
+            std::println("{}", applied.error());
+            return false;
+        }
+        std::println("received metadata of {} bytes", ourself.metadata().size());
+        return true;
+    }
+
+    case 2:
+        /* the remote does not serve metadata, others are asked instead */
+        if (request != m_metadata_requests.end()) {
+            ourself.metadata().release(index);
+            m_metadata_requests.erase(request);
+        }
+        m_metadata_rejected = true;
+        return true;
+
+    default:
+        return true;
+    }
+}
+
+bool torr::torrent_peer::receive_message_pex(peer& ourself,
+    std::span<const std::byte> payload)
+{
+    auto discovered = ourself.peer_exchange().receive(m_advertised_peers, payload);
+    if (!discovered.has_value()) {
+        std::println("{}", discovered.error());
+        return false;
+    }
+    if (discovered.value())
+        std::println("discovered {} peers from {}", discovered.value(), m_ip_address_string);
+    return true;
+}
+
+bool torr::torrent_peer::exchange_peers(peer& ourself)
+{
+    if (m_state != connection_state::connected || !m_remote_ut_pex)
+        return true;
+
+    auto payload = ourself.peer_exchange().build(m_advertised_peers, address());
+    if (!payload.has_value())
+        return true;
+    return send_message_extended(m_remote_ut_pex, *payload);
+}
+
+bool torr::torrent_peer::request_metadata(peer& ourself)
+{
+    if (m_state != connection_state::connected || !m_remote_ut_metadata ||
+        m_metadata_rejected || ourself.has_metadata() || !ourself.metadata().has_size())
+        return true;
+
+    /* unanswered requests are handed to other peers by the exchange */
+    auto now = transfer_estimator::clock::now();
+    std::erase_if(m_metadata_requests, [&](const block_request& r) {
+        return now - r.sent >= metadata_exchange::request_timeout;
+    });
+
+    while (m_metadata_requests.size() < METADATA_REQUESTS_PER_PEER) {
+        auto piece = ourself.metadata().pick(now);
+        if (!piece.has_value())
+            break;
+        send_message_metadata_request(*piece);
+        m_metadata_requests.push_back(
+            { (uint32_t)*piece, 0, (uint32_t)ourself.metadata().piece_size(*piece), now });
+    }
     return true;
 }
 
+bool torr::torrent_peer::on_metadata(peer& ourself)
+{
+    if (m_state != connection_state::connected)
+        return true;
+    m_metadata_requests.clear();
+
+    /* bits past the piece count are dropped, a peer announcing
+     * them is only trimmed to the now known size */
+    size_t piece_count = ourself.download_target().piece_count().value_or(0);
+    std::vector<uint8_t> announced(m_bitfield.bytes_size());
+    m_bitfield.copy_msb_first(announced.data());
+    m_bitfield.resize_bits(piece_count);
+    m_bitfield.assign_msb_first(announced.data(), announced.size());
+
+    bool any = m_have_all;
+    for (size_t i = 0; i < m_bitfield.bits_size(); ++i) {
+        if (m_have_all)
+            m_bitfield.bit_set(i);
+        any = any || m_bitfield.bit_get(i);
+    }
+    ourself.picker().add_bitfield(m_bitfield);
+
+    if (any)
+        send_message_interested();
+    return download_next_piece(ourself);
+}
+
+bool torr::torrent_peer::allowed_fast(size_t piece_index) const
+{
+    return std::find(m_allowed_fast.begin(), m_allowed_fast.end(), piece_index)
+        != m_allowed_fast.end();
+}
+
+bool torr::torrent_peer::can_request() const
+{
+    if (!m_peer_choking)
+        return true;
+    return m_download_piece.exists && allowed_fast(m_download_piece.piece_index);
+}
 
-bool torr::torrent_peer::send_message_have(const download_torrent_piece& piece)
+bool torr::torrent_peer::announce_piece(size_t piece_index)
 {
     struct have_payload {
         peer::message message;
@@ -484,19 +1600,36 @@ bool torr::torrent_peer::send_message_have(const download_torrent_piece& piece)
     have_payload payload;
     payload.message.type = peer::message_type::have;
     payload.message.length = sizeof(payload) - sizeof(uint32_t);
-    payload.piece_index = piece.piece_index;
+    payload.piece_index = piece_index;
 
-    if (!m_tcp.send((uint8_t*)&payload, sizeof(payload)))
-        return false;
-
-    std::println("sent message have {} succesfully", piece.piece_index);
+    m_writer.queue_value(payload);
     return true;
 }
 
 void torr::torrent_peer::empty_download_piece()
 {
-    m_download_piece.data.clear();
+    m_download_piece.buffer = {};
+    m_download_piece.exists = false;
+}
+
+torr::piece_buffer torr::torrent_peer::take_piece_buffer()
+{
     m_download_piece.exists = false;
+    return std::move(m_download_piece.buffer);
+}
+
+void torr::torrent_peer::detach(peer& ourself)
+{
+    ourself.picker().remove_bitfield(m_bitfield);
+    for (const auto& request : m_metadata_requests)
+        ourself.metadata().release(request.piece_index);
+    m_metadata_requests.clear();
+    if (m_download_piece.exists && m_download_piece.downloaded < m_download_piece.piece_size) {
+        ourself.release_piece(m_download_piece.piece_index);
+        ourself.keep_partial_piece(m_download_piece.piece_index, std::move(m_download_piece.buffer));
+    }
+    m_requests.clear();
+    empty_download_piece();
 }
 
 const torr::torrent_peer::download_torrent_piece&
@@ -505,6 +1638,41 @@ const torr::torrent_peer::download_torrent_piece&
     return m_download_piece;
 }
 
+const torr::transfer_estimator& torr::torrent_peer::estimator() const
+{
+    return m_estimator;
+}
+
+const torr::transfer_estimator& torr::torrent_peer::upload_estimator() const
+{
+    return m_upload_estimator;
+}
+
+torr::transfer_estimator::clock::time_point torr::torrent_peer::last_received() const
+{
+    return m_last_received;
+}
+
+bool torr::torrent_peer::am_choking() const
+{
+    return m_am_choking;
+}
+
+bool torr::torrent_peer::supports_fast() const
+{
+    return m_supports_fast;
+}
+
+bool torr::torrent_peer::supports_extended() const
+{
+    return m_supports_extended;
+}
+
+bool torr::torrent_peer::peer_interested() const
+{
+    return m_peer_interested;
+}
+
 const std::string& torr::torrent_peer::ip_address_as_string() const
 {
     return m_ip_address_string;
@@ -520,6 +1688,31 @@ const size_t torr::torrent_peer::port() const
     return m_port;
 }
 
+torr::peer_ip_touple torr::torrent_peer::address() const
+{
+    return { m_ip_address, m_port };
+}
+
+torr::torrent_peer::connection_state torr::torrent_peer::state() const
+{
+    return m_state;
+}
+
+int torr::torrent_peer::socket_file_descriptor() const
+{
+    return m_tcp.socket_file_descriptor();
+}
+
+bool torr::torrent_peer::set_blocking(bool blocking) const
+{
+    return m_tcp.set_blocking(blocking);
+}
+
+bool torr::torrent_peer::set_receive_timeout(size_t micro_seconds) const
+{
+    return m_tcp.set_receive_timeout(micro_seconds);
+}
+
 const bool torr::torrent_peer::socket_healthy() const
 {
     return m_socket_healthy;
@@ -2,15 +2,52 @@
 
 #include <torrent.hpp>
 #include <generic/dynamic_bitset.hpp>
+#include <generic/file_descriptor.hpp>
+#include <storage/piece_buffer_pool.hpp>
+#include <storage/file_storage.hpp>
 #include <network/socket/tcp.hpp>
 #include <network/socket/endian.hpp>
+#include <network/socket/token_bucket.hpp>
+#include <network/peer/wire_reader.hpp>
+#include <network/peer/wire_writer.hpp>
+#include <network/peer/transfer_estimator.hpp>
+#include <network/peer/piece_picker.hpp>
+#include <network/peer/choker.hpp>
+#include <network/peer/metadata_exchange.hpp>
+#include <network/peer/peer_exchange.hpp>
 #include <network/endpoint.hpp>
 #include <bitset>
+#include <memory>
+#include <optional>
+#include <string>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
 #define MAX_BITFIELD_BYTES 512
 #define MAX_BLOCK_SIZE 16384
 #define MAX_BLOCKS_IN_PIECE 1024
+#define MAX_REQUEST_SIZE 131072
+#define MAX_UPLOAD_REQUESTS 256
+/* pieces given up by a connection whose received blocks are kept */
+#define MAX_PARTIAL_PIECES 16
+/* queued outgoing bytes above which requests are not served yet */
+#define UPLOAD_QUEUE_HIGH_WATER 262144
+/* verified pieces are written into the torrent's files under it */
+#define DOWNLOAD_DIRECTORY "./downloads"
+/* BEP 6 fast extension, bit 0x04 of the last reserved handshake byte */
+#define HANDSHAKE_RESERVED_FAST_BYTE 27
+#define HANDSHAKE_RESERVED_FAST 0x04
+#define MAX_ALLOWED_FAST 64
+#define MAX_SUGGESTED_PIECES 32
+/* BEP 10 extension protocol, bit 0x10 of reserved byte 5 */
+#define HANDSHAKE_RESERVED_EXTENDED_BYTE 25
+#define HANDSHAKE_RESERVED_EXTENDED 0x10
+/* extended message ids we assign, 0 is the extended handshake */
+#define EXTENDED_HANDSHAKE_ID 0
+#define EXTENDED_UT_METADATA_ID 1
+#define EXTENDED_UT_PEX_ID 2
+#define MAX_EXTENDED_HANDSHAKE_SIZE 65536
 
 namespace torr {
 
@@ -30,6 +67,12 @@ enum class message_type :
     request = 6,
     block = 7,
     cancel = 8,
+    suggest_piece = 13,
+    have_all = 14,
+    have_none = 15,
+    reject_request = 16,
+    allowed_fast = 17,
+    extended = 20,
 };
 
 struct message {
@@ -37,12 +80,31 @@ struct message {
     message_type type {};
 } __attribute__((packed));
 
+/* payload of request and cancel messages */
+struct block_request_payload {
+    big_endian_uint32_t piece_index;
+    big_endian_uint32_t begin;
+    big_endian_uint32_t length;
+} __attribute__((packed));
+
 private:
     std::unique_ptr<torrent_source> m_download_target;
     std::vector<std::byte> m_identifier;
     std::vector<std::byte> m_handshake;
     dynamic_bitset m_bitfield_pieces;
+    piece_picker m_picker;
+    torr::choker m_choker;
+    piece_buffer_pool m_piece_buffers;
+    /* blocks of released pieces, resumed by the next downloader */
+    std::unordered_map<size_t, piece_buffer> m_partial_pieces;
+    file_storage m_storage { DOWNLOAD_DIRECTORY };
+    metadata_exchange m_metadata;
+    torr::peer_exchange m_peer_exchange;
+    /* torrent wide limits, the parents of every connection's limits */
+    token_bucket m_download_limit;
+    token_bucket m_upload_limit;
     endpoint m_endpoint;
+    size_t m_wasted_bytes {};
 
 public:
     peer();
@@ -51,76 +113,264 @@ public:
     size_t randomize_identifier();
     size_t construct_handshake_string();
     void set_download_target(const torrent_source&);
+    /* completes a target known only by its info-hash with the
+     * info dictionary, ex. once the metadata exchange finished */
+    std::expected<bool, const char*> set_metadata(std::span<const std::byte> info);
+    bool has_metadata() const;
     void piece_download_complete(size_t piece_index);
     void set_shared_bitfield(uint8_t* shared_pointer, size_t bytes_size);
+    bool verify_piece(size_t piece_index, std::span<const std::byte> data) const;
+    std::optional<size_t> pick_piece(const dynamic_bitset& remote);
+    void release_piece(size_t piece_index);
+    bool has_piece(size_t piece_index) const;
+    /* registers a download of a specific piece, ex. a suggested or
+     * allowed fast one, false if we have it or it is taken */
+    bool claim_piece(size_t piece_index);
+    /* keeps the blocks of a released piece, ex. one whose requests
+     * timed out, so the next connection resumes instead of starting over */
+    void keep_partial_piece(size_t piece_index, piece_buffer buffer);
+    /* the kept blocks of a piece, an empty buffer if there are none */
+    piece_buffer take_partial_piece(size_t piece_index);
+    /* claims a kept partial piece the remote has, before any other */
+    std::optional<size_t> pick_partial_piece(const dynamic_bitset& remote);
+    /* duplicate or unrequested block bytes, the cost of endgame */
+    void add_wasted_bytes(size_t bytes);
+    size_t wasted_bytes() const;
 
     const std::vector<std::byte>& identifier() const;
     const torrent_source& download_target() const;
     const std::vector<std::byte>& handshake() const;
     const dynamic_bitset& bitfield_pieces() const;
+    piece_picker& picker();
+    const piece_picker& picker() const;
+    piece_buffer_pool& piece_buffers();
+    file_storage& storage();
+    metadata_exchange& metadata();
+    torr::peer_exchange& peer_exchange();
+    token_bucket& download_limit();
+    token_bucket& upload_limit();
+    /* shares limits across torrents, the buckets must outlive the peer */
+    void set_global_limits(token_bucket* download, token_bucket* upload);
+    torr::choker& choker();
+    bool seeding() const;
 };
 
 class torrent_peer {
 public:
+    enum class connection_state {
+        idle = 0,
+        connecting = 1,
+        handshaking = 2,
+        connected = 3,
+    };
+
+    struct block_request {
+        uint32_t piece_index {};
+        uint32_t offset {};
+        uint32_t length {};
+        transfer_estimator::clock::time_point sent {};
+    };
+
     struct download_torrent_piece {
         size_t piece_index {};
         size_t piece_size {};
         size_t downloaded {};
+        /* offset of the next block never requested */
+        size_t requested {};
         bool exists { false };
-        std::vector<std::byte> data;
+        piece_buffer buffer;
+        /* requests dropped by a choke, requested again first */
+        std::vector<block_request> returned;
     };
 
 private:
     tcp m_tcp;
+    token_bucket m_download_limit;
+    token_bucket m_upload_limit;
+    wire_reader m_reader;
+    wire_writer m_writer;
     dynamic_bitset m_bitfield;
     download_torrent_piece m_download_piece;
+    transfer_estimator m_estimator;
+    transfer_estimator m_upload_estimator;
+    std::vector<block_request> m_requests;
+    /* requests of the remote, served as the outgoing queue drains */
+    std::vector<block_request> m_upload_requests;
+    /* the files requested blocks are served from */
+    file_storage* m_storage {};
 
     std::string m_ip_address_string;
     bool m_socket_healthy {};
     in_addr m_ip_address {};
     size_t m_port {};
-    uint32_t m_outstanding_requests {};
-    time_t m_time_of_last_keep_alive_message { 0 };
+    size_t m_request_queue_depth { REQUEST_QUEUE_INITIAL };
+    transfer_estimator::clock::time_point m_last_keep_alive {};
+    /* the last complete message, keep-alives included */
+    transfer_estimator::clock::time_point m_last_received {};
+    /* the start of the current wait for blocks, the last block or
+     * the first request sent while none were outstanding */
+    transfer_estimator::clock::time_point m_last_block {};
+    /* the last requests timed out, the wait goes on across them */
+    bool m_requests_timed_out { 0 };
+    /* request timeouts since the last block arrived */
+    size_t m_request_timeouts {};
+    /* delivered nothing for snub_timeout, one request at a time */
+    bool m_snubbed { 0 };
 
+    connection_state m_state { connection_state::idle };
     bool m_handshake_complete { 0 };
     bool m_am_interested { 0 };
+    /* we choke the remote, the remote chokes us */
     bool m_am_choking { 1 };
-    bool m_peer_intersted { 0 };
+    bool m_peer_interested { 0 };
     bool m_peer_choking { 1 };
     bool m_can_send_request { 1 };
+    bool m_supports_fast { 0 };
+    bool m_supports_extended { 0 };
+    /* the remote's extended message id for ut_metadata, 0 if none */
+    uint8_t m_remote_ut_metadata { 0 };
+    bool m_metadata_rejected { 0 };
+    /* the remote's extended message id for ut_pex, 0 if none */
+    uint8_t m_remote_ut_pex { 0 };
+    peer_exchange::advertised m_advertised_peers;
+    /* HAVE_ALL received before the piece count was known */
+    bool m_have_all { 0 };
+    /* pieces the remote serves while choking us, and its hints */
+    std::vector<uint32_t> m_allowed_fast;
+    std::vector<uint32_t> m_suggested;
+    /* ut_metadata pieces requested from the remote */
+    std::vector<block_request> m_metadata_requests;
 
+    /* the start of the current wait, time the rate limits held
+     * received data back is not counted against the remote */
+    transfer_estimator::clock::time_point blocks_waiting_since() const;
     void determine_outstanding_requests(const peer& ourself);
-    bool determine_download_piece(const peer& ourself);
+    bool determine_download_piece(peer& ourself);
 
+    bool verify_handshake(const peer& ourself, std::span<const std::byte> received);
+    bool process_received(peer& ourself);
+    bool process_messages(peer& ourself);
+    bool handle_message(peer& ourself, const wire_message& message);
     bool receive_message_choke();
-    bool receive_message_unchoke(const peer& ourself);
-    bool receive_message_cancel(const peer::message& message);
-    bool receive_message_block(const peer& ourself, const peer::message& message);
-    bool receive_message_request(const peer::message& message);
-    bool receive_message_bitfield(const peer::message& message);
-    bool receive_message_have(const peer::message& message);
-    bool receive_message_keep_alive(const peer::message& message);
+    bool receive_message_unchoke(peer& ourself);
+    bool receive_message_cancel(std::span<const std::byte> payload);
+    bool receive_message_block(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_request(const peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_bitfield(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_have(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_keep_alive();
+    bool receive_message_have_all(peer& ourself);
+    bool receive_message_have_none(peer& ourself);
+    bool receive_message_reject(std::span<const std::byte> payload);
+    bool receive_message_allowed_fast(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_suggest(std::span<const std::byte> payload);
+    bool receive_message_extended(peer& ourself, std::span<const std::byte> payload);
+    bool receive_extended_handshake(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_metadata(peer& ourself, std::span<const std::byte> payload);
+    bool receive_message_pex(peer& ourself, std::span<const std::byte> payload);
+    bool allowed_fast(size_t piece_index) const;
+    bool can_request() const;
+    bool cancel_finished_piece(peer& ourself);
 
     bool fill_outstanding_requests(const peer& ourself);
-    bool send_message_request(uint32_t offset = 0);
+    bool send_message_request(uint32_t offset, uint32_t length);
+    bool send_message_cancel(const block_request& request);
     bool send_message_interested();
+    bool send_message_choke();
+    bool send_message_unchoke();
+    bool serve_upload_requests();
     bool send_message_bitfield(const peer& ourself);
-    bool send_message_have(const download_torrent_piece& piece);
+    bool send_message_availability(const peer& ourself);
+    bool send_message_reject(const block_request& request);
+    bool send_message_extended(uint8_t id, std::span<const std::byte> payload);
+    bool send_message_extended_handshake(const peer& ourself);
+    bool send_message_metadata_request(size_t piece);
+    bool send_message_metadata(const peer& ourself, size_t piece);
 
 public:
+    static constexpr transfer_estimator::clock::duration snub_timeout = std::chrono::seconds(20);
+
     torrent_peer();
     ~torrent_peer();
 
-    bool download_next_piece(const peer& ourself);
-    bool receive_message(const peer& ourself);
+    bool download_next_piece(peer& ourself);
+    bool receive_message(peer& ourself);
+    bool flush();
     bool set_ip_and_port(const in_addr&, const size_t&);
     bool handshake(const peer& ourself);
+
+    /* event driven use, the socket is non-blocking and the handshake
+     * is sent and verified as the socket turns writable and readable */
+    std::expected<int, const char*> connect_non_blocking(const peer& ourself);
+    bool on_readable(peer& ourself);
+    bool on_writable(peer& ourself);
+    /* reads and verifies only the handshake, messages that follow it
+     * stay buffered until the connection is driven by its owner */
+    bool on_handshake_readable(const peer& ourself);
+    /* completion driven use, data was received by an io_ring and
+     * outgoing bytes are moved out to be sent by it */
+    bool on_received(peer& ourself, std::span<const std::byte> data);
+    size_t take_outgoing(std::vector<std::byte>& out);
+    bool has_outgoing() const;
+    /* queues HAVE for a piece we verified */
+    bool announce_piece(size_t piece_index);
+    /* keeps ut_metadata requests in flight while the info dictionary
+     * is unknown, pieces are shared out by the peer's exchange */
+    bool request_metadata(peer& ourself);
+    /* the info dictionary became known, availability the remote
+     * announced so far is sized to the piece count and counted */
+    bool on_metadata(peer& ourself);
+    /* queues ut_pex with the peers connected since the last one,
+     * at most once per peer_exchange::interval */
+    bool exchange_peers(peer& ourself);
+
     void empty_download_piece();
+    /* moves the finished piece out, ex. to be verified and written */
+    piece_buffer take_piece_buffer();
+    void detach(peer& ourself);
+    /* queues CHOKE or UNCHOKE, only if the state changes */
+    bool set_choking(bool choke);
+    /* queues a keep-alive, the owner sends them periodically */
+    bool send_message_keep_alive();
+    /* cancels the requests once the oldest went unanswered for the
+     * estimator's request timeout, counted from the last block, and
+     * returns their piece to the picker for other connections, the
+     * blocks received of it are kept for whoever resumes it. A remote
+     * without a block for snub_timeout is snubbed. Returns true if
+     * requests timed out */
+    bool check_request_timeouts(peer& ourself,
+        transfer_estimator::clock::time_point now = transfer_estimator::clock::now());
+    /* when check_request_timeouts() has something to do, none
+     * without outstanding requests */
+    std::optional<transfer_estimator::clock::time_point> request_deadline() const;
+    bool snubbed() const;
+    /* timeouts in a row, none of the requests since got a block */
+    size_t request_timeouts() const;
+    /* the connection's limits draw from the torrent's limits */
+    void attach_rate_limits(peer& ourself);
+    void attach_storage(peer& ourself);
+    token_bucket& download_limit();
+    token_bucket& upload_limit();
+    /* the last transfer stopped at a limit, not at the socket, the
+     * owner drives the connection again once the buckets refilled */
+    bool throttled() const;
 
     const download_torrent_piece& download_piece() const;
+    const transfer_estimator& estimator() const;
+    const transfer_estimator& upload_estimator() const;
+    transfer_estimator::clock::time_point last_received() const;
+    bool am_choking() const;
+    bool supports_fast() const;
+    bool supports_extended() const;
+    bool peer_interested() const;
     const std::string& ip_address_as_string() const;
     const in_addr& ip_address() const;
+    peer_ip_touple address() const;
     const size_t port() const;
+    connection_state state() const;
+    int socket_file_descriptor() const;
+    bool set_blocking(bool blocking) const;
+    bool set_receive_timeout(size_t micro_seconds) const;
     const bool socket_healthy() const;
 };
 
@@ -0,0 +1,167 @@
+#include "peer_exchange.hpp"
+#include <network/socket/endian.hpp>
+#include <generic/bencode_view.hpp>
+#include <generic/bencode_writer.hpp>
+#include <algorithm>
+#include <cstring>
+
+torr::peer_exchange::peer_exchange() {}
+torr::peer_exchange::~peer_exchange() {}
+
+uint64_t torr::peer_exchange::key(const peer_ip_touple& address)
+{
+    return ((uint64_t)ntohl(address.address.s_addr) << 16) | (uint16_t)address.port;
+}
+
+torr::peer_ip_touple torr::peer_exchange::address(uint64_t key)
+{
+    peer_ip_touple address {};
+    address.address.s_addr = htonl((uint32_t)(key >> 16));
+    address.port = (uint16_t)key;
+    return address;
+}
+
+void torr::peer_exchange::append_compact(std::vector<std::byte>& out,
+    const peer_ip_touple& address)
+{
+    struct compact_peer {
+        uint32_t address;
+        big_endian_uint16_t port;
+    } __attribute__((packed));
+
+    compact_peer compact;
+    compact.address = address.address.s_addr;
+    compact.port = (uint16_t)address.port;
+    auto bytes = (const std::byte*)&compact;
+    out.insert(out.end(), bytes, bytes + sizeof(compact));
+}
+
+std::vector<torr::peer_ip_touple>
+    torr::peer_exchange::parse_compact(std::span<const std::byte> compact)
+{
+    std::vector<peer_ip_touple> addresses;
+    for (size_t i = 0; i + PEX_COMPACT_SIZE <= compact.size(); i += PEX_COMPACT_SIZE) {
+        peer_ip_touple address {};
+        big_endian_uint16_t port;
+        memcpy(&address.address.s_addr, compact.data() + i, sizeof(uint32_t));
+        memcpy(&port, compact.data() + i + sizeof(uint32_t), sizeof(port));
+        address.port = port.as_small_endian();
+        if (address.address.s_addr && address.port)
+            addresses.push_back(address);
+    }
+    return addresses;
+}
+
+void torr::peer_exchange::add_connected(const peer_ip_touple& address)
+{
+    m_connected.insert(key(address));
+    m_known.insert(key(address));
+}
+
+void torr::peer_exchange::remove_connected(const peer_ip_touple& address)
+{
+    m_connected.erase(key(address));
+}
+
+bool torr::peer_exchange::add_known(const peer_ip_touple& address)
+{
+    return m_known.insert(key(address)).second;
+}
+
+std::optional<std::vector<std::byte>> torr::peer_exchange::build(advertised& state,
+    const peer_ip_touple& remote, clock::time_point now)
+{
+    if (now < state.next)
+        return {};
+    state.next = now + interval;
+
+    /* the remote is never told about itself */
+    uint64_t remote_key = key(remote);
+    std::vector<std::byte> added;
+    std::vector<std::byte> added_flags;
+    std::vector<std::byte> dropped;
+
+    for (uint64_t peer : m_connected) {
+        if (added_flags.size() >= PEX_MAX_ADDED)
+            break;
+        if (peer == remote_key || state.peers.contains(peer))
+            continue;
+        append_compact(added, address(peer));
+        added_flags.push_back((std::byte)PEX_FLAG_REACHABLE);
+        state.peers.insert(peer);
+    }
+
+    size_t dropped_count = 0;
+    for (auto it = state.peers.begin(); it != state.peers.end() && dropped_count < PEX_MAX_DROPPED;) {
+        if (m_connected.contains(*it)) {
+            ++it;
+            continue;
+        }
+        append_compact(dropped, address(*it));
+        it = state.peers.erase(it);
+        dropped_count++;
+    }
+
+    if (added.empty() && dropped.empty())
+        return {};
+
+    std::vector<std::byte> payload;
+    bencode_writer writer(payload);
+    writer.begin_dictionary()
+        .key("added").string(added)
+        .key("added.f").string(added_flags)
+        .key("dropped").string(dropped)
+    .end();
+    if (!writer.finish().has_value())
+        return {};
+    return payload;
+}
+
+std::expected<size_t, const char*> torr::peer_exchange::receive(advertised& state,
+    std::span<const std::byte> payload, clock::time_point now)
+{
+    if (state.has_received && now - state.received < interval / 2)
+        return 0;
+    state.received = now;
+    state.has_received = true;
+
+    bencode_view message;
+    if (!message.from_buffer(payload).has_value() ||
+        message.root().type() != bencode_view::target_type::dictionaries)
+        return std::unexpected("peer exchange: invalid message");
+
+    auto added = message["added"];
+    if (added.type() != bencode_view::target_type::strings)
+        return 0;
+
+    /* a message may list more than allowed, the rest is ignored */
+    size_t count = 0;
+    auto addresses = parse_compact(added.as_bytes());
+    for (const auto& address : addresses) {
+        if (count >= PEX_MAX_ADDED || m_discovered.size() >= PEX_MAX_DISCOVERED)
+            break;
+        if (!add_known(address))
+            continue;
+        m_discovered.push_back(address);
+        count++;
+    }
+    return count;
+}
+
+std::vector<torr::peer_ip_touple> torr::peer_exchange::take_discovered(size_t max)
+{
+    size_t count = std::min(max, m_discovered.size());
+    std::vector<peer_ip_touple> taken(m_discovered.begin(), m_discovered.begin() + count);
+    m_discovered.erase(m_discovered.begin(), m_discovered.begin() + count);
+    return taken;
+}
+
+size_t torr::peer_exchange::discovered() const
+{
+    return m_discovered.size();
+}
+
+size_t torr::peer_exchange::connected() const
+{
+    return m_connected.size();
+}
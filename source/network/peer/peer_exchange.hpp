@@ -0,0 +1,78 @@
+#pragma once
+
+#include <torrent.hpp>
+#include <unordered_set>
+#include <expected>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <span>
+
+/* BEP 11, at most 50 added and 50 dropped peers once a minute */
+#define PEX_MAX_ADDED 50
+#define PEX_MAX_DROPPED 50
+#define PEX_MAX_DISCOVERED 1024
+#define PEX_COMPACT_SIZE 6
+/* added.f flag, the peer accepted an incoming connection */
+#define PEX_FLAG_REACHABLE 0x10
+
+namespace torr {
+
+/* Peer exchange (ut_pex) state shared by every connection of a
+ * download. The connected set is what we advertise, each connection
+ * remembers what it was told and only the difference is sent, at most
+ * once per interval. Addresses learned from remotes are queued once,
+ * addresses already known, ex. from the tracker, are not queued. */
+class peer_exchange {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::duration interval = std::chrono::seconds(60);
+
+    /* what one connection was told so far */
+    struct advertised {
+        std::unordered_set<uint64_t> peers;
+        clock::time_point next {};
+        /* the last message received, remotes are held to the interval too */
+        clock::time_point received {};
+        bool has_received {};
+    };
+
+private:
+    std::unordered_set<uint64_t> m_connected;
+    std::unordered_set<uint64_t> m_known;
+    std::deque<peer_ip_touple> m_discovered;
+
+public:
+    peer_exchange();
+    ~peer_exchange();
+
+    /* the compact form, address and port in network order */
+    static uint64_t key(const peer_ip_touple& address);
+    static peer_ip_touple address(uint64_t key);
+    static void append_compact(std::vector<std::byte>& out, const peer_ip_touple& address);
+    static std::vector<peer_ip_touple> parse_compact(std::span<const std::byte> compact);
+
+    void add_connected(const peer_ip_touple& address);
+    void remove_connected(const peer_ip_touple& address);
+    /* true if the address was not known yet */
+    bool add_known(const peer_ip_touple& address);
+
+    /* the ut_pex payload for a connection, empty if it is not
+     * due yet or nothing changed since its last message */
+    std::optional<std::vector<std::byte>> build(advertised& state,
+        const peer_ip_touple& remote, clock::time_point now = clock::now());
+    /* queues the unknown added peers of a ut_pex payload, returns how
+     * many, messages arriving within half an interval are ignored */
+    std::expected<size_t, const char*> receive(advertised& state,
+        std::span<const std::byte> payload, clock::time_point now = clock::now());
+
+    std::vector<peer_ip_touple> take_discovered(size_t max = PEX_MAX_DISCOVERED);
+    size_t discovered() const;
+    size_t connected() const;
+};
+
+}
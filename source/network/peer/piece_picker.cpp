@@ -0,0 +1,213 @@
+#include "piece_picker.hpp"
+#include <algorithm>
+#include <numeric>
+
+torr::piece_picker::piece_picker()
+    : m_random(std::random_device {}())
+{
+}
+
+torr::piece_picker::~piece_picker() {}
+
+void torr::piece_picker::resize(size_t piece_count)
+{
+    m_pieces.resize(piece_count);
+    std::iota(m_pieces.begin(), m_pieces.end(), 0);
+    std::shuffle(m_pieces.begin(), m_pieces.end(), m_random);
+
+    m_position.resize(piece_count);
+    for (size_t i = 0; i < piece_count; ++i)
+        m_position[m_pieces[i]] = i;
+
+    m_availability.assign(piece_count, 0);
+    m_bucket_begin = { 0, 0, (uint32_t)piece_count };
+    m_have.resize_bits(piece_count);
+    m_storing.resize_bits(piece_count);
+    m_downloaders.assign(piece_count, 0);
+    m_have_count = 0;
+    m_downloading_count = 0;
+}
+
+size_t torr::piece_picker::piece_count() const
+{
+    return m_pieces.size();
+}
+
+size_t torr::piece_picker::bucket_of(uint32_t piece) const
+{
+    return m_have.bit_get(piece) ? 0 : m_availability[piece] + 1;
+}
+
+void torr::piece_picker::move_up(uint32_t piece)
+{
+    /* swap with the last piece of the bucket and shrink it by one */
+    size_t bucket = bucket_of(piece);
+    if (bucket + 2 >= m_bucket_begin.size())
+        m_bucket_begin.insert(m_bucket_begin.end() - 1, m_bucket_begin.back());
+
+    uint32_t last = m_bucket_begin[bucket + 1] - 1;
+    uint32_t other = m_pieces[last];
+    std::swap(m_pieces[m_position[piece]], m_pieces[last]);
+    m_position[other] = m_position[piece];
+    m_position[piece] = last;
+    m_bucket_begin[bucket + 1]--;
+}
+
+void torr::piece_picker::move_down(uint32_t piece)
+{
+    /* swap with the first piece of the bucket and shrink it by one */
+    size_t bucket = bucket_of(piece);
+    uint32_t first = m_bucket_begin[bucket];
+    uint32_t other = m_pieces[first];
+    std::swap(m_pieces[m_position[piece]], m_pieces[first]);
+    m_position[other] = m_position[piece];
+    m_position[piece] = first;
+    m_bucket_begin[bucket]++;
+}
+
+void torr::piece_picker::increment(size_t piece_index)
+{
+    if (piece_index >= m_pieces.size())
+        return;
+    if (!m_have.bit_get(piece_index))
+        move_up(piece_index);
+    m_availability[piece_index]++;
+}
+
+void torr::piece_picker::decrement(size_t piece_index)
+{
+    if (piece_index >= m_pieces.size() || !m_availability[piece_index])
+        return;
+    if (!m_have.bit_get(piece_index))
+        move_down(piece_index);
+    m_availability[piece_index]--;
+}
+
+void torr::piece_picker::add_bitfield(const dynamic_bitset& bitfield)
+{
+    size_t count = std::min(bitfield.bits_size(), m_pieces.size());
+    for (size_t i = 0; i < count; ++i)
+        if (bitfield.bit_get(i)) increment(i);
+}
+
+void torr::piece_picker::remove_bitfield(const dynamic_bitset& bitfield)
+{
+    size_t count = std::min(bitfield.bits_size(), m_pieces.size());
+    for (size_t i = 0; i < count; ++i)
+        if (bitfield.bit_get(i)) decrement(i);
+}
+
+void torr::piece_picker::set_have(size_t piece_index)
+{
+    if (piece_index >= m_pieces.size() || m_have.bit_get(piece_index))
+        return;
+
+    /* walk down to the first pickable bucket, then into bucket 0 */
+    uint32_t availability = m_availability[piece_index];
+    for (uint32_t i = 0; i < availability; ++i) {
+        m_availability[piece_index] = availability - i;
+        move_down(piece_index);
+    }
+    m_availability[piece_index] = 0;
+    move_down(piece_index);
+
+    m_have.bit_set(piece_index);
+    m_storing.bit_clear(piece_index);
+    m_have_count++;
+    if (m_downloaders[piece_index])
+        m_downloading_count--;
+    m_downloaders[piece_index] = 0;
+    m_availability[piece_index] = availability;
+}
+
+bool torr::piece_picker::have(size_t piece_index) const
+{
+    return m_have.bit_get(piece_index);
+}
+
+void torr::piece_picker::set_storing(size_t piece_index, bool storing)
+{
+    if (piece_index >= m_pieces.size() || m_have.bit_get(piece_index))
+        return;
+    if (storing)
+        m_storing.bit_set(piece_index);
+    else
+        m_storing.bit_clear(piece_index);
+}
+
+bool torr::piece_picker::storing(size_t piece_index) const
+{
+    return m_storing.bit_get(piece_index);
+}
+
+void torr::piece_picker::add_downloader(size_t piece_index)
+{
+    if (piece_index >= m_pieces.size() || m_have.bit_get(piece_index))
+        return;
+    if (!m_downloaders[piece_index])
+        m_downloading_count++;
+    if (m_downloaders[piece_index] < UINT8_MAX)
+        m_downloaders[piece_index]++;
+}
+
+void torr::piece_picker::remove_downloader(size_t piece_index)
+{
+    if (piece_index >= m_pieces.size() || !m_downloaders[piece_index])
+        return;
+    if (!--m_downloaders[piece_index])
+        m_downloading_count--;
+}
+
+size_t torr::piece_picker::downloaders(size_t piece_index) const
+{
+    if (piece_index >= m_downloaders.size())
+        return 0;
+    return m_downloaders[piece_index];
+}
+
+bool torr::piece_picker::endgame() const
+{
+    return !m_pieces.empty() && m_have_count + m_downloading_count == m_pieces.size();
+}
+
+size_t torr::piece_picker::availability(size_t piece_index) const
+{
+    if (piece_index >= m_availability.size())
+        return 0;
+    return m_availability[piece_index];
+}
+
+std::optional<size_t> torr::piece_picker::pick(const dynamic_bitset& remote)
+{
+    for (size_t bucket = 1; bucket + 1 < m_bucket_begin.size(); ++bucket) {
+        uint32_t begin = m_bucket_begin[bucket];
+        uint32_t size = m_bucket_begin[bucket + 1] - begin;
+        if (!size)
+            continue;
+
+        uint32_t start = m_random() % size;
+        for (uint32_t i = 0; i < size; ++i) {
+            uint32_t piece = m_pieces[begin + (start + i) % size];
+            if (remote.bit_get(piece) && !m_downloaders[piece])
+                return piece;
+        }
+    }
+    return {};
+}
+
+std::optional<size_t> torr::piece_picker::pick_endgame(const dynamic_bitset& remote) const
+{
+    if (!endgame())
+        return {};
+
+    /* only the few pieces still in flight are left outside bucket 0 */
+    std::optional<size_t> found;
+    for (size_t i = m_bucket_begin[1]; i < m_pieces.size(); ++i) {
+        uint32_t piece = m_pieces[i];
+        if (!remote.bit_get(piece) || m_storing.bit_get(piece))
+            continue;
+        if (!found || m_downloaders[piece] < m_downloaders[*found])
+            found = piece;
+    }
+    return found;
+}
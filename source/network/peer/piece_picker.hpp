@@ -0,0 +1,79 @@
+#pragma once
+
+#include <generic/dynamic_bitset.hpp>
+#include <optional>
+#include <cstdint>
+#include <vector>
+#include <random>
+
+namespace torr {
+
+/* Rarest-first piece selection from swarm availability.
+ *
+ * All pieces are kept in one array ordered by availability, split into
+ * buckets of equal availability. Moving a piece to the next bucket is
+ * a single swap with the bucket's edge, so HAVE and bitfield updates
+ * cost O(1) per piece. Bucket 0 holds the pieces we already have and
+ * is never picked from, the pickable buckets start at availability 0.
+ *
+ * The initial order is shuffled and the scan within a bucket starts at
+ * a random position, so ties between equally rare pieces are random. */
+class piece_picker {
+private:
+    std::vector<uint32_t> m_pieces;
+    std::vector<uint32_t> m_position;
+    std::vector<uint32_t> m_availability;
+    /* m_bucket_begin[b] is the first position of bucket b, bucket b
+     * holds availability b - 1, the last entry is the end of the array */
+    std::vector<uint32_t> m_bucket_begin;
+    dynamic_bitset m_have;
+    /* verified and being written, never downloaded again */
+    dynamic_bitset m_storing;
+    /* connections downloading each piece, more than one in endgame */
+    std::vector<uint8_t> m_downloaders;
+    size_t m_have_count {};
+    size_t m_downloading_count {};
+    std::minstd_rand m_random;
+
+    size_t bucket_of(uint32_t piece) const;
+    void move_up(uint32_t piece);
+    void move_down(uint32_t piece);
+
+public:
+    piece_picker();
+    ~piece_picker();
+
+    void resize(size_t piece_count);
+    size_t piece_count() const;
+
+    /* a connected peer announced or dropped a piece */
+    void increment(size_t piece_index);
+    void decrement(size_t piece_index);
+    void add_bitfield(const dynamic_bitset& bitfield);
+    void remove_bitfield(const dynamic_bitset& bitfield);
+
+    /* we have the piece, it is never picked again */
+    void set_have(size_t piece_index);
+    bool have(size_t piece_index) const;
+    /* a verified piece is written asynchronously, until set_have() or
+     * a failed write clears it endgame does not request it again */
+    void set_storing(size_t piece_index, bool storing);
+    bool storing(size_t piece_index) const;
+
+    /* pieces in flight are skipped, so connections pick different pieces */
+    void add_downloader(size_t piece_index);
+    void remove_downloader(size_t piece_index);
+    size_t downloaders(size_t piece_index) const;
+
+    /* every piece we miss is already being downloaded */
+    bool endgame() const;
+
+    size_t availability(size_t piece_index) const;
+
+    /* rarest piece the remote has, that we neither have nor download */
+    std::optional<size_t> pick(const dynamic_bitset& remote);
+    /* in endgame, the in flight piece the remote has with the fewest downloaders */
+    std::optional<size_t> pick_endgame(const dynamic_bitset& remote) const;
+};
+
+}
@@ -0,0 +1,117 @@
+#include "transfer_estimator.hpp"
+#include <algorithm>
+#include <cmath>
+
+torr::transfer_estimator::transfer_estimator() {}
+torr::transfer_estimator::~transfer_estimator() {}
+
+void torr::transfer_estimator::add_bytes(size_t bytes, clock::time_point now)
+{
+    m_total_bytes += bytes;
+    if (m_window_begin == clock::time_point {})
+        m_window_begin = now;
+
+    m_window_bytes += bytes;
+    if (now - m_window_begin < rate_window)
+        return;
+
+    /* the first window is the rate, later ones are folded in */
+    if (!m_has_rate)
+        m_rate = m_window_bytes / std::chrono::duration<double>(now - m_window_begin).count();
+    else
+        m_rate = folded_rate(now);
+    m_has_rate = true;
+    m_window_begin = now;
+    m_window_bytes = 0;
+}
+
+void torr::transfer_estimator::add_rtt_sample(clock::duration sample, clock::time_point now)
+{
+    if (sample <= clock::duration::zero())
+        sample = clock::duration(1);
+
+    if (!m_has_rtt) {
+        m_srtt = sample;
+        m_rttvar = sample / 2;
+        m_min_rtt = sample;
+        m_min_rtt_stamp = now;
+        m_has_rtt = true;
+        return;
+    }
+
+    /* RFC 6298: rttvar = 3/4 rttvar + 1/4 |srtt - r|, srtt = 7/8 srtt + 1/8 r */
+    auto error = (m_srtt > sample) ? m_srtt - sample : sample - m_srtt;
+    m_rttvar = (3 * m_rttvar + error) / 4;
+    m_srtt = (7 * m_srtt + sample) / 8;
+
+    if (sample <= m_min_rtt || now - m_min_rtt_stamp > min_rtt_window) {
+        m_min_rtt = sample;
+        m_min_rtt_stamp = now;
+    }
+}
+
+double torr::transfer_estimator::folded_rate(clock::time_point now) const
+{
+    auto elapsed = now - m_window_begin;
+    double sample = m_window_bytes / std::chrono::duration<double>(elapsed).count();
+
+    /* one EWMA step per window gone by, all with the open window's average */
+    double windows = elapsed / rate_window;
+    return sample + (m_rate - sample) * std::pow(1 - rate_alpha, windows);
+}
+
+double torr::transfer_estimator::rate(clock::time_point now) const
+{
+    if (!m_has_rate || now - m_window_begin < rate_window)
+        return m_rate;
+
+    return folded_rate(now);
+}
+
+size_t torr::transfer_estimator::total_bytes() const
+{
+    return m_total_bytes;
+}
+
+bool torr::transfer_estimator::has_rtt() const
+{
+    return m_has_rtt;
+}
+
+torr::transfer_estimator::clock::duration torr::transfer_estimator::srtt() const
+{
+    return m_srtt;
+}
+
+torr::transfer_estimator::clock::duration torr::transfer_estimator::rttvar() const
+{
+    return m_rttvar;
+}
+
+torr::transfer_estimator::clock::duration torr::transfer_estimator::min_rtt() const
+{
+    return m_min_rtt;
+}
+
+torr::transfer_estimator::clock::duration torr::transfer_estimator::rto() const
+{
+    return m_srtt + 4 * m_rttvar;
+}
+
+torr::transfer_estimator::clock::duration torr::transfer_estimator::request_timeout() const
+{
+    if (!m_has_rtt)
+        return initial_request_timeout;
+    return std::clamp(rto(), min_request_timeout, max_request_timeout);
+}
+
+size_t torr::transfer_estimator::queue_depth(size_t block_size) const
+{
+    if (!m_has_rate || !m_has_rtt || !block_size)
+        return REQUEST_QUEUE_INITIAL;
+
+    double delay = std::chrono::duration<double>(m_min_rtt).count();
+    double bdp = m_rate * delay * queue_gain;
+    size_t depth = (size_t)std::ceil(bdp / block_size);
+    return std::clamp<size_t>(depth, REQUEST_QUEUE_MIN, REQUEST_QUEUE_MAX);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#define REQUEST_QUEUE_MIN 2
+#define REQUEST_QUEUE_INITIAL 16
+#define REQUEST_QUEUE_MAX 512
+
+namespace torr {
+
+/* Per connection throughput and round trip estimation.
+ *
+ * The download rate is an EWMA over fixed windows, every window
+ * without bytes counts as an empty sample so the rate decays while
+ * the transfer is stalled. Round trips are
+ * measured from a request to its block, smoothed as in RFC 6298 for
+ * timeouts, and the lowest recent sample approximates the path delay
+ * without the time requests wait in the peer's queue. The request
+ * queue depth follows the bandwidth-delay product from those two. */
+class transfer_estimator {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr clock::duration rate_window = std::chrono::milliseconds(500);
+    static constexpr clock::duration min_rtt_window = std::chrono::seconds(10);
+    static constexpr double rate_alpha = 0.25;
+    /* requests kept in flight relative to the bandwidth-delay product,
+     * above 1 so the queue keeps growing while the rate still scales */
+    static constexpr double queue_gain = 2.0;
+    /* block request timeouts, the first before any round trip is known */
+    static constexpr clock::duration initial_request_timeout = std::chrono::seconds(10);
+    static constexpr clock::duration min_request_timeout = std::chrono::seconds(2);
+    static constexpr clock::duration max_request_timeout = std::chrono::seconds(60);
+
+private:
+    clock::time_point m_window_begin {};
+    size_t m_window_bytes {};
+    double m_rate {};
+    bool m_has_rate {};
+
+    clock::duration m_srtt {};
+    clock::duration m_rttvar {};
+    clock::duration m_min_rtt {};
+    clock::time_point m_min_rtt_stamp {};
+    bool m_has_rtt {};
+
+    size_t m_total_bytes {};
+
+    /* the rate with the open window and the empty ones since folded in */
+    double folded_rate(clock::time_point now) const;
+
+public:
+    transfer_estimator();
+    ~transfer_estimator();
+
+    void add_bytes(size_t bytes, clock::time_point now = clock::now());
+    void add_rtt_sample(clock::duration sample, clock::time_point now = clock::now());
+
+    /* bytes per second, 0 until the first window completes */
+    double rate(clock::time_point now = clock::now()) const;
+    size_t total_bytes() const;
+    bool has_rtt() const;
+    clock::duration srtt() const;
+    clock::duration rttvar() const;
+    clock::duration min_rtt() const;
+    /* retransmission style timeout, srtt + 4 * rttvar */
+    clock::duration rto() const;
+    /* rto() within the request timeout bounds */
+    clock::duration request_timeout() const;
+
+    /* requests of block_size to keep in flight */
+    size_t queue_depth(size_t block_size) const;
+};
+
+}
@@ -0,0 +1,71 @@
+#include "wire_reader.hpp"
+#include <network/socket/endian.hpp>
+#include <generic/try.hpp>
+#include <sys/uio.h>
+
+torr::wire_reader::wire_reader(size_t capacity, size_t max_message)
+    : m_buffer(std::max(capacity, max_message + sizeof(uint32_t))),
+    m_max_message(max_message)
+{
+}
+
+torr::wire_reader::~wire_reader() {}
+
+std::expected<size_t, const char*> torr::wire_reader::fill(const tcp& socket)
+{
+    if (!m_buffer.free())
+        return std::unexpected("wire reader: buffer full");
+
+    auto regions = m_buffer.writable_regions();
+    struct iovec vectors[2] = {
+        { regions[0].data(), regions[0].size() },
+        { regions[1].data(), regions[1].size() },
+    };
+
+    size_t received = TRY(socket.receive_vectored(vectors, regions[1].empty() ? 1 : 2));
+    m_buffer.commit(received);
+    return received;
+}
+
+size_t torr::wire_reader::append(std::span<const std::byte> data)
+{
+    return m_buffer.write(data);
+}
+
+bool torr::wire_reader::take(std::span<std::byte> out)
+{
+    if (!m_buffer.peek(out.data(), out.size()))
+        return false;
+    m_buffer.consume(out.size());
+    return true;
+}
+
+std::expected<bool, const char*> torr::wire_reader::next(wire_message& out)
+{
+    big_endian_uint32_t prefix;
+    if (!m_buffer.peek(&prefix, sizeof(prefix)))
+        return false;
+
+    uint32_t length = prefix.as_small_endian();
+    if (length > m_max_message)
+        return std::unexpected("wire reader: message too large");
+    if (m_buffer.size() < sizeof(prefix) + length)
+        return false;
+
+    out = {};
+    out.length = length;
+    out.keep_alive = (length == 0);
+    if (!out.keep_alive) {
+        m_buffer.peek(&out.id, sizeof(out.id), sizeof(prefix));
+        out.payload = m_buffer.contiguous(length - 1, sizeof(prefix) + 1, m_scratch);
+    }
+
+    /* consumed bytes are only overwritten by the next fill() */
+    m_buffer.consume(sizeof(prefix) + length);
+    return true;
+}
+
+size_t torr::wire_reader::buffered() const
+{
+    return m_buffer.size();
+}
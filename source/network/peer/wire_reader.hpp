@@ -0,0 +1,52 @@
+#pragma once
+
+#include <generic/ring_buffer.hpp>
+#include <network/socket/tcp.hpp>
+#include <expected>
+#include <cstdint>
+#include <vector>
+#include <span>
+
+#define WIRE_READER_CAPACITY 262144
+#define WIRE_READER_MAX_MESSAGE 131072
+
+namespace torr {
+
+/* one framed peer wire message, a zero length prefix is a keep-alive
+ * and carries no id. The payload excludes the length prefix and id */
+struct wire_message {
+    uint32_t length {};
+    bool keep_alive {};
+    uint8_t id {};
+    std::span<const std::byte> payload {};
+};
+
+/* Per connection receive buffer, fill() pulls whatever the socket has
+ * in one readv() and next() frames out the complete messages in it.
+ * A framed payload stays valid until the next call to fill() or next(). */
+class wire_reader {
+private:
+    ring_buffer m_buffer;
+    std::vector<std::byte> m_scratch;
+    size_t m_max_message;
+
+public:
+    explicit wire_reader(size_t capacity = WIRE_READER_CAPACITY,
+        size_t max_message = WIRE_READER_MAX_MESSAGE);
+    ~wire_reader();
+
+    /* one receive from the socket, 0 if it would block */
+    std::expected<size_t, const char*> fill(const tcp& socket);
+    /* buffers bytes received elsewhere, ex. right after the handshake */
+    size_t append(std::span<const std::byte> data);
+    /* takes raw bytes that are not length prefixed, ex. the handshake */
+    bool take(std::span<std::byte> out);
+
+    /* frames the next buffered message into out, false if the
+     * buffer does not yet hold a complete message */
+    std::expected<bool, const char*> next(wire_message& out);
+
+    size_t buffered() const;
+};
+
+}
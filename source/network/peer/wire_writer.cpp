@@ -0,0 +1,162 @@
+#include "wire_writer.hpp"
+#include <generic/try.hpp>
+#include <algorithm>
+#include <sys/uio.h>
+
+torr::wire_writer::wire_writer() {}
+torr::wire_writer::~wire_writer() {}
+
+void torr::wire_writer::queue(std::span<const std::byte> bytes)
+{
+    if (bytes.empty())
+        return;
+
+    size_t offset = m_buffer.size();
+    m_buffer.insert(m_buffer.end(), bytes.begin(), bytes.end());
+    m_queued += bytes.size();
+
+    /* consecutive copies extend the last segment */
+    if (!m_segments.empty()) {
+        segment& last = m_segments.back();
+        if (!last.external && !last.file && last.offset + last.length == offset) {
+            last.length += bytes.size();
+            return;
+        }
+    }
+    m_segments.push_back({ nullptr, nullptr, offset, bytes.size() });
+}
+
+void torr::wire_writer::queue_external(std::span<const std::byte> bytes)
+{
+    if (bytes.empty())
+        return;
+    m_segments.push_back({ bytes.data(), nullptr, 0, bytes.size() });
+    m_queued += bytes.size();
+}
+
+void torr::wire_writer::queue_file(const std::shared_ptr<file_descriptor>& file,
+    off_t offset, size_t length)
+{
+    if (!length)
+        return;
+    m_segments.push_back({ nullptr, file, (size_t)offset, length });
+    m_queued += length;
+}
+
+void torr::wire_writer::drop_sent(size_t length)
+{
+    m_queued -= length;
+    auto it = m_segments.begin();
+    for (; it != m_segments.end() && length >= it->length; ++it)
+        length -= it->length;
+    if (it != m_segments.end()) {
+        if (it->external) it->external += length;
+        else it->offset += length;
+        it->length -= length;
+    }
+    m_segments.erase(m_segments.begin(), it);
+
+    if (m_segments.empty())
+        clear();
+    else
+        compact();
+}
+
+void torr::wire_writer::compact()
+{
+    /* copies are queued in order, the first one left marks the sent prefix */
+    auto first = std::find_if(m_segments.begin(), m_segments.end(),
+        [](const segment& s) { return !s.external && !s.file; });
+    size_t sent = first == m_segments.end() ? m_buffer.size() : first->offset;
+    if (sent < WIRE_WRITER_COMPACT_THRESHOLD || sent * 2 < m_buffer.size())
+        return;
+
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + sent);
+    for (; first != m_segments.end(); ++first)
+        if (!first->external && !first->file)
+            first->offset -= sent;
+}
+
+std::expected<size_t, const char*> torr::wire_writer::flush(const tcp& socket)
+{
+    size_t sent = 0;
+    bool corked = false;
+
+    while (!m_segments.empty()) {
+        std::expected<size_t, const char*> result;
+
+        if (m_segments.front().file) {
+            const segment& s = m_segments.front();
+            result = socket.send_file(s.file->get(), s.offset, s.length);
+        } else {
+            /* memory segments up to the next file range go in one call */
+            struct iovec vectors[WIRE_WRITER_MAX_VECTORS];
+            size_t count = 0;
+            for (; count < m_segments.size() && count < WIRE_WRITER_MAX_VECTORS; ++count) {
+                const segment& s = m_segments[count];
+                if (s.file) break;
+                const std::byte* base = s.external ? s.external : m_buffer.data() + s.offset;
+                vectors[count] = { (void*)base, s.length };
+            }
+            result = socket.send_vectored(vectors, count);
+        }
+
+        if (!result.has_value()) {
+            if (corked) socket.set_cork(false);
+            return std::unexpected(result.error());
+        }
+
+        /* socket buffer is full, the rest stays queued */
+        if (!result.value())
+            break;
+
+        sent += result.value();
+        drop_sent(result.value());
+
+        if (!corked && !m_segments.empty()) {
+            socket.set_cork(true);
+            corked = true;
+        }
+    }
+
+    if (corked)
+        socket.set_cork(false);
+    return sent;
+}
+
+size_t torr::wire_writer::drain(std::vector<std::byte>& out)
+{
+    size_t drained = 0;
+    for (const segment& s : m_segments) {
+        if (s.file) break;
+        const std::byte* base = s.external ? s.external : m_buffer.data() + s.offset;
+        out.insert(out.end(), base, base + s.length);
+        drained += s.length;
+    }
+
+    if (drained)
+        drop_sent(drained);
+    return drained;
+}
+
+size_t torr::wire_writer::queued() const
+{
+    return m_queued;
+}
+
+size_t torr::wire_writer::buffered() const
+{
+    return m_buffer.size();
+}
+
+bool torr::wire_writer::empty() const
+{
+    return m_segments.empty();
+}
+
+void torr::wire_writer::clear()
+{
+    m_buffer.clear();
+    m_segments.clear();
+    m_queued = 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <generic/file_descriptor.hpp>
+#include <network/socket/tcp.hpp>
+#include <sys/types.h>
+#include <expected>
+#include <memory>
+#include <cstdint>
+#include <vector>
+#include <span>
+
+#define WIRE_WRITER_MAX_VECTORS 64
+/* sent bytes at the front of the copy buffer are dropped once there
+ * are this many and they are at least half of it */
+#define WIRE_WRITER_COMPACT_THRESHOLD 65536
+
+namespace torr {
+
+/* Per connection outgoing queue, messages are gathered during an
+ * event loop turn and flush() hands all of them to the socket in one
+ * sendmsg(). Small messages are copied into one buffer, so a burst of
+ * requests becomes a single segment, large payloads are referenced.
+ * File ranges are sent with sendfile() and never enter user space. */
+class wire_writer {
+private:
+    struct segment {
+        /* nullptr if the bytes live in m_buffer at offset */
+        const std::byte* external {};
+        /* set if the bytes are a range of the file at offset */
+        std::shared_ptr<file_descriptor> file {};
+        size_t offset {};
+        size_t length {};
+    };
+
+    std::vector<std::byte> m_buffer;
+    std::vector<segment> m_segments;
+    size_t m_queued {};
+
+    void drop_sent(size_t length);
+    void compact();
+
+public:
+    wire_writer();
+    ~wire_writer();
+
+    /* copies the bytes into the queue */
+    void queue(std::span<const std::byte> bytes);
+    /* references the bytes, they must stay valid until flushed */
+    void queue_external(std::span<const std::byte> bytes);
+    /* queues length bytes of the file at offset, the file stays open
+     * until they are sent */
+    void queue_file(const std::shared_ptr<file_descriptor>& file, off_t offset, size_t length);
+
+    template <typename T>
+    void queue_value(const T& value)
+    {
+        queue({ (const std::byte*)&value, sizeof(value) });
+    }
+
+    /* sends as much as the socket takes, a burst that needs more than
+     * one sendmsg() is corked so it leaves in full sized segments */
+    std::expected<size_t, const char*> flush(const tcp& socket);
+
+    /* moves the queued bytes up to the first file range into out,
+     * for sends that complete later, ex. through an io_ring */
+    size_t drain(std::vector<std::byte>& out);
+
+    size_t queued() const;
+    /* bytes held by the copy buffer, sent ones until compacted */
+    size_t buffered() const;
+    bool empty() const;
+    void clear();
+};
+
+}
@@ -1,4 +1,5 @@
 #include "http.hpp"
+#include <generic/try.hpp>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <format>
@@ -62,30 +63,32 @@ std::expected<int, const char*> torr::http::connect()
     return m_tcp.socket_file_descriptor();
 }
 
-std::expected<std::span<std::byte>, const char*>
-    torr::http::get_request()
+size_t torr::http::transport_send(uint8_t* buffer, size_t size)
+{
+    if (m_port == 443) {
+        int error = SSL_write(m_ssl_connection, buffer, size);
+        error = (error < 0) ? 0 : error;
+        return (size_t)error;
+    }
+    return m_tcp.send(buffer, size).value_or(0);
+}
+
+size_t torr::http::transport_receive(uint8_t* buffer, size_t size)
+{
+    if (m_port == 443) {
+        int error = SSL_read(m_ssl_connection, buffer, size);
+        error = (error < 0) ? 0 : error;
+        return (size_t)error;
+    }
+    return m_tcp.receive(buffer, size).value_or(0);
+}
+
+std::expected<size_t, const char*>
+    torr::http::get_request(const std::function<bool(std::span<std::byte>)>& on_body)
 {
     if (!m_is_connected)
         return std::unexpected("http request: not connected to any socket");
 
-    auto tcp_write = [&](uint8_t* buffer, size_t size) {
-        if (m_port == 443) {
-            int error = SSL_write(m_ssl_connection, buffer, size);
-            error = (error < 0) ? 0 : error;
-            return (size_t)error;
-        }
-        return m_tcp.send(buffer, size).value();
-    };
-
-    auto tcp_receive = [&](uint8_t* buffer, size_t size) {
-        if (m_port == 443) {
-            int error = SSL_read(m_ssl_connection, buffer, size);
-            error = (error < 0) ? 0 : error;
-            return (size_t)error;
-        }
-        return m_tcp.receive(buffer, size).value();
-    };
-
     std::string request = std::format(
         "GET {}{} HTTP/1.1\r\nHost: {}\r\nConnection: close\r\n\r\n",
         m_url.path(),
@@ -93,32 +96,47 @@ std::expected<std::span<std::byte>, const char*>
         m_url.host()
     );
 
-    auto send_size = tcp_write((uint8_t*)request.data(), request.size());
+    auto send_size = transport_send((uint8_t*)request.data(), request.size());
     if (!send_size)
         return std::unexpected("http get request: could not send() to tcp socket");
 
-    m_data.resize(1024);
-    size_t read_offset = 0;
-    while (int size = tcp_receive((uint8_t*)m_data.data() + read_offset, 1024)) {
-        if (size <= 0) break;
-        read_offset += size;
-        m_data.resize(m_data.size() + size);
-    }
-
+    /* the header ends at the first empty line, the state is
+     * kept across receives since it may be split between them */
+    std::byte buffer[16384];
     uint32_t header_end = 2;
-    for (size_t i = 0; i < m_data.size(); ++i) {
-        if ((char)m_data.at(i) == '\n')
-            header_end--;
-        else if ((char)m_data.at(i) != '\r')
-            header_end = 2;
-
-        if (!header_end) {
-            m_data.erase(m_data.begin(), m_data.begin() + i);
-            if (!m_data.empty()) m_data.erase(m_data.begin());
-            break;
+    bool in_body = false;
+    size_t body_size = 0;
+
+    while (size_t size = transport_receive((uint8_t*)buffer, sizeof(buffer))) {
+        size_t body_offset = 0;
+        for (; !in_body && body_offset < size; ++body_offset) {
+            if ((char)buffer[body_offset] == '\n')
+                header_end--;
+            else if ((char)buffer[body_offset] != '\r')
+                header_end = 2;
+            if (!header_end)
+                in_body = true;
         }
+
+        if (!in_body || body_offset >= size)
+            continue;
+
+        body_size += size - body_offset;
+        if (!on_body({ buffer + body_offset, size - body_offset }))
+            break;
     }
 
+    return body_size;
+}
+
+std::expected<std::span<std::byte>, const char*>
+    torr::http::get_request()
+{
+    m_data.clear();
+    TRY(get_request([&](std::span<std::byte> body) {
+        m_data.insert(m_data.end(), body.begin(), body.end());
+        return true;
+    }));
     return m_data;
 }
 
@@ -3,6 +3,7 @@
 #include "tcp.hpp"
 #include <openssl/ssl.h>
 #include <uri/url.hpp>
+#include <functional>
 #include <expected>
 #include <vector>
 #include <span>
@@ -20,6 +21,9 @@ private:
     SSL_CTX* m_ssl_ctx {};
     SSL* m_ssl_connection {};
 
+    size_t transport_send(uint8_t* buffer, size_t size);
+    size_t transport_receive(uint8_t* buffer, size_t size);
+
 public:
     http();
     ~http();
@@ -30,6 +34,11 @@ public:
     std::expected<int, const char*> connect();
     std::expected<std::span<std::byte>, const char*>
         get_request();
+
+    /* streams the response body to on_body as it arrives,
+     * returning false from on_body stops receiving */
+    std::expected<size_t, const char*>
+        get_request(const std::function<bool(std::span<std::byte>)>& on_body);
 };
 
 };
@@ -0,0 +1,318 @@
+#include "io_ring.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void* arguments, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arguments, count);
+}
+
+torr::io_ring::io_ring() {}
+
+torr::io_ring::~io_ring()
+{
+    close();
+}
+
+void torr::io_ring::close()
+{
+    if (m_submissions)
+        munmap(m_submissions, m_submissions_size);
+    if (m_completion_ring && m_completion_ring != m_submission_ring)
+        munmap(m_completion_ring, m_completion_ring_size);
+    if (m_submission_ring)
+        munmap(m_submission_ring, m_submission_ring_size);
+    if (m_ring_fd >= 0)
+        ::close(m_ring_fd);
+
+    m_submissions = nullptr;
+    m_completion_ring = nullptr;
+    m_submission_ring = nullptr;
+    m_ring_fd = -1;
+    m_buffers_registered = false;
+}
+
+bool torr::io_ring::available()
+{
+    struct io_uring_params params {};
+    int fd = io_uring_setup(2, &params);
+    if (fd < 0)
+        return false;
+    ::close(fd);
+    return true;
+}
+
+std::expected<bool, const char*> torr::io_ring::open(unsigned entries)
+{
+    close();
+
+    struct io_uring_params params {};
+    m_ring_fd = io_uring_setup(entries, &params);
+    if (m_ring_fd < 0)
+        return std::unexpected("io ring: io_uring_setup() failed");
+
+    m_entries = params.sq_entries;
+    m_submission_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_completion_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        m_submission_ring_size = std::max(m_submission_ring_size, m_completion_ring_size);
+        m_completion_ring_size = m_submission_ring_size;
+    }
+
+    void* submission_ring = mmap(nullptr, m_submission_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (submission_ring == MAP_FAILED) {
+        close();
+        return std::unexpected("io ring: mmap() of the submission ring failed");
+    }
+    m_submission_ring = submission_ring;
+
+    if (single_mmap) {
+        m_completion_ring = m_submission_ring;
+    } else {
+        void* completion_ring = mmap(nullptr, m_completion_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (completion_ring == MAP_FAILED) {
+            close();
+            return std::unexpected("io ring: mmap() of the completion ring failed");
+        }
+        m_completion_ring = completion_ring;
+    }
+
+    m_submissions_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* submissions = mmap(nullptr, m_submissions_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (submissions == MAP_FAILED) {
+        close();
+        return std::unexpected("io ring: mmap() of the submission entries failed");
+    }
+    m_submissions = (struct io_uring_sqe*)submissions;
+
+    auto* sq = (uint8_t*)m_submission_ring;
+    m_submission_head = (unsigned*)(sq + params.sq_off.head);
+    m_submission_tail = (unsigned*)(sq + params.sq_off.tail);
+    m_submission_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    m_submission_array = (unsigned*)(sq + params.sq_off.array);
+    m_submission_local_tail = *m_submission_tail;
+    m_submission_pending = 0;
+
+    auto* cq = (uint8_t*)m_completion_ring;
+    m_completion_head = (unsigned*)(cq + params.cq_off.head);
+    m_completion_tail = (unsigned*)(cq + params.cq_off.tail);
+    m_completion_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    m_completions = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool torr::io_ring::is_open() const
+{
+    return m_ring_fd >= 0;
+}
+
+std::expected<bool, const char*>
+    torr::io_ring::register_buffers(std::span<const struct iovec> buffers)
+{
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_BUFFERS,
+        buffers.data(), buffers.size()) < 0)
+        return std::unexpected("io ring: registering buffers failed");
+    m_buffers_registered = true;
+    return true;
+}
+
+bool torr::io_ring::buffers_registered() const
+{
+    return m_buffers_registered;
+}
+
+struct io_uring_sqe* torr::io_ring::next_submission()
+{
+    unsigned head = __atomic_load_n(m_submission_head, __ATOMIC_ACQUIRE);
+    if (m_submission_local_tail - head >= m_entries) {
+        /* full, hand what is queued to the kernel to make room */
+        if (!submit(0).has_value())
+            return nullptr;
+        head = __atomic_load_n(m_submission_head, __ATOMIC_ACQUIRE);
+        if (m_submission_local_tail - head >= m_entries)
+            return nullptr;
+    }
+
+    unsigned index = m_submission_local_tail & *m_submission_mask;
+    struct io_uring_sqe* submission = &m_submissions[index];
+    memset(submission, 0, sizeof(*submission));
+    m_submission_array[index] = index;
+    m_submission_local_tail++;
+    m_submission_pending++;
+    return submission;
+}
+
+bool torr::io_ring::receive(int fd, std::span<std::byte> buffer, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_RECV;
+    submission->fd = fd;
+    submission->addr = (uint64_t)buffer.data();
+    submission->len = buffer.size();
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::receive_fixed(int fd, std::span<std::byte> buffer,
+    uint16_t buffer_index, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_READ_FIXED;
+    submission->fd = fd;
+    submission->addr = (uint64_t)buffer.data();
+    submission->len = buffer.size();
+    /* sockets have no position, -1 reads at the current one */
+    submission->off = (uint64_t)-1;
+    submission->buf_index = buffer_index;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::send(int fd, std::span<const std::byte> buffer, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_SEND;
+    submission->fd = fd;
+    submission->addr = (uint64_t)buffer.data();
+    submission->len = buffer.size();
+    submission->msg_flags = MSG_NOSIGNAL;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::send_vectored(int fd, const struct msghdr* message, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_SENDMSG;
+    submission->fd = fd;
+    submission->addr = (uint64_t)message;
+    submission->len = 1;
+    submission->msg_flags = MSG_NOSIGNAL;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::write(int fd, std::span<const std::byte> buffer,
+    uint64_t offset, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_WRITE;
+    submission->fd = fd;
+    submission->addr = (uint64_t)buffer.data();
+    submission->len = buffer.size();
+    submission->off = offset;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::poll(int fd, uint32_t events, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_POLL_ADD;
+    submission->fd = fd;
+    submission->poll32_events = events;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::timeout(const struct __kernel_timespec* timeout, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_TIMEOUT;
+    submission->fd = -1;
+    submission->addr = (uint64_t)timeout;
+    submission->len = 1;
+    submission->off = 1;
+    submission->user_data = user_data;
+    return true;
+}
+
+bool torr::io_ring::cancel(uint64_t target_user_data, uint64_t user_data)
+{
+    struct io_uring_sqe* submission = next_submission();
+    if (!submission)
+        return false;
+    submission->opcode = IORING_OP_ASYNC_CANCEL;
+    submission->fd = -1;
+    submission->addr = target_user_data;
+    submission->user_data = user_data;
+    return true;
+}
+
+std::expected<size_t, const char*> torr::io_ring::submit(unsigned wait_for)
+{
+    unsigned to_submit = m_submission_pending;
+    __atomic_store_n(m_submission_tail, m_submission_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_for ? IORING_ENTER_GETEVENTS : 0;
+    if (!to_submit && !wait_for)
+        return 0;
+
+    int submitted;
+    do {
+        submitted = io_uring_enter(m_ring_fd, to_submit, wait_for, flags);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted < 0) {
+        if (errno == EAGAIN || errno == EBUSY)
+            return 0;
+        return std::unexpected("io ring: io_uring_enter() failed");
+    }
+
+    m_submission_pending -= std::min<unsigned>(submitted, m_submission_pending);
+    return submitted;
+}
+
+size_t torr::io_ring::reap(std::span<completion> out)
+{
+    unsigned head = *m_completion_head;
+    unsigned tail = __atomic_load_n(m_completion_tail, __ATOMIC_ACQUIRE);
+
+    size_t count = 0;
+    for (; head != tail && count < out.size(); ++head, ++count) {
+        const struct io_uring_cqe& entry = m_completions[head & *m_completion_mask];
+        out[count] = { entry.user_data, entry.res };
+    }
+
+    __atomic_store_n(m_completion_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+unsigned torr::io_ring::pending() const
+{
+    return m_submission_pending;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <expected>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+#define IO_RING_ENTRIES 1024
+
+namespace torr {
+
+/* Minimal io_uring, set up with the raw syscalls so there is no
+ * liburing dependency. Operations mirror what tcp does synchronously,
+ * they are queued as submissions and leave in one io_uring_enter()
+ * together with the wait for completions. Every submission carries
+ * user data that comes back in its completion. */
+class io_ring {
+public:
+    struct completion {
+        uint64_t user_data {};
+        /* bytes transferred, or a negative errno */
+        int32_t result {};
+    };
+
+private:
+    int m_ring_fd { -1 };
+    unsigned m_entries {};
+
+    void* m_submission_ring {};
+    size_t m_submission_ring_size {};
+    void* m_completion_ring {};
+    size_t m_completion_ring_size {};
+    struct io_uring_sqe* m_submissions {};
+    size_t m_submissions_size {};
+
+    unsigned* m_submission_head {};
+    unsigned* m_submission_tail {};
+    unsigned* m_submission_mask {};
+    unsigned* m_submission_array {};
+    unsigned m_submission_local_tail {};
+    unsigned m_submission_pending {};
+
+    unsigned* m_completion_head {};
+    unsigned* m_completion_tail {};
+    unsigned* m_completion_mask {};
+    struct io_uring_cqe* m_completions {};
+
+    bool m_buffers_registered { false };
+
+    struct io_uring_sqe* next_submission();
+    void close();
+
+public:
+    io_ring();
+    ~io_ring();
+
+    io_ring(const io_ring&) = delete;
+    io_ring& operator=(const io_ring&) = delete;
+
+    /* false if the kernel has no io_uring or it is disabled */
+    static bool available();
+    std::expected<bool, const char*> open(unsigned entries = IO_RING_ENTRIES);
+    bool is_open() const;
+
+    /* pins the buffers so receive_fixed() skips the per call page
+     * mapping, fails if they exceed RLIMIT_MEMLOCK */
+    std::expected<bool, const char*> register_buffers(std::span<const struct iovec> buffers);
+    bool buffers_registered() const;
+
+    bool receive(int fd, std::span<std::byte> buffer, uint64_t user_data);
+    bool receive_fixed(int fd, std::span<std::byte> buffer,
+        uint16_t buffer_index, uint64_t user_data);
+    bool send(int fd, std::span<const std::byte> buffer, uint64_t user_data);
+    bool send_vectored(int fd, const struct msghdr* message, uint64_t user_data);
+    bool write(int fd, std::span<const std::byte> buffer, uint64_t offset, uint64_t user_data);
+    bool poll(int fd, uint32_t events, uint64_t user_data);
+    /* completes after timeout, or as soon as another request completes */
+    bool timeout(const struct __kernel_timespec* timeout, uint64_t user_data);
+    bool cancel(uint64_t target_user_data, uint64_t user_data);
+
+    /* submits everything queued and waits for at least wait_for completions */
+    std::expected<size_t, const char*> submit(unsigned wait_for = 0);
+    /* moves finished completions into out, returns how many */
+    size_t reap(std::span<completion> out);
+
+    unsigned pending() const;
+};
+
+}
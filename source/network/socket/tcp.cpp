@@ -1,9 +1,14 @@
 #include "tcp.hpp"
 #include "cassync.h"
+#include <algorithm>
 #include <cstring>
+#include <thread>
 #include <unistd.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <signal.h>
@@ -20,6 +25,57 @@ torr::tcp::~tcp()
         close(m_socket_fd);
 }
 
+/* the first vectors holding up to limit bytes, returns their count */
+static size_t limit_vectors(const struct iovec* vectors, size_t count,
+    size_t limit, struct iovec* out)
+{
+    size_t limited = 0;
+    for (; limited < count && limited < TCP_MAX_LIMITED_VECTORS && limit; ++limited) {
+        out[limited] = vectors[limited];
+        out[limited].iov_len = std::min(out[limited].iov_len, limit);
+        limit -= out[limited].iov_len;
+    }
+    return limited;
+}
+
+static size_t vectors_length(const struct iovec* vectors, size_t count)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i)
+        length += vectors[i].iov_len;
+    return length;
+}
+
+void torr::tcp::set_rate_limits(token_bucket* receive, token_bucket* send)
+{
+    m_receive_limit = receive;
+    m_send_limit = send;
+}
+
+bool torr::tcp::receive_throttled() const
+{
+    return m_receive_throttled;
+}
+
+bool torr::tcp::send_throttled() const
+{
+    return m_send_throttled;
+}
+
+size_t torr::tcp::acquire(token_bucket* limit, size_t length) const
+{
+    if (!limit || !length)
+        return length;
+
+    for (;;) {
+        size_t granted = limit->request(length);
+        if (granted || !m_blocking)
+            return granted;
+        /* nothing else to do on a blocking socket until the next refill */
+        std::this_thread::sleep_for(TOKEN_BUCKET_REFILL_INTERVAL);
+    }
+}
+
 std::expected<int, const char*>
     torr::tcp::connect(const std::string& ip_address, const size_t& port)
 {
@@ -38,6 +94,7 @@ std::expected<int, const char*>
     m_socket_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (m_socket_fd < 0)
         return std::unexpected("tcp connect: socket() failed");
+    m_blocking = true;
 
     memset(&m_sockaddr_connect_to, 0, sizeof(m_sockaddr_connect_to));
     m_sockaddr_connect_to.sin_family = AF_INET;
@@ -47,6 +104,39 @@ std::expected<int, const char*>
     return m_socket_fd;
 }
 
+std::expected<int, const char*>
+    torr::tcp::connect_non_blocking(const struct in_addr& ip_address, const size_t& port)
+{
+    if (m_socket_fd >= 0)
+        close(m_socket_fd);
+
+    m_socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_socket_fd < 0)
+        return std::unexpected("tcp connect: socket() failed");
+    m_blocking = false;
+
+    memset(&m_sockaddr_connect_to, 0, sizeof(m_sockaddr_connect_to));
+    m_sockaddr_connect_to.sin_family = AF_INET;
+    m_sockaddr_connect_to.sin_addr.s_addr = ip_address.s_addr;
+    m_sockaddr_connect_to.sin_port = htons(port);
+
+    if (::connect(m_socket_fd, (struct sockaddr*)&m_sockaddr_connect_to,
+        sizeof(m_sockaddr_connect_to)) < 0 && errno != EINPROGRESS)
+        return std::unexpected("tcp connect: connect() failed");
+    return m_socket_fd;
+}
+
+std::expected<bool, const char*> torr::tcp::connect_result() const
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(m_socket_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+        return std::unexpected("tcp connect: getsockopt() failed");
+    if (error)
+        return std::unexpected("tcp connect: connection failed");
+    return true;
+}
+
 std::expected<size_t, const char*>
     torr::tcp::send(const uint8_t* buffer, size_t length, int flags) const
 {
@@ -62,6 +152,61 @@ std::expected<size_t, const char*>
     return sendto_result;
 }
 
+std::expected<size_t, const char*>
+    torr::tcp::send_vectored(const struct iovec* vectors, size_t count) const
+{
+    size_t length = vectors_length(vectors, count);
+    size_t granted = acquire(m_send_limit, length);
+    m_send_throttled = granted < length;
+    if (!granted)
+        return 0;
+
+    struct iovec limited[TCP_MAX_LIMITED_VECTORS];
+    struct msghdr message {};
+    message.msg_iov = (struct iovec*)vectors;
+    message.msg_iovlen = count;
+    if (granted < length) {
+        message.msg_iov = limited;
+        message.msg_iovlen = limit_vectors(vectors, count, granted, limited);
+    }
+
+    ssize_t sendmsg_result = sendmsg(m_socket_fd, &message, MSG_NOSIGNAL);
+    if (m_send_limit)
+        m_send_limit->refund(granted - std::max<ssize_t>(sendmsg_result, 0));
+    if (sendmsg_result < (ssize_t)granted)
+        m_send_throttled = false;
+    if (sendmsg_result < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return std::unexpected("tcp send: sendmsg() failed");
+    }
+    return sendmsg_result;
+}
+
+std::expected<size_t, const char*>
+    torr::tcp::send_file(int file_descriptor, size_t offset, size_t length) const
+{
+    size_t granted = acquire(m_send_limit, length);
+    m_send_throttled = granted < length;
+    if (!granted)
+        return 0;
+
+    off_t file_offset = offset;
+    ssize_t sendfile_result = sendfile(m_socket_fd, file_descriptor, &file_offset, granted);
+    if (m_send_limit)
+        m_send_limit->refund(granted - std::max<ssize_t>(sendfile_result, 0));
+    if (sendfile_result < (ssize_t)granted)
+        m_send_throttled = false;
+    if (sendfile_result < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return std::unexpected("tcp send: sendfile() failed");
+    }
+    if (sendfile_result == 0)
+        return std::unexpected("tcp send: sendfile() reached end of file");
+    return sendfile_result;
+}
+
 std::expected<size_t, const char*>
     torr::tcp::receive(uint8_t* buffer, size_t length, int flags) const
 {
@@ -78,6 +223,37 @@ std::expected<size_t, const char*>
     return recvfrom_result;
 }
 
+std::expected<size_t, const char*>
+    torr::tcp::receive_vectored(const struct iovec* vectors, size_t count) const
+{
+    size_t length = vectors_length(vectors, count);
+    size_t granted = acquire(m_receive_limit, length);
+    m_receive_throttled = granted < length;
+    if (!granted)
+        return 0;
+
+    struct iovec limited[TCP_MAX_LIMITED_VECTORS];
+    if (granted < length) {
+        count = limit_vectors(vectors, count, granted, limited);
+        vectors = limited;
+    }
+
+    /* a short read means the socket is drained, not throttled */
+    ssize_t readv_result = readv(m_socket_fd, vectors, count);
+    if (m_receive_limit)
+        m_receive_limit->refund(granted - std::max<ssize_t>(readv_result, 0));
+    if (readv_result < (ssize_t)granted)
+        m_receive_throttled = false;
+    if (readv_result < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return std::unexpected("tcp receive: readv() failed");
+    }
+    if (readv_result == 0)
+        return std::unexpected("tcp receive: connection closed");
+    return readv_result;
+}
+
 bool torr::tcp::set_send_timeout(size_t micro_seconds) const
 {
     struct timeval timeout;      
@@ -88,3 +264,43 @@ bool torr::tcp::set_send_timeout(size_t micro_seconds) const
         return false;
     return true;
 }
+
+bool torr::tcp::set_receive_timeout(size_t micro_seconds) const
+{
+    struct timeval timeout;
+    timeout.tv_sec = micro_seconds / 1000000;
+    timeout.tv_usec = micro_seconds % 1000000;
+
+    if (setsockopt(m_socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+        return false;
+    return true;
+}
+
+void torr::tcp::adopt(int socket_fd)
+{
+    if (m_socket_fd >= 0)
+        close(m_socket_fd);
+    m_socket_fd = socket_fd;
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    m_blocking = flags < 0 || !(flags & O_NONBLOCK);
+}
+
+bool torr::tcp::set_blocking(bool blocking) const
+{
+    int flags = fcntl(m_socket_fd, F_GETFL, 0);
+    if (flags < 0)
+        return false;
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    if (fcntl(m_socket_fd, F_SETFL, flags) < 0)
+        return false;
+    m_blocking = blocking;
+    return true;
+}
+
+bool torr::tcp::set_cork(bool cork) const
+{
+    int value = cork;
+    if (setsockopt(m_socket_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) < 0)
+        return false;
+    return true;
+}
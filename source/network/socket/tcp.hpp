@@ -1,8 +1,12 @@
 #pragma once
 
+#include <network/socket/token_bucket.hpp>
 #include <expected>
 #include <string>
 #include <netinet/in.h>
+#include <sys/uio.h>
+
+#define TCP_MAX_LIMITED_VECTORS 64
 
 namespace torr {
 
@@ -10,6 +14,14 @@ class tcp {
 private:
     struct sockaddr_in m_sockaddr_connect_to {};
     int m_socket_fd { -1 };
+    token_bucket* m_receive_limit {};
+    token_bucket* m_send_limit {};
+    mutable bool m_blocking { true };
+    mutable bool m_receive_throttled {};
+    mutable bool m_send_throttled {};
+
+    /* tokens for length bytes, a blocking socket waits for them */
+    size_t acquire(token_bucket* limit, size_t length) const;
 
 public:
     tcp();
@@ -19,13 +31,42 @@ public:
         connect(const std::string& ip_address, const size_t& port);
     std::expected<int, const char*>
         connect(const struct in_addr& ip_address, const size_t& port);
+    /* starts connecting a non-blocking socket, the socket turns
+     * writable once connect_result() can tell the outcome */
+    std::expected<int, const char*>
+        connect_non_blocking(const struct in_addr& ip_address, const size_t& port);
+    std::expected<bool, const char*> connect_result() const;
+    /* takes ownership of a connected socket, ex. an accepted one
+     * or one end of socketpair(), keeping its blocking mode */
+    void adopt(int socket_fd);
 
     std::expected<size_t, const char*>
         send(const uint8_t* buffer, size_t length, int flags = 0) const;
+    /* 0 if the socket would block */
+    std::expected<size_t, const char*>
+        send_vectored(const struct iovec* vectors, size_t count) const;
+    /* sends length bytes of the file at offset without copying them
+     * through user space, 0 if the socket would block */
+    std::expected<size_t, const char*>
+        send_file(int file_descriptor, size_t offset, size_t length) const;
     std::expected<size_t, const char*>
         receive(uint8_t* buffer, size_t length, int flags = 0) const;
+    /* 0 if the socket would block, an error once the peer closed */
+    std::expected<size_t, const char*>
+        receive_vectored(const struct iovec* vectors, size_t count) const;
+
+    /* limits the vectored and file transfers, a non-blocking socket
+     * transfers what the buckets grant and reports it as throttled,
+     * its owner calls again once the buckets refilled */
+    void set_rate_limits(token_bucket* receive, token_bucket* send);
+    bool receive_throttled() const;
+    bool send_throttled() const;
 
     bool set_send_timeout(size_t micro_seconds) const;
+    /* a blocking receive that times out returns 0 bytes */
+    bool set_receive_timeout(size_t micro_seconds) const;
+    bool set_cork(bool cork) const;
+    bool set_blocking(bool blocking) const;
     int socket_file_descriptor() const { return m_socket_fd; }
 };
 
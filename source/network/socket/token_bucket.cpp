@@ -0,0 +1,121 @@
+#include "token_bucket.hpp"
+#include <algorithm>
+
+torr::token_bucket::token_bucket() {}
+
+torr::token_bucket::~token_bucket()
+{
+    set_parent(nullptr);
+}
+
+void torr::token_bucket::set_parent(token_bucket* parent)
+{
+    if (m_parent)
+        m_parent->m_children--;
+    m_parent = parent;
+    if (m_parent)
+        m_parent->m_children++;
+}
+
+void torr::token_bucket::set_rate(size_t bytes_per_second, size_t burst)
+{
+    /* a newly limited bucket starts with a full burst */
+    bool was_limited = m_rate;
+    m_rate = bytes_per_second;
+    m_burst = burst ? burst : bytes_per_second;
+    m_tokens = was_limited ? std::min(m_tokens, m_burst) : m_burst;
+    m_refilled = clock::now();
+}
+
+void torr::token_bucket::refill(clock::time_point now)
+{
+    auto elapsed = now - m_refilled;
+    if (elapsed < TOKEN_BUCKET_REFILL_INTERVAL)
+        return;
+
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    uint64_t added = (uint64_t)m_rate * microseconds / 1000000;
+    /* a full bucket does not save up time */
+    if (m_tokens + added >= m_burst) {
+        m_tokens = m_burst;
+        m_refilled = now;
+        return;
+    }
+
+    /* only the time the added tokens stand for is used up, the rest
+     * carries over, so a rate under a token per interval still refills */
+    m_tokens += added;
+    m_refilled += std::chrono::microseconds(added * 1000000 / m_rate);
+}
+
+size_t torr::token_bucket::take(size_t bytes, bool share, clock::time_point now)
+{
+    size_t grant = bytes;
+    if (m_rate) {
+        refill(now);
+        size_t available = m_tokens;
+        if (share && m_children > 1)
+            available = std::min(available,
+                std::max<size_t>(m_tokens / m_children, TOKEN_BUCKET_MIN_SHARE));
+        grant = std::min(grant, available);
+    }
+
+    if (m_parent && grant)
+        grant = m_parent->take(grant, true, now);
+    if (m_rate)
+        m_tokens -= grant;
+    return grant;
+}
+
+size_t torr::token_bucket::request(size_t bytes, clock::time_point now)
+{
+    size_t granted = take(bytes, false, now);
+    if (granted < bytes)
+        m_limited_at = now;
+    return granted;
+}
+
+void torr::token_bucket::refund(size_t bytes)
+{
+    for (token_bucket* bucket = this; bucket; bucket = bucket->m_parent)
+        if (bucket->m_rate)
+            bucket->m_tokens = std::min(bucket->m_tokens + bytes, bucket->m_burst);
+}
+
+bool torr::token_bucket::limited() const
+{
+    for (const token_bucket* bucket = this; bucket; bucket = bucket->m_parent)
+        if (bucket->m_rate)
+            return true;
+    return false;
+}
+
+torr::token_bucket* torr::token_bucket::parent() const
+{
+    return m_parent;
+}
+
+size_t torr::token_bucket::rate() const
+{
+    return m_rate;
+}
+
+size_t torr::token_bucket::burst() const
+{
+    return m_burst;
+}
+
+size_t torr::token_bucket::tokens() const
+{
+    return m_tokens;
+}
+
+size_t torr::token_bucket::children() const
+{
+    return m_children;
+}
+
+torr::token_bucket::clock::time_point torr::token_bucket::limited_at() const
+{
+    return m_limited_at;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/* tokens are added in batches, not on every request */
+#define TOKEN_BUCKET_REFILL_INTERVAL std::chrono::milliseconds(20)
+/* the smallest share a child is granted, about one block */
+#define TOKEN_BUCKET_MIN_SHARE 16384
+
+namespace torr {
+
+/* Byte rate limit, one token per byte. Buckets form a hierarchy, ex.
+ * global, torrent and peer, and a request is granted only what every
+ * bucket up to the root can give. A parent hands each request of a
+ * child at most an even share of its tokens, so one busy connection
+ * can not drain a bucket before the others get their turn. A bucket
+ * without a rate is unlimited and only passes requests up. */
+class token_bucket {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    token_bucket* m_parent {};
+    size_t m_children {};
+    size_t m_rate {};
+    size_t m_burst {};
+    size_t m_tokens {};
+    clock::time_point m_refilled {};
+    clock::time_point m_limited_at {};
+
+    void refill(clock::time_point now);
+    size_t take(size_t bytes, bool share, clock::time_point now);
+
+public:
+    token_bucket();
+    ~token_bucket();
+
+    token_bucket(const token_bucket&) = delete;
+    token_bucket& operator=(const token_bucket&) = delete;
+
+    /* the parent must outlive the bucket */
+    void set_parent(token_bucket* parent);
+    token_bucket* parent() const;
+    /* bytes per second, 0 removes the limit. The burst is what an idle
+     * bucket accumulates, one second worth of the rate by default */
+    void set_rate(size_t bytes_per_second, size_t burst = 0);
+
+    /* grants up to bytes, 0 if this bucket or an ancestor is empty */
+    size_t request(size_t bytes, clock::time_point now = clock::now());
+    /* gives back granted tokens that were not used, ex. on a short read */
+    void refund(size_t bytes);
+
+    /* this bucket or an ancestor has a rate */
+    bool limited() const;
+    size_t rate() const;
+    size_t burst() const;
+    size_t tokens() const;
+    size_t children() const;
+    /* the last request granted less than asked, ex. so waiting on the
+     * limit is not blamed on the remote */
+    clock::time_point limited_at() const;
+};
+
+}
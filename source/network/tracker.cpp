@@ -2,6 +2,7 @@
 #include "socket/udp.hpp"
 #include "socket/http.hpp"
 #include <generic/dynamic_bitset.hpp>
+#include <generic/bencode_decoder.hpp>
 #include <generic/try.hpp>
 #include <utility>
 #include <cassert>
@@ -228,29 +229,65 @@ std::expected<torr::tracker_response*, const char*>
     url += "&port=6881";
 
     http request;
-    bencode_map bencode;
-    TRY(request.from_string(url));
-    bencode.from_buffer(TRY(request.get_request()));
-
-    if (bencode["peers"].type() != bencode_map::target_type::strings)
-        return std::unexpected("http tracker announce: did not receive compact peer list response");
-    std::string peers_string = bencode["peers"].as_str();
-
-    udp_announce_ip_and_port peers[MAX_PEERS];
-    memset(&peers, 0, sizeof(peers));
-    memcpy(&peers, peers_string.c_str(), peers_string.size() < sizeof(peers)
-        ? peers_string.size() : sizeof(peers));
+    bencode_decoder decoder;
+    m_tracker_response.clear_peers();
 
-    for (size_t i = 0; i < MAX_PEERS; ++i) {
-        if (!peers[i].ip_address && !peers[i].tcp_port)
-            break;
+    /* compact peers are taken out of the body as it is received,
+     * a peer entry may be split across two body chunks */
+    udp_announce_ip_and_port partial_peer;
+    size_t partial_peer_size = 0;
+    bool has_compact_peers = false;
+    const char* failure_reason = nullptr;
+    size_t leechers = 0, seeders = 0;
+
+    decoder.set_handler([&](const bencode_decoder::event& e) {
+        if (e.depth != 1)
+            return;
+
+        if (e.type == bencode_decoder::event_type::integer) {
+            if (e.key == "interval") m_tracker_response.set_interval(e.integer);
+            if (e.key == "incomplete") leechers = e.integer;
+            if (e.key == "complete") seeders = e.integer;
+        }
+
+        if (e.type != bencode_decoder::event_type::string)
+            return;
+
+        if (e.key == "failure reason")
+            failure_reason = "http tracker announce: tracker responded with failure reason";
+        if (e.key != "peers")
+            return;
+
+        has_compact_peers = true;
+        for (const auto& byte : e.data) {
+            ((std::byte*)&partial_peer)[partial_peer_size++] = byte;
+            if (partial_peer_size < sizeof(partial_peer))
+                continue;
+            partial_peer_size = 0;
+
+            if (m_tracker_response.m_peer_addresses.size() >= MAX_PEERS)
+                continue;
+
+            struct in_addr ip_addr;
+            ip_addr.s_addr = ntohl(partial_peer.ip_address);
+            size_t port = partial_peer.tcp_port;
+            m_tracker_response.m_peer_addresses.push_back({ ip_addr, port });
+        }
+    });
 
-        struct in_addr ip_addr;
-        ip_addr.s_addr = ntohl(peers[i].ip_address);
-        size_t port = peers[i].tcp_port;
-        m_tracker_response.m_peer_addresses.push_back({ ip_addr, port });
-    }
+    TRY(request.from_string(url));
+    TRY(request.get_request([&](std::span<std::byte> body) {
+        return decoder.feed(body) == bencode_decoder::status::need_more_bytes;
+    }));
+
+    if (decoder.state() != bencode_decoder::status::complete)
+        return std::unexpected("http tracker announce: incomplete or malformed bencode response");
+    if (failure_reason)
+        return std::unexpected(failure_reason);
+    if (!has_compact_peers)
+        return std::unexpected("http tracker announce: did not receive compact peer list response");
 
+    m_tracker_response.set_leechers_seeders(leechers, seeders);
     return &m_tracker_response;
 }
 
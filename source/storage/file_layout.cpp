@@ -0,0 +1,73 @@
+#include "file_layout.hpp"
+#include <algorithm>
+
+void torr::file_layout::set_piece_length(uint64_t piece_length)
+{
+    m_piece_length = piece_length;
+}
+
+void torr::file_layout::add_file(const std::filesystem::path& path, uint64_t length)
+{
+    m_paths.push_back(path);
+    m_offsets.push_back(m_offsets.back() + length);
+}
+
+size_t torr::file_layout::file_count() const
+{
+    return m_paths.size();
+}
+
+uint64_t torr::file_layout::total_length() const
+{
+    return m_offsets.back();
+}
+
+uint64_t torr::file_layout::piece_length() const
+{
+    return m_piece_length;
+}
+
+uint64_t torr::file_layout::file_length(size_t file_index) const
+{
+    return m_offsets[file_index + 1] - m_offsets[file_index];
+}
+
+uint64_t torr::file_layout::file_offset(size_t file_index) const
+{
+    return m_offsets[file_index];
+}
+
+const std::filesystem::path& torr::file_layout::file_path(size_t file_index) const
+{
+    return m_paths[file_index];
+}
+
+size_t torr::file_layout::file_at(uint64_t torrent_offset) const
+{
+    /* last file starting at or before the offset, which skips
+     * over zero length files sharing the same start offset */
+    auto it = std::upper_bound(m_offsets.begin(), m_offsets.end() - 1, torrent_offset);
+    return (it - m_offsets.begin()) - 1;
+}
+
+size_t torr::file_layout::map_block(size_t piece_index, uint64_t offset, uint64_t length,
+    std::vector<file_slice>& out) const
+{
+    out.clear();
+    uint64_t begin = piece_index * m_piece_length + offset;
+    if (!length || offset + length > m_piece_length || begin + length > total_length())
+        return 0;
+
+    for (size_t file = file_at(begin); length; ++file) {
+        uint64_t file_end = m_offsets[file + 1];
+        if (file_end <= begin)
+            continue;
+
+        uint64_t slice_length = std::min(length, file_end - begin);
+        out.push_back({ file, begin - m_offsets[file], slice_length });
+        begin += slice_length;
+        length -= slice_length;
+    }
+
+    return out.size();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+#include <vector>
+
+namespace torr {
+
+struct file_slice {
+    size_t file_index {};
+    uint64_t file_offset {};
+    uint64_t length {};
+};
+
+/* Files of a torrent laid out back to back in one address space.
+ * The start offset of every file is kept in one sorted flat array,
+ * a block is mapped onto files with a binary search over it. */
+class file_layout {
+private:
+    std::vector<std::filesystem::path> m_paths;
+    /* m_offsets[i] is where file i starts, the last entry is the total length */
+    std::vector<uint64_t> m_offsets { 0 };
+    uint64_t m_piece_length {};
+
+public:
+    file_layout() {}
+    ~file_layout() {}
+
+    void set_piece_length(uint64_t piece_length);
+    void add_file(const std::filesystem::path& path, uint64_t length);
+
+    size_t file_count() const;
+    uint64_t total_length() const;
+    uint64_t piece_length() const;
+    uint64_t file_length(size_t file_index) const;
+    uint64_t file_offset(size_t file_index) const;
+    const std::filesystem::path& file_path(size_t file_index) const;
+
+    /* index of the file holding the torrent offset */
+    size_t file_at(uint64_t torrent_offset) const;
+
+    /* maps length bytes at offset within piece to file slices, out is
+     * cleared and reused so the hot path does not allocate, returns
+     * the number of slices or 0 if the block is outside the
+     * piece or the torrent */
+    size_t map_block(size_t piece_index, uint64_t offset, uint64_t length,
+        std::vector<file_slice>& out) const;
+};
+
+}
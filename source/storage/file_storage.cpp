@@ -0,0 +1,85 @@
+#include "file_storage.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <print>
+
+torr::file_storage::file_storage(std::filesystem::path root)
+    : m_root(std::move(root))
+{
+}
+
+torr::file_storage::~file_storage()
+{
+}
+
+void torr::file_storage::set_layout(const file_layout* layout)
+{
+    m_layout = layout;
+    m_files.assign(layout ? layout->file_count() : 0, nullptr);
+    m_writable.assign(m_files.size(), false);
+}
+
+bool torr::file_storage::ready() const
+{
+    return m_layout && m_layout->file_count();
+}
+
+const std::filesystem::path& torr::file_storage::root() const
+{
+    return m_root;
+}
+
+std::shared_ptr<file_descriptor> torr::file_storage::file(size_t file_index, bool writable)
+{
+    if (file_index >= m_files.size())
+        return nullptr;
+    if (m_files[file_index] && (m_writable[file_index] || !writable))
+        return m_files[file_index];
+
+    auto path = m_root / m_layout->file_path(file_index);
+    int flags = O_RDONLY | O_CLOEXEC;
+    if (writable) {
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+        flags = O_RDWR | O_CREAT | O_CLOEXEC;
+    }
+
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        std::println("could not open {}", path.string());
+        return nullptr;
+    }
+
+    /* connections serving from the read only one keep it alive */
+    m_files[file_index] = std::make_shared<file_descriptor>(fd);
+    m_writable[file_index] = writable;
+    return m_files[file_index];
+}
+
+std::span<const torr::file_slice> torr::file_storage::map_block(size_t piece_index,
+    uint64_t offset, uint64_t length)
+{
+    if (!m_layout)
+        return {};
+    m_layout->map_block(piece_index, offset, length, m_slices);
+    return m_slices;
+}
+
+bool torr::file_storage::write_piece(size_t piece_index, std::span<const std::byte> data)
+{
+    for (const auto& slice : map_block(piece_index, 0, data.size())) {
+        auto target = file(slice.file_index, true);
+        if (!target)
+            return false;
+
+        for (uint64_t written = 0; written < slice.length;) {
+            ssize_t result = pwrite(target->get(), data.data() + written,
+                slice.length - written, slice.file_offset + written);
+            if (result <= 0)
+                return false;
+            written += result;
+        }
+        data = data.subspan(slice.length);
+    }
+    return data.empty() && !m_slices.empty();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <storage/file_layout.hpp>
+#include <generic/file_descriptor.hpp>
+#include <filesystem>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <span>
+
+namespace torr {
+
+/* The files of a torrent under a root directory. Verified pieces are
+ * written into them and blocks are served from them, both mapped
+ * through the file layout. Every file is opened on first use and
+ * kept open, a file opened read only is reopened to be written. */
+class file_storage {
+private:
+    const file_layout* m_layout {};
+    std::filesystem::path m_root;
+    std::vector<std::shared_ptr<file_descriptor>> m_files;
+    std::vector<bool> m_writable;
+    std::vector<file_slice> m_slices;
+
+public:
+    explicit file_storage(std::filesystem::path root);
+    ~file_storage();
+
+    /* the layout must outlive the storage, open files are dropped */
+    void set_layout(const file_layout* layout);
+    bool ready() const;
+    const std::filesystem::path& root() const;
+
+    /* a writable file is created along with its directories */
+    std::shared_ptr<file_descriptor> file(size_t file_index, bool writable);
+    /* the slices of a block, valid until the next call, empty if
+     * the block is outside the torrent or there is no layout */
+    std::span<const file_slice> map_block(size_t piece_index, uint64_t offset, uint64_t length);
+    bool write_piece(size_t piece_index, std::span<const std::byte> data);
+};
+
+}
@@ -0,0 +1,201 @@
+#include "piece_buffer_pool.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+torr::piece_buffer::piece_buffer(piece_buffer_pool* pool, std::byte* data,
+    size_t capacity, size_t size, size_t block_size)
+    : m_pool(pool),
+    m_data(data),
+    m_capacity(capacity),
+    m_size(size),
+    m_block_size(block_size),
+    m_block_count((size + block_size - 1) / block_size),
+    m_blocks((m_block_count + 63) / 64)
+{
+}
+
+torr::piece_buffer::~piece_buffer()
+{
+    if (m_pool && m_data)
+        m_pool->release(m_data, m_capacity);
+}
+
+torr::piece_buffer::piece_buffer(piece_buffer&& other)
+    : m_pool(std::exchange(other.m_pool, nullptr)),
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_capacity(std::exchange(other.m_capacity, 0)),
+    m_size(std::exchange(other.m_size, 0)),
+    m_block_size(std::exchange(other.m_block_size, 0)),
+    m_block_count(std::exchange(other.m_block_count, 0)),
+    m_received_blocks(std::exchange(other.m_received_blocks, 0)),
+    m_received(std::exchange(other.m_received, 0)),
+    m_blocks(std::move(other.m_blocks))
+{
+}
+
+torr::piece_buffer& torr::piece_buffer::operator=(piece_buffer&& other)
+{
+    if (this != &other) {
+        if (m_pool && m_data)
+            m_pool->release(m_data, m_capacity);
+        m_pool = std::exchange(other.m_pool, nullptr);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_capacity = std::exchange(other.m_capacity, 0);
+        m_size = std::exchange(other.m_size, 0);
+        m_block_size = std::exchange(other.m_block_size, 0);
+        m_block_count = std::exchange(other.m_block_count, 0);
+        m_received_blocks = std::exchange(other.m_received_blocks, 0);
+        m_received = std::exchange(other.m_received, 0);
+        m_blocks = std::move(other.m_blocks);
+    }
+    return *this;
+}
+
+size_t torr::piece_buffer::block_length(size_t offset) const
+{
+    if (offset >= m_size)
+        return 0;
+    return std::min(m_block_size, m_size - offset);
+}
+
+bool torr::piece_buffer::has_block(size_t offset) const
+{
+    if (!m_data || offset % m_block_size || offset >= m_size)
+        return false;
+    size_t block = offset / m_block_size;
+    return m_blocks[block / 64] & (1ull << (block % 64));
+}
+
+bool torr::piece_buffer::write_block(size_t offset, std::span<const std::byte> block)
+{
+    if (!m_data || offset % m_block_size || block.size() != block_length(offset))
+        return false;
+    if (has_block(offset))
+        return false;
+
+    memcpy(m_data + offset, block.data(), block.size());
+    size_t index = offset / m_block_size;
+    m_blocks[index / 64] |= 1ull << (index % 64);
+    m_received_blocks++;
+    m_received += block.size();
+    return true;
+}
+
+bool torr::piece_buffer::complete() const
+{
+    return m_data && m_received_blocks == m_block_count;
+}
+
+bool torr::piece_buffer::empty() const
+{
+    return !m_data;
+}
+
+void torr::piece_buffer::reset()
+{
+    std::fill(m_blocks.begin(), m_blocks.end(), 0);
+    m_received_blocks = 0;
+    m_received = 0;
+}
+
+size_t torr::piece_buffer::size() const
+{
+    return m_size;
+}
+
+size_t torr::piece_buffer::received() const
+{
+    return m_received;
+}
+
+size_t torr::piece_buffer::block_count() const
+{
+    return m_block_count;
+}
+
+std::span<std::byte> torr::piece_buffer::data()
+{
+    return { m_data, m_size };
+}
+
+std::span<const std::byte> torr::piece_buffer::data() const
+{
+    return { m_data, m_size };
+}
+
+torr::piece_buffer_pool::piece_buffer_pool(size_t piece_length, size_t block_size,
+    size_t max_cached)
+    : m_max_cached(max_cached)
+{
+    configure(piece_length, block_size);
+}
+
+torr::piece_buffer_pool::~piece_buffer_pool()
+{
+    clear();
+}
+
+void torr::piece_buffer_pool::clear()
+{
+    for (std::byte* slab : m_free)
+        free(slab);
+    m_free.clear();
+}
+
+void torr::piece_buffer_pool::configure(size_t piece_length, size_t block_size)
+{
+    if (piece_length == m_piece_length && block_size == m_block_size)
+        return;
+
+    clear();
+    m_piece_length = piece_length;
+    m_block_size = std::max<size_t>(block_size, 1);
+    m_slab_size = (piece_length + PIECE_BUFFER_ALIGNMENT - 1)
+        / PIECE_BUFFER_ALIGNMENT * PIECE_BUFFER_ALIGNMENT;
+}
+
+torr::piece_buffer torr::piece_buffer_pool::acquire(size_t piece_size)
+{
+    if (!piece_size || piece_size > m_piece_length)
+        return {};
+
+    std::byte* slab = nullptr;
+    if (!m_free.empty()) {
+        slab = m_free.back();
+        m_free.pop_back();
+    } else {
+        slab = (std::byte*)aligned_alloc(PIECE_BUFFER_ALIGNMENT, m_slab_size);
+        if (!slab)
+            return {};
+    }
+
+    m_outstanding++;
+    return piece_buffer(this, slab, m_slab_size, piece_size, m_block_size);
+}
+
+void torr::piece_buffer_pool::release(std::byte* slab, size_t capacity)
+{
+    m_outstanding--;
+    /* slabs handed out before a reconfigure are not reused */
+    if (capacity == m_slab_size && m_free.size() < m_max_cached)
+        m_free.push_back(slab);
+    else
+        free(slab);
+}
+
+size_t torr::piece_buffer_pool::piece_length() const
+{
+    return m_piece_length;
+}
+
+size_t torr::piece_buffer_pool::cached() const
+{
+    return m_free.size();
+}
+
+size_t torr::piece_buffer_pool::outstanding() const
+{
+    return m_outstanding;
+}
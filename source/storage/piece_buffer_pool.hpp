@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <span>
+
+#define PIECE_BUFFER_ALIGNMENT 4096
+#define PIECE_BUFFER_POOL_CACHED 64
+
+namespace torr {
+
+class piece_buffer_pool;
+
+/* One piece being downloaded, backed by a slab from the pool. Blocks
+ * are copied straight to their offset and a bitmap with one bit per
+ * block tracks which ones arrived, so blocks may come in any order
+ * and duplicates are detected. Returns its slab to the pool when
+ * destroyed, the pool must outlive it. */
+class piece_buffer {
+private:
+    piece_buffer_pool* m_pool {};
+    std::byte* m_data {};
+    size_t m_capacity {};
+    size_t m_size {};
+    size_t m_block_size {};
+    size_t m_block_count {};
+    size_t m_received_blocks {};
+    size_t m_received {};
+    std::vector<uint64_t> m_blocks;
+
+    friend class piece_buffer_pool;
+    piece_buffer(piece_buffer_pool* pool, std::byte* data, size_t capacity,
+        size_t size, size_t block_size);
+
+public:
+    piece_buffer() {}
+    ~piece_buffer();
+
+    piece_buffer(const piece_buffer&) = delete;
+    piece_buffer& operator=(const piece_buffer&) = delete;
+    piece_buffer(piece_buffer&& other);
+    piece_buffer& operator=(piece_buffer&& other);
+
+    /* copies the block to offset, false if it is not a whole block
+     * of this piece or it was already received */
+    bool write_block(size_t offset, std::span<const std::byte> block);
+    bool has_block(size_t offset) const;
+    /* length of the block at offset, the last block may be short */
+    size_t block_length(size_t offset) const;
+
+    bool complete() const;
+    bool empty() const;
+    void reset();
+
+    size_t size() const;
+    size_t received() const;
+    size_t block_count() const;
+    std::span<std::byte> data();
+    std::span<const std::byte> data() const;
+};
+
+/* Piece length slabs reused across pieces, so downloading a piece
+ * allocates nothing once the pool is warm. Slabs are page aligned and
+ * up to PIECE_BUFFER_POOL_CACHED free ones are kept. */
+class piece_buffer_pool {
+private:
+    size_t m_piece_length {};
+    size_t m_block_size {};
+    size_t m_slab_size {};
+    size_t m_max_cached {};
+    size_t m_outstanding {};
+    std::vector<std::byte*> m_free;
+
+    friend class piece_buffer;
+    void release(std::byte* slab, size_t capacity);
+    void clear();
+
+public:
+    piece_buffer_pool(size_t piece_length = 0, size_t block_size = 16384,
+        size_t max_cached = PIECE_BUFFER_POOL_CACHED);
+    ~piece_buffer_pool();
+
+    piece_buffer_pool(const piece_buffer_pool&) = delete;
+    piece_buffer_pool& operator=(const piece_buffer_pool&) = delete;
+
+    /* drops the cached slabs if the piece length changes */
+    void configure(size_t piece_length, size_t block_size);
+    /* a buffer for a piece of piece_size bytes, empty if it
+     * exceeds the piece length or allocation fails */
+    piece_buffer acquire(size_t piece_size);
+
+    size_t piece_length() const;
+    size_t cached() const;
+    size_t outstanding() const;
+};
+
+}
@@ -1,12 +1,17 @@
 #pragma once
 
 #include <generic/bencode_map.hpp>
+#include <generic/bencode_view.hpp>
+#include <storage/file_layout.hpp>
 #include <filesystem> 
+#include <expected>
 #include <optional>
 #include <vector>
 #include <memory>
 #include <string>
+#include <cstring>
 #include <cassert>
+#include <span>
 #include <arpa/inet.h>
 
 #define VIRTUAL_MEMBER_FUNCTION return {};
@@ -18,6 +23,14 @@ struct peer_ip_touple {
     size_t port;
 } __attribute__ ((packed));
 
+/* SHA1 digest of one piece, the digests of a torrent are
+ * kept in one contiguous array indexed by piece index */
+struct alignas(4) piece_hash {
+    std::byte bytes[20];
+};
+
+static_assert(sizeof(piece_hash) == 20);
+
 class torrent_source {
 public:
     enum class source_type {
@@ -34,10 +47,57 @@ public:
         { VIRTUAL_MEMBER_FUNCTION };
     virtual std::optional<size_t> piece_length() const
         { VIRTUAL_MEMBER_FUNCTION };
+    virtual std::optional<size_t> piece_count() const
+        { VIRTUAL_MEMBER_FUNCTION };
+    virtual std::optional<std::span<const piece_hash>> piece_hashes() const
+        { VIRTUAL_MEMBER_FUNCTION };
+    virtual std::optional<size_t> total_length() const
+        { VIRTUAL_MEMBER_FUNCTION };
+    virtual std::optional<const file_layout*> files() const
+        { VIRTUAL_MEMBER_FUNCTION };
     virtual source_type type() const
         { VIRTUAL_MEMBER_FUNCTION };
+    /* bencoded info dictionary, as hashed into the info-hash */
+    virtual std::optional<std::span<const std::byte>> info_dictionary() const
+        { VIRTUAL_MEMBER_FUNCTION };
+    /* fills in a source known only by its info-hash, ex. with
+     * metadata fetched from peers, fails if the hash differs */
+    virtual std::expected<bool, const char*> set_info(std::span<const std::byte>)
+        { return std::unexpected("torrent source: info cannot be set"); };
+
+    /* size of the piece at index, the last piece may be shorter */
+    std::optional<size_t> piece_size(size_t index) const
+    {
+        auto length = piece_length();
+        auto count = piece_count();
+        auto total = total_length();
+        if (!length || !count || !total || index >= *count)
+            return {};
+        if (index + 1 < *count)
+            return *length;
+        return *total - index * *length;
+    }
 };
 
+struct torrent_info {
+    std::string name;
+    size_t piece_length {};
+    size_t total_length {};
+    std::vector<piece_hash> piece_hashes;
+    file_layout files;
+};
+
+/* a path component taken from the torrent must stay inside the
+ * download directory, rejects empty, "." and ".." components
+ * and anything holding a separator */
+inline bool valid_path_component(std::string_view component)
+{
+    if (component.empty() || component == "." || component == "..")
+        return false;
+    return component.find('/') == std::string_view::npos
+        && component.find('\0') == std::string_view::npos;
+}
+
 inline bool validate_torrent_bencode_map(bencode_map& bencode)
 {
     if (bencode["announce"].type() != bencode_map::target_type::strings)
@@ -51,4 +111,78 @@ inline bool validate_torrent_bencode_map(bencode_map& bencode)
     return true;
 }
 
+inline std::expected<torrent_info, const char*>
+    parse_torrent_info(const bencode_view::element& info)
+{
+    using target_type = bencode_view::target_type;
+    torrent_info parsed;
+
+    if (info.type() != target_type::dictionaries)
+        return std::unexpected("invalid torrent info: info is not a dictionary");
+    if (info["piece length"].type() != target_type::integers || info["piece length"].as_int() <= 0)
+        return std::unexpected("invalid torrent info: invalid piece length");
+    if (info["pieces"].type() != target_type::strings)
+        return std::unexpected("invalid torrent info: missing pieces");
+
+    parsed.piece_length = info["piece length"].as_int();
+    if (info["name"].type() == target_type::strings)
+        parsed.name = info["name"].as_str();
+
+    bool multi_file = (info["files"].type() == target_type::lists);
+    if ((!multi_file || !parsed.name.empty()) && !valid_path_component(parsed.name))
+        return std::unexpected("invalid torrent info: invalid name");
+
+    if (info["length"].type() == target_type::integers) {
+        if (info["length"].as_int() < 0)
+            return std::unexpected("invalid torrent info: negative length");
+        parsed.files.add_file(parsed.name, info["length"].as_int());
+    }
+
+    /* multi-file torrents are laid out under a directory named after the torrent */
+    for (const auto& file : info["files"]) {
+        if (file["length"].type() != target_type::integers || file["length"].as_int() < 0)
+            return std::unexpected("invalid torrent info: invalid file length");
+        if (file["path"].type() != target_type::lists || !file["path"].size())
+            return std::unexpected("invalid torrent info: invalid file path");
+
+        std::filesystem::path path = parsed.name;
+        for (const auto& component : file["path"]) {
+            if (component.type() != target_type::strings || !valid_path_component(component.as_str()))
+                return std::unexpected("invalid torrent info: invalid file path");
+            path /= component.as_str();
+        }
+        parsed.files.add_file(path, file["length"].as_int());
+    }
+
+    parsed.files.set_piece_length(parsed.piece_length);
+    parsed.total_length = parsed.files.total_length();
+
+    auto pieces = info["pieces"].as_bytes();
+    if (pieces.size() % sizeof(piece_hash) != 0)
+        return std::unexpected("invalid torrent info: pieces length is not a multiple of 20");
+
+    size_t piece_count = pieces.size() / sizeof(piece_hash);
+    size_t expected_piece_count =
+        (parsed.total_length + parsed.piece_length - 1) / parsed.piece_length;
+    if (!piece_count || piece_count != expected_piece_count)
+        return std::unexpected("invalid torrent info: piece count does not match total length");
+
+    parsed.piece_hashes.resize(piece_count);
+    memcpy(parsed.piece_hashes.data(), pieces.data(), pieces.size());
+    return parsed;
+}
+
+inline bool validate_torrent_bencode_view(const bencode_view& bencode)
+{
+    if (bencode["announce"].type() != bencode_view::target_type::strings)
+        return false;
+    if (bencode["info"].type() != bencode_view::target_type::dictionaries)
+        return false;
+    if (bencode["info"]["piece length"].type() != bencode_view::target_type::integers)
+        return false;
+    if (bencode["info"]["pieces"].type() != bencode_view::target_type::strings)
+        return false;
+    return true;
+}
+
 }
@@ -1,6 +1,6 @@
 #include "torrent_file.hpp"
+#include <generic/try.hpp>
 #include <openssl/sha.h>
-#include <fstream>
 
 std::unique_ptr<torr::torrent_source> torr::torrent_file::copy() const 
 {
@@ -25,11 +25,36 @@ std::optional<size_t> torr::torrent_file::piece_length() const
     return m_piece_length;
 }
 
+std::optional<size_t> torr::torrent_file::piece_count() const 
+{
+    return m_piece_hashes.size();
+}
+
+std::optional<std::span<const torr::piece_hash>> torr::torrent_file::piece_hashes() const 
+{
+    return m_piece_hashes;
+}
+
+std::optional<size_t> torr::torrent_file::total_length() const 
+{
+    return m_total_length;
+}
+
+std::optional<const torr::file_layout*> torr::torrent_file::files() const 
+{
+    return &m_files;
+}
+
 torr::torrent_source::source_type torr::torrent_file::type() const 
 {
     return torr::torrent_source::source_type::torrent_file;
 }
 
+std::optional<std::span<const std::byte>> torr::torrent_file::info_dictionary() const
+{
+    return m_torrent_bencode["info"].as_raw();
+}
+
 const std::vector<torr::tracker>& torr::torrent_file::trackers() const
 {
     return m_trackers;
@@ -38,30 +63,33 @@ const std::vector<torr::tracker>& torr::torrent_file::trackers() const
 const std::expected<torr::torrent_file*, const char*>
     torr::torrent_file::from_path(const std::filesystem::path& file_path)
 {
-    const auto iflags = std::ios::in | std::ios::binary;
-    std::ifstream file(file_path, iflags); 
-    if (!file) return std::unexpected("invalid torrent file: could not resolve file path");
-
-    auto data = std::vector<uint8_t>(std::istreambuf_iterator<char>{file}, {});
-    m_torrent_bencode.store_raw_bencode();
-    m_torrent_bencode.from_buffer(
-        std::span {(std::byte*)data.data(), data.size()}
-    );
+    /* the view references the mapping, copies of
+     * this torrent_file share the same mapping */
+    auto file = std::make_shared<mapped_file>();
+    if (!file->from_path(file_path))
+        return std::unexpected("invalid torrent file: could not map file path");
+
+    m_mapped_file = file;
+    if (!m_torrent_bencode.from_buffer(m_mapped_file->bytes()))
+        return std::unexpected("invalid torrent file: malformed bencode");
 
-    if (!validate_torrent_bencode_map(m_torrent_bencode))
+    if (!validate_torrent_bencode_view(m_torrent_bencode))
         return std::unexpected("invalid torrent file: missing bencode information");
 
-    m_piece_length = m_torrent_bencode["info"]["piece length"].as_int();
+    auto info = TRY(parse_torrent_info(m_torrent_bencode["info"]));
+    m_piece_length = info.piece_length;
+    m_total_length = info.total_length;
+    m_piece_hashes = std::move(info.piece_hashes);
+    m_file_name = std::move(info.name);
+    m_files = std::move(info.files);
 
     m_file_hash.resize(20);
     auto info_raw = m_torrent_bencode["info"].as_raw();
-    /* FIXME: append byte 'd' but not 'e'? fix in bencoder */
-    info_raw.insert(info_raw.begin(), (std::byte)'d');
     SHA1((uint8_t*)info_raw.data(), info_raw.size(), (uint8_t*)m_file_hash.data());
 
     /* TODO: parse multiple announcers */
     tracker tr;
-    tr.set_string(m_torrent_bencode["announce"].as_str());
+    tr.set_string(std::string(m_torrent_bencode["announce"].as_str()));
     m_trackers.push_back(tr);
 
     return this;
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <generic/bencode_map.hpp>
+#include <generic/bencode_view.hpp>
+#include <generic/mapped_file.hpp>
 #include <network/tracker.hpp>
 #include <torrent.hpp>
 #include <memory>
@@ -13,11 +14,15 @@ namespace torr {
 
 class torrent_file : public torrent_source {
 private:
-    bencode_map m_torrent_bencode;
+    std::shared_ptr<mapped_file> m_mapped_file;
+    bencode_view m_torrent_bencode;
     std::vector<tracker> m_trackers;
     std::vector<std::byte> m_file_hash;
+    std::vector<piece_hash> m_piece_hashes;
+    file_layout m_files;
     std::string m_file_name;
     size_t m_piece_length = 0;
+    size_t m_total_length = 0;
 
 public:
     torrent_file() {}
@@ -27,7 +32,12 @@ public:
     std::optional<const std::vector<std::byte>*> file_hash() const override;
     std::optional<const std::string*> file_name() const override;
     std::optional<size_t> piece_length() const override;
+    std::optional<size_t> piece_count() const override;
+    std::optional<std::span<const piece_hash>> piece_hashes() const override;
+    std::optional<size_t> total_length() const override;
+    std::optional<const file_layout*> files() const override;
     source_type type() const override;
+    std::optional<std::span<const std::byte>> info_dictionary() const override;
 
     const std::vector<tracker>& trackers() const;
     const std::expected<torrent_file*, const char*> 
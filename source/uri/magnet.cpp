@@ -1,6 +1,8 @@
 #include "magnet.hpp"
 #include <generic/try.hpp>
 #include <network/socket/http.hpp>
+#include <openssl/sha.h>
+#include <cstring>
 #include <ranges>
 #include <print>
 #include <regex>
@@ -35,17 +37,83 @@ std::optional<size_t>
     return m_piece_length;
 }
 
+std::optional<size_t>
+    torr::magnet::piece_count() const
+{
+    if (!m_has_info) return {};
+    return m_piece_hashes.size();
+}
+
+std::optional<std::span<const torr::piece_hash>>
+    torr::magnet::piece_hashes() const
+{
+    if (!m_has_info) return {};
+    return m_piece_hashes;
+}
+
+std::optional<size_t>
+    torr::magnet::total_length() const
+{
+    if (!m_has_info) return {};
+    return m_total_length;
+}
+
+std::optional<const torr::file_layout*>
+    torr::magnet::files() const
+{
+    if (!m_has_info) return {};
+    return &m_files;
+}
+
 const std::vector<torr::tracker>&
     torr::magnet::trackers() const
 {
     return m_trackers;
 }
 
+const std::string& torr::magnet::exact_source() const
+{
+    return m_exact_source;
+}
+
 torr::torrent_source::source_type torr::magnet::type() const
 {
     return torr::torrent_source::source_type::magnet_uri;
 }
 
+std::optional<std::span<const std::byte>>
+    torr::magnet::info_dictionary() const
+{
+    if (!m_has_info) return {};
+    return std::span<const std::byte>(m_info);
+}
+
+std::expected<bool, const char*>
+    torr::magnet::set_info(std::span<const std::byte> info_dictionary)
+{
+    std::byte digest[SHA_DIGEST_LENGTH];
+    SHA1((const uint8_t*)info_dictionary.data(), info_dictionary.size(), (uint8_t*)digest);
+    if (m_file_hash.size() != sizeof(digest) ||
+        memcmp(digest, m_file_hash.data(), sizeof(digest)) != 0)
+        return std::unexpected("invalid magnet info: info-hash mismatch");
+
+    /* parsed from the copy, the view points into it */
+    std::vector<std::byte> info(info_dictionary.begin(), info_dictionary.end());
+    bencode_view info_bencode;
+    TRY(info_bencode.from_buffer(info));
+    auto parsed = TRY(parse_torrent_info(info_bencode.root()));
+
+    m_piece_length = parsed.piece_length;
+    m_total_length = parsed.total_length;
+    m_piece_hashes = std::move(parsed.piece_hashes);
+    m_files = std::move(parsed.files);
+    if (m_file_name.empty())
+        m_file_name = std::move(parsed.name);
+    m_info = std::move(info);
+    m_has_info = true;
+    return true;
+}
+
 const std::expected<torr::magnet*, const char*>
     torr::magnet::urn_to_file_hash(const std::string& urn_string)
 {
@@ -109,10 +177,24 @@ const std::expected<torr::magnet*, const char*>
     http request;
     TRY(request.from_string(url));
     auto http_data = TRY(request.get_request());
-    m_torrent_bencode.from_buffer(http_data);
+
+    bencode_view torrent_bencode;
+    TRY(torrent_bencode.from_buffer(http_data));
+    if (!validate_torrent_bencode_view(torrent_bencode))
+        return std::unexpected("invalid magnet uri: missing or invalid bencode information");
+
+    TRY(set_info(torrent_bencode["info"].as_raw()));
     return this;
 }
 
+const std::expected<torr::magnet*, const char*>
+    torr::magnet::fetch_exact_source()
+{
+    if (m_exact_source.empty())
+        return std::unexpected("invalid magnet uri: missing exact source");
+    return url_to_piece_hash(m_exact_source);
+}
+
 const std::expected<torr::magnet*, const char*>
     torr::magnet::from_string(const std::string& uri_string)
 {
@@ -140,7 +222,7 @@ const std::expected<torr::magnet*, const char*>
         else if (param == "xt")
             TRY(urn_to_file_hash(regex_matches[1]));
         else if (param == "xs")
-            TRY(url_to_piece_hash(regex_matches[1]));
+            m_exact_source = regex_matches[1];
         else if (param == "dn")
             m_file_name = regex_matches[1];
 
@@ -151,9 +233,6 @@ const std::expected<torr::magnet*, const char*>
         return std::unexpected("invalid magnet uri: missing trackers");
     if (m_file_hash.size() <= 0)
         return std::unexpected("invalid magnet uri: missing file hash");
-    if (!validate_torrent_bencode_map(m_torrent_bencode))
-        return std::unexpected("invalid magnet uri: missing or invalid bencode information");
 
-    m_piece_length = m_torrent_bencode["info"]["piece length"].as_int();
     return this;
 }
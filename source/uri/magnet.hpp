@@ -1,6 +1,6 @@
 #pragma once
 
-#include <generic/bencode_map.hpp>
+#include <generic/bencode_view.hpp>
 #include <network/tracker.hpp>
 #include <uri/url.hpp>
 #include <torrent.hpp>
@@ -16,9 +16,14 @@ class magnet : public torrent_source {
 private:
     std::vector<tracker> m_trackers;
     std::vector<std::byte> m_file_hash;
+    std::vector<piece_hash> m_piece_hashes;
+    file_layout m_files;
     std::string m_file_name;
-    size_t m_piece_length;
-    bencode_map m_torrent_bencode;
+    std::string m_exact_source;
+    std::vector<std::byte> m_info;
+    size_t m_piece_length {};
+    size_t m_total_length {};
+    bool m_has_info {};
 
     const std::expected<magnet*, const char*>
         urn_to_file_hash(const std::string&);
@@ -33,11 +38,21 @@ public:
     std::optional<const std::vector<std::byte>*> file_hash() const override;
     std::optional<const std::string*> file_name() const override;
     std::optional<size_t> piece_length() const override;
+    std::optional<size_t> piece_count() const override;
+    std::optional<std::span<const piece_hash>> piece_hashes() const override;
+    std::optional<size_t> total_length() const override;
+    std::optional<const file_layout*> files() const override;
     torrent_source::source_type type() const override;
+    std::optional<std::span<const std::byte>> info_dictionary() const override;
+    std::expected<bool, const char*> set_info(std::span<const std::byte>) override;
 
     const std::vector<tracker>& trackers() const;
+    const std::string& exact_source() const;
     const std::expected<magnet*, const char*>
         from_string(const std::string&);
+    /* downloads the torrent named by xs= over http, otherwise the
+     * info dictionary is fetched from peers with ut_metadata */
+    const std::expected<magnet*, const char*> fetch_exact_source();
 };
 
 }
@@ -0,0 +1,79 @@
+#include <generic/bencode_decoder.hpp>
+#include <cassert>
+#include <string>
+#include <print>
+
+#define TEST_NAME "generic/bencode_decoder.hpp"
+#define TEST_BENCODE_STRING "d8:intervali1800e5:peers12:abcdefghijkl4:listli-7e0:d1:ai1eeee"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    std::string_view data = TEST_BENCODE_STRING;
+
+    /* feed the same response in every chunk size,
+     * the result must not depend on chunk boundaries */
+    for (size_t chunk_size = 1; chunk_size <= data.size(); ++chunk_size) {
+        bencode_decoder decoder;
+        std::string peers;
+        int64_t interval = 0;
+        int64_t negative = 0;
+        size_t ends = 0;
+
+        decoder.set_handler([&](const bencode_decoder::event& e) {
+            if (e.type == bencode_decoder::event_type::string && e.key == "peers") {
+                assert(e.offset == peers.size() && e.length == 12);
+                peers.append((const char*)e.data.data(), e.data.size());
+            }
+            if (e.type == bencode_decoder::event_type::integer && e.key == "interval")
+                interval = e.integer;
+            if (e.type == bencode_decoder::event_type::integer && e.depth == 2)
+                negative = e.integer;
+            if (e.type == bencode_decoder::event_type::end)
+                ends++;
+        });
+
+        auto status = bencode_decoder::status::need_more_bytes;
+        for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+            auto chunk = data.substr(offset, chunk_size);
+            status = decoder.feed({ (const std::byte*)chunk.data(), chunk.size() });
+            if (offset + chunk_size < data.size())
+                assert(
+                    status == bencode_decoder::status::need_more_bytes &&
+                    "failed due to decoder completing before the input ended"
+                );
+        }
+
+        assert(
+            status == bencode_decoder::status::complete &&
+            "failed due to decoder not completing"
+        );
+
+        assert(
+            peers == "abcdefghijkl" && interval == 1800 &&
+            negative == -7 && ends == 3 &&
+            "failed due to decoded values not matching input"
+        );
+    }
+
+    std::string_view malformed = "d5:peersi1e";
+    bencode_decoder decoder;
+    decoder.feed({ (const std::byte*)malformed.data(), malformed.size() });
+    assert(
+        decoder.state() == bencode_decoder::status::need_more_bytes &&
+        "failed due to unterminated dictionary not needing more bytes"
+    );
+
+    std::string_view invalid_key = "di1ei2ee";
+    decoder.reset();
+    assert(
+        decoder.feed({ (const std::byte*)invalid_key.data(), invalid_key.size() })
+            == bencode_decoder::status::error &&
+        "failed due to integer dictionary key being accepted"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
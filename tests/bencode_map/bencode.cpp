@@ -1,4 +1,5 @@
 #include <generic/bencode_map.hpp>
+#include <cassert>
 #include <print>
 
 #define TEST_NAME "generic/bencode_map.hpp"
@@ -9,7 +10,8 @@ int main()
     std::print("test: {} ... ", TEST_NAME);
 
     bencode_map bencode;
-    bencode.from_string(TEST_BENCODE_STRING);
+    std::string data = TEST_BENCODE_STRING;
+    bencode.from_string(data);
 
     bencode["wiki"].as_str();
     bencode["meaning"].as_int();
@@ -17,6 +19,58 @@ int main()
     bencode["hits"][1].as_int();
     bencode["hits"][2]["C++20"].as_str();
 
+    auto raw = bencode["hits"].as_raw();
+    assert(
+        std::string((const char*)raw.data(), raw.size()) == "li32ei22ed5:C++204:coolee" &&
+        "failed due to bencode[\"hits\"].as_raw() not matching source bytes"
+    );
+
+    assert(
+        bencode.source_range().first == 0 &&
+        bencode.source_range().second == data.size() - 1 &&
+        "failed due to root source_range() not covering the dictionary"
+    );
+
+    bencode_map arena_bencode;
+    arena_bencode.use_arena();
+    arena_bencode.from_string(data);
+
+    assert(
+        arena_bencode["wiki"].as_str() == "bencode" &&
+        arena_bencode["hits"][2]["C++20"].as_str() == "cool" &&
+        arena_bencode["meaning"].as_int() == 42 &&
+        "failed due to arena backed bencode_map values"
+    );
+
+    assert(
+        arena_bencode["missing"].type() == bencode_map::target_type::unknown &&
+        "failed due to missing key not resolving to unknown type"
+    );
+
+    /* malformed input fails instead of throwing or overflowing */
+    bencode_map truncated;
+    assert(
+        truncated.from_string("d4:spam99999999999:ab").failed() == false &&
+        truncated["spam"].type() != bencode_map::target_type::strings &&
+        "failed due to huge length prefix not truncated to the input"
+    );
+    bencode_map overflow;
+    assert(
+        overflow.from_string("d1:ai99999999999999999999ee").failed() &&
+        overflow["a"].type() == bencode_map::target_type::unknown &&
+        "failed due to integer overflow accepted"
+    );
+    bencode_map misplaced_sign;
+    assert(
+        misplaced_sign.from_string("d1:ai4-2ee").failed() &&
+        "failed due to sign after the first digit accepted"
+    );
+    bencode_map negative;
+    assert(
+        !negative.from_string("d1:ai-42ee").failed() && negative["a"].as_int() == -42 &&
+        "failed due to negative integer rejected"
+    );
+
     std::println("passed");
 
     return 0;
@@ -0,0 +1,57 @@
+#include <generic/bencode_view.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "generic/bencode_view.hpp"
+#define TEST_BENCODE_STRING "d4:wiki7:bencode7:meaningi42e4:hitsli32ei-22ed5:C++204:coolee0:0:e"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    bencode_view bencode;
+    std::string_view data = TEST_BENCODE_STRING;
+    assert(
+        bencode.from_buffer({ (const std::byte*)data.data(), data.size() }).has_value() &&
+        "failed due to bencode.from_buffer() throwing std::unexpected"
+    );
+
+    assert(
+        bencode["wiki"].as_str() == "bencode" &&
+        "failed due to bencode[\"wiki\"].as_str()"
+    );
+
+    assert(
+        bencode["meaning"].as_int() == 42 &&
+        "failed due to bencode[\"meaning\"].as_int()"
+    );
+
+    assert(
+        bencode["hits"].size() == 3 &&
+        bencode["hits"][1].as_int() == -22 &&
+        bencode["hits"][2]["C++20"].as_str() == "cool" &&
+        "failed due to nested list and dictionary lookup"
+    );
+
+    assert(
+        bencode[""].as_str().empty() &&
+        bencode["missing"].type() == bencode_view::target_type::unknown &&
+        "failed due to empty string or missing key"
+    );
+
+    auto raw = bencode["hits"].as_raw();
+    assert(
+        std::string_view((const char*)raw.data(), raw.size()) == "li32ei-22ed5:C++204:coolee" &&
+        "failed due to bencode[\"hits\"].as_raw() not matching source bytes"
+    );
+
+    std::string_view truncated = "d4:wiki7:bencode";
+    assert(
+        !bencode.from_buffer({ (const std::byte*)truncated.data(), truncated.size() }).has_value() &&
+        "failed due to truncated input being accepted"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <generic/bencode_writer.hpp>
+#include <generic/bencode_view.hpp>
+#include <cassert>
+#include <string>
+#include <print>
+
+#define TEST_NAME "generic/bencode_writer.hpp"
+#define EXPECTED_BENCODE_STRING "d1:ai1e1:bl3:onei-2ee1:md11:ut_metadatai3e6:ut_pexi1ee1:zd0:0:ee"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    std::vector<std::byte> buffer;
+    bencode_writer writer(buffer);
+
+    /* keys written out of order must come out sorted */
+    writer.begin_dictionary()
+        .key("z").begin_dictionary().key("").string("").end()
+        .key("m").begin_dictionary()
+            .key("ut_pex").integer(1)
+            .key("ut_metadata").integer(3)
+        .end()
+        .key("b").begin_list().string("one").integer(-2).end()
+        .key("a").integer(1)
+    .end();
+
+    auto encoded = writer.finish();
+    assert(
+        encoded.has_value() &&
+        "failed due to writer.finish() throwing std::unexpected"
+    );
+
+    std::string_view output { (const char*)encoded->data(), encoded->size() };
+    assert(
+        output == EXPECTED_BENCODE_STRING &&
+        "failed due to dictionary keys not being canonically sorted"
+    );
+
+    bencode_view view;
+    assert(
+        view.from_buffer(*encoded).has_value() &&
+        view["m"]["ut_metadata"].as_int() == 3 &&
+        "failed due to encoded output not decoding"
+    );
+
+    std::byte fixed[8];
+    bencode_writer fixed_writer(std::span<std::byte> { fixed, sizeof(fixed) });
+    fixed_writer.begin_list().string("too long for eight bytes").end();
+    assert(
+        !fixed_writer.finish().has_value() &&
+        "failed due to fixed buffer overflow not being reported"
+    );
+
+    std::vector<std::byte> duplicate_buffer;
+    bencode_writer duplicate(duplicate_buffer);
+    duplicate.begin_dictionary().key("b").integer(1).key("a").integer(2).key("b").integer(3).end();
+    assert(
+        !duplicate.finish().has_value() &&
+        "failed due to duplicate dictionary key being accepted"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
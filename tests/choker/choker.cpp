@@ -0,0 +1,83 @@
+#include <network/peer/choker.hpp>
+#include <cassert>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "choker.cpp"
+
+using namespace std::chrono_literals;
+
+static size_t unchoked(const std::vector<torr::choker::candidate>& candidates)
+{
+    size_t count = 0;
+    for (const auto& c : candidates)
+        count += c.unchoke;
+    return count;
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    torr::choker choker;
+    auto now = torr::choker::clock::time_point {} + 1s;
+
+    assert(
+        choker.due(now) && !choker.due(now + 1s) &&
+        choker.due(now + torr::choker::round_interval) &&
+        "failed due to rounds not following the interval"
+    );
+
+    /* ten interested peers with increasing download rates, one not interested */
+    std::vector<torr::choker::candidate> candidates;
+    for (size_t i = 0; i < 10; ++i)
+        candidates.push_back({ i, true, (double)i * 1000, (double)(10 - i) * 1000 });
+    candidates.push_back({ 10, false, 1e9, 1e9 });
+
+    choker.evaluate(candidates, false);
+    assert(
+        unchoked(candidates) == CHOKER_UNCHOKE_SLOTS + 1 &&
+        candidates[9].unchoke && candidates[8].unchoke &&
+        candidates[7].unchoke && candidates[6].unchoke &&
+        !candidates[10].unchoke &&
+        "failed due to top downloaders not unchoked"
+    );
+
+    assert(
+        choker.has_optimistic() && choker.optimistic_id() < 6 &&
+        candidates[choker.optimistic_id()].unchoke &&
+        "failed due to optimistic slot not among the remaining peers"
+    );
+
+    /* the optimistic slot holds until it rotates */
+    size_t optimistic = choker.optimistic_id();
+    for (size_t round = 1; round < CHOKER_OPTIMISTIC_ROUNDS; ++round) {
+        choker.evaluate(candidates, false);
+        assert(
+            choker.optimistic_id() == optimistic &&
+            "failed due to optimistic slot rotating early"
+        );
+    }
+
+    /* seeding ranks by upload rate */
+    choker.evaluate(candidates, true);
+    assert(
+        candidates[0].unchoke && candidates[1].unchoke &&
+        candidates[2].unchoke && candidates[3].unchoke &&
+        unchoked(candidates) == CHOKER_UNCHOKE_SLOTS + 1 &&
+        "failed due to top uploaders not unchoked when seeding"
+    );
+
+    /* fewer interested peers than slots, no optimistic left */
+    std::vector<torr::choker::candidate> few = { { 0, true }, { 1, true }, { 2, false } };
+    choker.evaluate(few, false);
+    assert(
+        few[0].unchoke && few[1].unchoke && !few[2].unchoke &&
+        !choker.has_optimistic() &&
+        "failed due to small swarm not fully unchoked"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <network/peer/connector.hpp>
+#include <generic/bencode_writer.hpp>
+#include <torrent_file.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <print>
+
+#define TEST_NAME "connector.cpp"
+
+using namespace std::chrono_literals;
+
+/* a loopback listener, connects complete through its backlog
+ * whether or not the test ever accepts them */
+static int listen_loopback(torr::peer_ip_touple& address)
+{
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in bound {};
+    bound.sin_family = AF_INET;
+    bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(bound);
+    assert(bind(listener, (sockaddr*)&bound, sizeof(bound)) == 0);
+    assert(listen(listener, 4) == 0);
+    assert(getsockname(listener, (sockaddr*)&bound, &length) == 0);
+    address.address = bound.sin_addr;
+    address.port = ntohs(bound.sin_port);
+    return listener;
+}
+
+static std::string write_torrent(const std::filesystem::path& directory)
+{
+    std::vector<std::byte> torrent;
+    bencode_writer writer(torrent);
+    writer.begin_dictionary()
+        .key("announce").string("udp://127.0.0.1:1")
+        .key("info").begin_dictionary()
+            .key("length").integer(16384)
+            .key("name").string("connector.bin")
+            .key("piece length").integer(16384)
+            .key("pieces").string(std::string(20, 'p'))
+        .end()
+    .end();
+    auto encoded = writer.finish();
+    assert(encoded.has_value());
+
+    auto path = directory / "connector.torrent";
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)encoded->data(), encoded->size());
+    return path;
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    char directory_template[] = "/tmp/torr_connector_XXXXXX";
+    std::filesystem::path directory = mkdtemp(directory_template);
+    torr::torrent_file file;
+    assert(file.from_path(write_torrent(directory)).has_value());
+
+    torr::peer ourself;
+    ourself.set_download_target(file);
+    ourself.randomize_identifier();
+    ourself.construct_handshake_string();
+
+    /* one candidate answers the handshake, one never does */
+    torr::peer_ip_touple answering, silent;
+    int answering_listener = listen_loopback(answering);
+    int silent_listener = listen_loopback(silent);
+
+    auto timeout = 200ms;
+    torr::connector connector(ourself, 4, timeout);
+    assert(!connector.poll(0).has_value() && "failed due to poll before open");
+    assert(connector.open().has_value());
+    connector.add_candidate(silent);
+    connector.add_candidate(answering);
+    assert(connector.candidates() == 2 && !connector.exhausted());
+
+    auto start = torr::connector::clock::now();
+    int remote = -1;
+    std::string received;
+    std::unique_ptr<torr::torrent_peer> connected;
+    while (!connector.exhausted() && torr::connector::clock::now() - start < 2s) {
+        assert(connector.poll(20).has_value());
+
+        if (remote < 0)
+            remote = accept4(answering_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (remote >= 0 && received.size() < 68) {
+            char buffer[68];
+            ssize_t count = recv(remote, buffer, sizeof(buffer) - received.size(), MSG_DONTWAIT);
+            if (count > 0)
+                received.append(buffer, count);
+            if (received.size() == 68)
+                send(remote, received.data(), received.size(), MSG_NOSIGNAL);
+        }
+
+        if (!connected)
+            connected = connector.take();
+    }
+    auto elapsed = torr::connector::clock::now() - start;
+
+    /* the answering peer is handed back, the silent one expires at its deadline */
+    assert(connected && connected->state() == torr::torrent_peer::connection_state::connected &&
+        connected->port() == answering.port && "failed due to handshaked peer not handed back");
+    assert(connector.exhausted() && !connector.in_flight() && !connector.take() &&
+        "failed due to silent attempt not expired");
+    assert(elapsed >= timeout && elapsed < timeout + 500ms &&
+        "failed due to attempt expiring away from its deadline");
+
+    /* without candidates next() fails instead of blocking */
+    assert(!connector.next().has_value() && "failed due to next without candidates");
+
+    /* a handshaked peer nobody takes is closed once it waited too long */
+    auto ready_timeout = 100ms;
+    torr::connector unattended(ourself, 4, timeout, ready_timeout);
+    assert(unattended.open().has_value());
+    unattended.add_candidate(answering);
+    close(remote);
+    remote = -1;
+    received.clear();
+    start = torr::connector::clock::now();
+    while (!unattended.ready() && torr::connector::clock::now() - start < 2s) {
+        assert(unattended.poll(20).has_value());
+
+        if (remote < 0)
+            remote = accept4(answering_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (remote >= 0 && received.size() < 68) {
+            char buffer[68];
+            ssize_t count = recv(remote, buffer, sizeof(buffer) - received.size(), MSG_DONTWAIT);
+            if (count > 0)
+                received.append(buffer, count);
+            if (received.size() == 68)
+                send(remote, received.data(), received.size(), MSG_NOSIGNAL);
+        }
+    }
+    assert(unattended.ready() == 1 && "failed due to handshake not completed");
+    assert(unattended.poll(0).has_value() && unattended.ready() == 1 &&
+        "failed due to ready peer closed early");
+    std::this_thread::sleep_for(ready_timeout);
+    assert(unattended.poll(0).has_value() && unattended.exhausted() &&
+        "failed due to stale ready peer kept");
+
+    close(remote);
+    close(answering_listener);
+    close(silent_listener);
+    std::filesystem::remove_all(directory);
+    std::println("passed");
+    return 0;
+}
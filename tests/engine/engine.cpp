@@ -0,0 +1,293 @@
+#include <network/engine/engine.hpp>
+#include <generic/bencode_writer.hpp>
+#include <torrent_file.hpp>
+#include <openssl/sha.h>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <climits>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <print>
+
+#define TEST_NAME "engine.cpp"
+#define TEST_PIECE_LENGTH 16384
+#define TEST_TOTAL_LENGTH 20000
+#define TEST_FILE_NAME "engine.bin"
+/* one piece of two blocks, resumed by a second remote */
+#define TEST_RESUME_PIECE_LENGTH 32768
+
+using namespace std::chrono_literals;
+
+/* a remote seed, driven from the test between engine turns */
+struct remote {
+    int listener { -1 };
+    int fd { -1 };
+    size_t piece_length { TEST_PIECE_LENGTH };
+    size_t piece_count { 2 };
+    std::string received;
+    bool handshaked {};
+    bool interested {};
+    /* choking remotes unchoke only when told */
+    bool choking {};
+    /* requests past this many are left unanswered */
+    size_t answers { SIZE_MAX };
+    size_t requests {};
+    size_t cancels {};
+    size_t haves {};
+
+    void send_all(const std::string& bytes)
+    {
+        assert(send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL) == (ssize_t)bytes.size());
+    }
+
+    static std::string frame(uint8_t id, const std::string& payload)
+    {
+        uint32_t length = htonl(1 + payload.size());
+        return std::string((const char*)&length, 4) + (char)id + payload;
+    }
+
+    void serve(const std::string& data)
+    {
+        char buffer[4096];
+        ssize_t count;
+        while ((count = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            received.append(buffer, count);
+
+        if (!handshaked) {
+            if (received.size() < 68)
+                return;
+            /* the same protocol string and info-hash, no extensions */
+            assert(received.compare(0, 20, "\x13" "BitTorrent protocol") == 0);
+            send_all(received.substr(0, 20) + std::string(8, '\0') +
+                received.substr(28, 20) + std::string(20, 'R'));
+            send_all(frame(5, std::string(1, (char)(0xff << (8 - piece_count)))));
+            if (!choking)
+                send_all(frame(1, ""));
+            received.erase(0, 68);
+            handshaked = true;
+        }
+
+        while (received.size() >= 4) {
+            uint32_t length;
+            memcpy(&length, received.data(), 4);
+            length = ntohl(length);
+            if (received.size() < 4 + length)
+                return;
+            std::string message = received.substr(4, length);
+            received.erase(0, 4 + length);
+            if (!length)
+                continue;
+
+            if (message[0] == 2)
+                interested = true;
+            if (message[0] == 4)
+                haves++;
+            if (message[0] == 8)
+                cancels++;
+            if (message[0] == 6 && ++requests <= answers) {
+                uint32_t index, begin, size;
+                memcpy(&index, message.data() + 1, 4);
+                memcpy(&begin, message.data() + 5, 4);
+                memcpy(&size, message.data() + 9, 4);
+                size_t offset = ntohl(index) * piece_length + ntohl(begin);
+                send_all(frame(7, message.substr(1, 8) + data.substr(offset, ntohl(size))));
+            }
+        }
+    }
+};
+
+static int listen_loopback(in_addr& address, size_t& port)
+{
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in bound {};
+    bound.sin_family = AF_INET;
+    bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(bound);
+    assert(bind(listener, (sockaddr*)&bound, sizeof(bound)) == 0);
+    assert(listen(listener, 4) == 0);
+    assert(getsockname(listener, (sockaddr*)&bound, &length) == 0);
+    address = bound.sin_addr;
+    port = ntohs(bound.sin_port);
+    return listener;
+}
+
+static std::string write_torrent(const std::string& data, size_t piece_length,
+    const std::string& path)
+{
+    std::string pieces;
+    for (size_t offset = 0; offset < data.size(); offset += piece_length) {
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        std::string piece = data.substr(offset, piece_length);
+        SHA1((const unsigned char*)piece.data(), piece.size(), digest);
+        pieces.append((const char*)digest, sizeof(digest));
+    }
+
+    std::vector<std::byte> torrent;
+    bencode_writer writer(torrent);
+    writer.begin_dictionary()
+        .key("announce").string("udp://127.0.0.1:1")
+        .key("info").begin_dictionary()
+            .key("length").integer(data.size())
+            .key("name").string(TEST_FILE_NAME)
+            .key("piece length").integer(piece_length)
+            .key("pieces").string(pieces)
+        .end()
+    .end();
+    auto encoded = writer.finish();
+    assert(encoded.has_value());
+
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)encoded->data(), encoded->size());
+    return path;
+}
+
+static bool run_until(torr::engine& engine, std::initializer_list<remote*> seeds,
+    const std::string& data, auto&& done, torr::engine::clock::duration limit = 5s)
+{
+    auto start = torr::engine::clock::now();
+    while (!done()) {
+        if (torr::engine::clock::now() - start > limit)
+            return false;
+        assert(engine.run_once(10).has_value());
+        for (remote* seed : seeds) {
+            if (seed->fd == -1)
+                seed->fd = accept4(seed->listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (seed->fd >= 0)
+                seed->serve(data);
+        }
+    }
+    return true;
+}
+
+static std::string stored_file()
+{
+    std::ifstream stored(DOWNLOAD_DIRECTORY "/" TEST_FILE_NAME, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(stored), {});
+}
+
+static void download(torr::engine_backend backend, const torr::torrent_file& file, const std::string& data)
+{
+    std::filesystem::remove_all(DOWNLOAD_DIRECTORY);
+    torr::peer ourself;
+    ourself.set_download_target(file);
+    ourself.randomize_identifier();
+    ourself.construct_handshake_string();
+
+    torr::engine engine(ourself);
+    auto opened = engine.open(backend);
+    /* kernels without io_uring, or sandboxes that deny it */
+    if (!opened.has_value())
+        return;
+    assert(engine.backend() == backend);
+
+    in_addr address;
+    size_t port;
+    remote seed;
+    seed.listener = listen_loopback(address, port);
+    assert(engine.connect(address, port).has_value() && engine.connection_count() == 1);
+
+    /* connect, handshake, then bitfield and unchoke against interested and requests */
+    assert(run_until(engine, { &seed }, data, [&] { return ourself.seeding(); }) &&
+        "failed due to download not completing");
+    assert(seed.handshaked && seed.interested && seed.requests == 2 &&
+        "failed due to messages not exchanged");
+
+    /* verified pieces are announced back and stored in the torrent's file */
+    assert(run_until(engine, { &seed }, data, [&] { return seed.haves == 2; }) &&
+        "failed due to pieces not announced");
+    assert(stored_file() == data && "failed due to stored file not matching");
+
+    /* a remote that closes is detached */
+    close(seed.fd);
+    seed.fd = -2;
+    assert(run_until(engine, { &seed }, data, [&] { return !engine.connection_count(); }) &&
+        "failed due to closed connection not detached");
+
+    close(seed.listener);
+}
+
+static void resume(torr::engine_backend backend, const torr::torrent_file& file, const std::string& data)
+{
+    std::filesystem::remove_all(DOWNLOAD_DIRECTORY);
+    torr::peer ourself;
+    ourself.set_download_target(file);
+    ourself.randomize_identifier();
+    ourself.construct_handshake_string();
+
+    torr::engine engine(ourself);
+    if (!engine.open(backend).has_value())
+        return;
+
+    /* the first remote sends one block and goes silent, the
+     * second one chokes until the first timed out */
+    remote silent, second;
+    silent.piece_length = second.piece_length = TEST_RESUME_PIECE_LENGTH;
+    silent.piece_count = second.piece_count = 1;
+    silent.answers = 1;
+    second.choking = true;
+
+    in_addr address;
+    size_t silent_port, second_port;
+    silent.listener = listen_loopback(address, silent_port);
+    second.listener = listen_loopback(address, second_port);
+    assert(engine.connect(address, silent_port).has_value());
+    assert(engine.connect(address, second_port).has_value());
+
+    assert(run_until(engine, { &silent, &second }, data, [&] { return silent.cancels > 0; },
+        torr::transfer_estimator::min_request_timeout + 3s) && "failed due to requests not timed out");
+    assert(silent.requests == 2 && !ourself.wasted_bytes() && "failed due to received block dropped");
+
+    /* the released piece is resumed, only the missing block is requested */
+    second.send_all(remote::frame(1, ""));
+    assert(run_until(engine, { &silent, &second }, data, [&] { return ourself.seeding(); }) &&
+        "failed due to piece not resumed by another remote");
+    assert(second.requests == 1 && "failed due to received block requested again");
+    assert(run_until(engine, { &silent, &second }, data, [&] { return second.haves == 1; }));
+    assert(stored_file() == data && "failed due to resumed piece not matching");
+
+    close(silent.fd);
+    close(second.fd);
+    close(silent.listener);
+    close(second.listener);
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    char directory_template[] = "/tmp/torr_engine_XXXXXX";
+    std::filesystem::path directory = mkdtemp(directory_template);
+    auto previous = std::filesystem::current_path();
+    std::filesystem::current_path(directory);
+
+    std::string data;
+    for (size_t i = 0; i < TEST_TOTAL_LENGTH; ++i)
+        data += (char)(i * 7 + 3);
+
+    torr::torrent_file file;
+    assert(file.from_path(write_torrent(data, TEST_PIECE_LENGTH, "engine.torrent")).has_value());
+
+    download(torr::engine_backend::epoll, file, data);
+    download(torr::engine_backend::io_uring, file, data);
+
+    std::string resumed = data.substr(0, TEST_RESUME_PIECE_LENGTH);
+    while (resumed.size() < TEST_RESUME_PIECE_LENGTH)
+        resumed += (char)(resumed.size() * 13);
+    torr::torrent_file resume_file;
+    assert(resume_file.from_path(
+        write_torrent(resumed, TEST_RESUME_PIECE_LENGTH, "resume.torrent")).has_value());
+
+    resume(torr::engine_backend::epoll, resume_file, resumed);
+    resume(torr::engine_backend::io_uring, resume_file, resumed);
+
+    std::filesystem::current_path(previous);
+    std::filesystem::remove_all(directory);
+    std::println("passed");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <storage/file_layout.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "file_layout.cpp"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    /* piece length 16, files: a (10), empty (0), b (20), c (3) */
+    torr::file_layout layout;
+    layout.set_piece_length(16);
+    layout.add_file("torrent/a", 10);
+    layout.add_file("torrent/empty", 0);
+    layout.add_file("torrent/b", 20);
+    layout.add_file("torrent/c", 3);
+
+    assert(
+        layout.file_count() == 4 &&
+        layout.total_length() == 33 &&
+        layout.file_offset(2) == 10 &&
+        layout.file_length(1) == 0 &&
+        "failed due to file offsets not matching"
+    );
+
+    assert(
+        layout.file_at(0) == 0 &&
+        layout.file_at(9) == 0 &&
+        layout.file_at(10) == 2 &&
+        layout.file_at(32) == 3 &&
+        "failed due to file lookup skipping or landing on the wrong file"
+    );
+
+    std::vector<torr::file_slice> slices;
+    assert(
+        layout.map_block(0, 4, 4, slices) == 1 &&
+        slices[0].file_index == 0 &&
+        slices[0].file_offset == 4 &&
+        slices[0].length == 4 &&
+        "failed due to block within one file"
+    );
+
+    /* piece 0 spans a, the empty file and the start of b */
+    assert(
+        layout.map_block(0, 0, 16, slices) == 2 &&
+        slices[0].file_index == 0 && slices[0].length == 10 &&
+        slices[1].file_index == 2 && slices[1].file_offset == 0 &&
+        slices[1].length == 6 &&
+        "failed due to block crossing an empty file"
+    );
+
+    /* the last piece is shorter, it ends in c */
+    assert(
+        layout.map_block(2, 0, 1, slices) == 1 &&
+        slices[0].file_index == 3 && slices[0].file_offset == 2 &&
+        layout.map_block(1, 12, 3, slices) == 2 &&
+        slices[0].file_index == 2 && slices[0].file_offset == 18 &&
+        slices[0].length == 2 &&
+        slices[1].file_index == 3 && slices[1].length == 1 &&
+        "failed due to block crossing into the last file"
+    );
+
+    assert(
+        layout.map_block(1, 0, 17, slices) == 0 &&
+        layout.map_block(2, 0, 2, slices) == 0 &&
+        layout.map_block(5, 0, 1, slices) == 0 &&
+        slices.empty() &&
+        "failed due to out of bounds block not rejected"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
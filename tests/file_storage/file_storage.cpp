@@ -0,0 +1,69 @@
+#include <storage/file_storage.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "file_storage.cpp"
+
+static std::string read_file(const std::filesystem::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    char root_template[] = "/tmp/torr_file_storage_XXXXXX";
+    std::filesystem::path root = mkdtemp(root_template);
+    assert(!root.empty());
+
+    /* piece length 8, files: a (5), b (8), c (3) */
+    torr::file_layout layout;
+    layout.set_piece_length(8);
+    layout.add_file("torrent/a", 5);
+    layout.add_file("torrent/sub/b", 8);
+    layout.add_file("torrent/c", 3);
+
+    torr::file_storage storage(root);
+    assert(!storage.ready() && storage.map_block(0, 0, 8).empty() &&
+        "failed due to blocks mapped without a layout");
+    storage.set_layout(&layout);
+    assert(storage.ready());
+
+    /* pieces land in every file they span, in any order */
+    std::string data = "0123456789abcdef";
+    auto piece = [&](size_t index) {
+        return std::as_bytes(std::span(data.data() + index * 8, 8));
+    };
+    assert(storage.write_piece(1, piece(1)) && "failed due to second piece not stored");
+    assert(storage.write_piece(0, piece(0)) && "failed due to first piece not stored");
+    assert(read_file(root / "torrent/a") == "01234" && "failed due to first file contents");
+    assert(read_file(root / "torrent/sub/b") == "56789abc" && "failed due to nested file contents");
+    assert(read_file(root / "torrent/c") == "def" && "failed due to last file contents");
+    assert(!storage.write_piece(2, piece(0)) && "failed due to piece outside the torrent stored");
+
+    /* blocks are served from the files they were mapped to */
+    auto slices = storage.map_block(0, 3, 4);
+    assert(slices.size() == 2 && slices[1].file_index == 1 && slices[1].length == 2);
+    auto first = storage.file(slices[0].file_index, false);
+    assert(first && first == storage.file(0, true) && "failed due to writable file reopened");
+    char block[3] {};
+    assert(pread(first->get(), block, 2, slices[0].file_offset) == 2 && std::string(block) == "34");
+
+    /* a file opened read only is reopened to be written */
+    torr::file_storage reader(root);
+    reader.set_layout(&layout);
+    auto read_only = reader.file(2, false);
+    assert(read_only && read_only != reader.file(2, true) && "failed due to read only file written");
+    assert(!reader.file(3, false) && "failed due to file outside the layout opened");
+
+    std::filesystem::remove_all(root);
+    std::println("passed");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <network/socket/io_ring.hpp>
+#include <cassert>
+#include <cstring>
+#include <print>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#define TEST_NAME "io_ring.cpp"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    /* kernels without io_uring, or sandboxes that deny it, use epoll */
+    if (!torr::io_ring::available()) {
+        std::println("passed");
+        return 0;
+    }
+
+    torr::io_ring ring;
+    assert(ring.open(8).has_value() && "failed due to io_uring_setup() failing");
+
+    int pair[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) == 0);
+
+    std::byte received[64] {};
+    const char* message = "interested";
+    std::span<const std::byte> sent { (const std::byte*)message, strlen(message) };
+
+    /* receive queued before the data exists, completes once it arrives */
+    assert(ring.receive(pair[0], received, 1));
+    assert(ring.send(pair[1], sent, 2));
+    assert(ring.pending() == 2 && "failed due to submissions not queued");
+
+    torr::io_ring::completion completions[8];
+    size_t reaped = 0;
+    int32_t results[3] {};
+    while (reaped < 2) {
+        assert(ring.submit(1).has_value());
+        size_t count = ring.reap(completions);
+        for (size_t i = 0; i < count; ++i)
+            results[completions[i].user_data] = completions[i].result;
+        reaped += count;
+    }
+
+    assert(
+        results[1] == (int32_t)sent.size() && results[2] == (int32_t)sent.size() &&
+        "failed due to send or receive length mismatch"
+    );
+
+    assert(
+        memcmp(received, message, sent.size()) == 0 &&
+        "failed due to received bytes mismatch"
+    );
+
+    /* a timeout completes on its own when nothing else does */
+    struct __kernel_timespec timeout { 0, 1000000 };
+    assert(ring.timeout(&timeout, 3));
+    assert(ring.submit(1).has_value());
+    assert(
+        ring.reap(completions) == 1 &&
+        completions[0].user_data == 3 && completions[0].result == -ETIME &&
+        "failed due to timeout not expiring"
+    );
+
+    /* poll reports writability like epoll would */
+    assert(ring.poll(pair[1], POLLOUT, 4));
+    assert(ring.submit(1).has_value());
+    assert(
+        ring.reap(completions) == 1 &&
+        (completions[0].result & POLLOUT) &&
+        "failed due to poll not reporting POLLOUT"
+    );
+
+    close(pair[0]);
+    close(pair[1]);
+
+    std::println("passed");
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <network/peer/metadata_exchange.hpp>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "metadata_exchange.cpp"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    using clock = torr::metadata_exchange::clock;
+
+    /* two and a half pieces of metadata */
+    std::vector<std::byte> info(METADATA_PIECE_SIZE * 2 + 100);
+    for (size_t i = 0; i < info.size(); ++i)
+        info[i] = (std::byte)(i * 7);
+    std::vector<std::byte> info_hash(SHA_DIGEST_LENGTH);
+    SHA1((const uint8_t*)info.data(), info.size(), (uint8_t*)info_hash.data());
+
+    torr::metadata_exchange exchange;
+    exchange.set_info_hash(info_hash);
+    assert(!exchange.pick().has_value() && "failed due to pick() without a size");
+    assert(!exchange.set_size(METADATA_MAX_SIZE + 1) && "failed due to oversized metadata accepted");
+    assert(exchange.set_size(info.size()) && exchange.piece_count() == 3);
+    assert(exchange.set_size(info.size() + 1) && exchange.size() == info.size() &&
+        "failed due to a later size replacing the first");
+    assert(exchange.piece_size(2) == 100 && "failed due to last piece size");
+
+    /* each piece goes to one connection at a time */
+    auto now = clock::now();
+    auto first = exchange.pick(now);
+    auto second = exchange.pick(now);
+    auto third = exchange.pick(now);
+    assert(first == 0 && second == 1 && third == 2 && "failed due to pieces not shared out");
+    assert(!exchange.pick(now).has_value() && "failed due to piece handed out twice");
+
+    /* rejected and timed out pieces are handed out again */
+    exchange.release(1);
+    assert(exchange.pick(now) == 1 && "failed due to released piece not picked");
+    assert(
+        exchange.pick(now + torr::metadata_exchange::request_timeout) == 0 &&
+        "failed due to timed out piece not picked"
+    );
+
+    std::span<const std::byte> data = info;
+    assert(!exchange.receive(0, data.first(10)).has_value() && "failed due to short piece accepted");
+    assert(exchange.receive(0, data.subspan(0, METADATA_PIECE_SIZE)) == false);
+    assert(exchange.receive(2, data.subspan(METADATA_PIECE_SIZE * 2)) == false);
+
+    /* a corrupt piece fails the hash and the exchange starts over */
+    std::vector<std::byte> corrupt(data.begin() + METADATA_PIECE_SIZE,
+        data.begin() + METADATA_PIECE_SIZE * 2);
+    corrupt[5] ^= (std::byte)0xff;
+    assert(!exchange.receive(1, corrupt).has_value() && "failed due to hash mismatch accepted");
+    assert(!exchange.complete() && exchange.pick(now) == 0 && "failed due to exchange not reset");
+
+    /* the other announced size is tried next, then the first one again */
+    assert(exchange.size() == info.size() + 1 && exchange.piece_size(2) == 101 &&
+        "failed due to conflicting size not tried after a mismatch");
+    std::vector<std::byte> padded(info.begin(), info.end());
+    padded.push_back({});
+    for (size_t piece = 0; piece < exchange.piece_count(); ++piece)
+        exchange.receive(piece, std::span<const std::byte>(padded).subspan(
+            piece * METADATA_PIECE_SIZE, exchange.piece_size(piece)));
+    assert(!exchange.complete() && exchange.size() == info.size() &&
+        "failed due to sizes not tried in turn");
+
+    for (size_t piece = 0; piece < exchange.piece_count(); ++piece) {
+        auto complete = exchange.receive(piece,
+            data.subspan(piece * METADATA_PIECE_SIZE, exchange.piece_size(piece)));
+        assert(complete.has_value() && complete.value() == (piece == 2));
+    }
+
+    assert(exchange.complete() && "failed due to exchange not complete");
+    assert(
+        std::equal(info.begin(), info.end(), exchange.data().begin()) &&
+        "failed due to assembled metadata differs"
+    );
+    assert(!exchange.pick(now).has_value() && "failed due to pick() after completion");
+
+    std::println("passed");
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <network/peer/peer_exchange.hpp>
+#include <generic/bencode_view.hpp>
+#include <arpa/inet.h>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "peer_exchange.cpp"
+
+static torr::peer_ip_touple make_address(const char* ip, size_t port)
+{
+    in_addr parsed {};
+    inet_aton(ip, &parsed);
+    return { parsed, port };
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    using clock = torr::peer_exchange::clock;
+    auto now = clock::now();
+
+    auto remote = make_address("10.0.0.1", 6881);
+    auto first = make_address("10.0.0.2", 51413);
+    auto second = make_address("192.168.1.20", 6882);
+
+    /* the compact form round trips */
+    std::vector<std::byte> compact;
+    torr::peer_exchange::append_compact(compact, second);
+    assert(compact.size() == PEX_COMPACT_SIZE);
+    assert(
+        (uint8_t)compact[0] == 192 && (uint8_t)compact[4] == 0x1a && (uint8_t)compact[5] == 0xe2 &&
+        "failed due to compact address not in network order"
+    );
+    auto parsed = torr::peer_exchange::parse_compact(compact);
+    assert(
+        parsed.size() == 1 && parsed[0].address.s_addr == second.address.s_addr &&
+        parsed[0].port == 6882 && "failed due to compact address round trip"
+    );
+
+    torr::peer_exchange exchange;
+    exchange.add_connected(remote);
+    exchange.add_connected(first);
+    exchange.add_connected(second);
+
+    /* the remote is told about everyone but itself */
+    torr::peer_exchange::advertised state;
+    auto message = exchange.build(state, remote, now);
+    assert(message.has_value() && "failed due to no initial message");
+    bencode_view view;
+    assert(view.from_buffer(*message).has_value());
+    assert(view["added"].as_bytes().size() == 2 * PEX_COMPACT_SIZE && "failed due to added peers");
+    assert(view["added.f"].as_bytes().size() == 2 && "failed due to added flags");
+    assert(view["dropped"].as_bytes().empty());
+
+    /* rate limited, and only changes are sent */
+    exchange.remove_connected(first);
+    assert(!exchange.build(state, remote, now).has_value() && "failed due to rate limit");
+    message = exchange.build(state, remote, now + torr::peer_exchange::interval);
+    assert(message.has_value() && view.from_buffer(*message).has_value());
+    assert(view["added"].as_bytes().empty() && "failed due to unchanged peer sent again");
+    auto dropped = torr::peer_exchange::parse_compact(view["dropped"].as_bytes());
+    assert(dropped.size() == 1 && dropped[0].port == first.port && "failed due to dropped peer");
+    assert(
+        !exchange.build(state, remote, now + torr::peer_exchange::interval * 2).has_value() &&
+        "failed due to message without changes"
+    );
+
+    /* received peers are queued once, known ones are skipped */
+    torr::peer_exchange receiver;
+    receiver.add_known(first);
+    torr::peer_exchange::advertised from_remote;
+    std::vector<std::byte> added;
+    torr::peer_exchange::append_compact(added, first);
+    torr::peer_exchange::append_compact(added, second);
+    std::string payload = "d5:added12:" + std::string((const char*)added.data(), added.size()) + "e";
+    std::span<const std::byte> bytes { (const std::byte*)payload.data(), payload.size() };
+
+    auto discovered = receiver.receive(from_remote, bytes, now);
+    assert(discovered.has_value() && discovered.value() == 1 && "failed due to discovered count");
+    assert(receiver.receive(from_remote, bytes, now).value() == 0 && "failed due to flooding accepted");
+    assert(
+        receiver.receive(from_remote, bytes, now + torr::peer_exchange::interval).value() == 0 &&
+        "failed due to known peer queued twice"
+    );
+
+    auto taken = receiver.take_discovered();
+    assert(taken.size() == 1 && taken[0].port == second.port && receiver.discovered() == 0);
+
+    std::span<const std::byte> garbage { (const std::byte*)"x", 1 };
+    assert(
+        !receiver.receive(from_remote, garbage, now + torr::peer_exchange::interval * 2).has_value() &&
+        "failed due to invalid message accepted"
+    );
+
+    std::println("passed");
+    return 0;
+}
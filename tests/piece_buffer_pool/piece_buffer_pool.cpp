@@ -0,0 +1,70 @@
+#include <storage/piece_buffer_pool.hpp>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "piece_buffer_pool.cpp"
+
+static std::vector<std::byte> block(size_t length, uint8_t value)
+{
+    return std::vector<std::byte>(length, (std::byte)value);
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    /* pieces of 40 bytes in blocks of 16, the last block is 8 bytes */
+    torr::piece_buffer_pool pool(40, 16, 1);
+
+    {
+        torr::piece_buffer piece = pool.acquire(40);
+        assert(!piece.empty() && piece.block_count() == 3 && "failed due to block count");
+        assert(
+            ((uintptr_t)piece.data().data() % PIECE_BUFFER_ALIGNMENT) == 0 &&
+            "failed due to slab not page aligned"
+        );
+
+        /* out of order, the short last block first */
+        assert(piece.write_block(32, block(8, 3)) && "failed due to last block rejected");
+        assert(piece.write_block(0, block(16, 1)) && "failed due to first block rejected");
+        assert(!piece.complete() && "failed due to piece complete early");
+
+        assert(!piece.write_block(0, block(16, 9)) && "failed due to duplicate accepted");
+        assert(!piece.write_block(8, block(16, 9)) && "failed due to misaligned block accepted");
+        assert(!piece.write_block(16, block(8, 9)) && "failed due to short block accepted");
+        assert(!piece.write_block(48, block(16, 9)) && "failed due to block past piece accepted");
+
+        assert(piece.write_block(16, block(16, 2)));
+        assert(piece.complete() && piece.received() == 40 && "failed due to piece not complete");
+        assert(
+            piece.data()[0] == (std::byte)1 && piece.data()[16] == (std::byte)2 &&
+            piece.data()[39] == (std::byte)3 &&
+            "failed due to blocks not placed at their offsets"
+        );
+        assert(pool.outstanding() == 1);
+    }
+
+    assert(pool.outstanding() == 0 && pool.cached() == 1 && "failed due to slab not returned");
+
+    /* a warm pool hands the cached slab out again */
+    {
+        torr::piece_buffer first = pool.acquire(24);
+        assert(pool.cached() == 0 && first.size() == 24 && first.block_count() == 2);
+        assert(!first.has_block(0) && "failed due to bitmap not cleared on reuse");
+
+        torr::piece_buffer second = pool.acquire(40);
+        torr::piece_buffer moved = std::move(second);
+        assert(second.empty() && !moved.empty() && pool.outstanding() == 2);
+    }
+
+    /* only max_cached free slabs are kept */
+    assert(pool.cached() == 1 && pool.outstanding() == 0 && "failed due to cache limit");
+
+    assert(pool.acquire(41).empty() && "failed due to oversized piece accepted");
+    assert(pool.acquire(0).empty() && "failed due to empty piece accepted");
+
+    std::println("passed");
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <network/peer/piece_picker.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "piece_picker.cpp"
+#define TEST_PIECES 64
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    torr::piece_picker picker;
+    picker.resize(TEST_PIECES);
+
+    dynamic_bitset seed;
+    seed.resize_bits(TEST_PIECES);
+    for (size_t i = 0; i < TEST_PIECES; ++i)
+        seed.bit_set(i);
+
+    /* three seeds, one more peer holding every piece but 5 and 9 */
+    dynamic_bitset partial = seed;
+    partial.bit_clear(5);
+    partial.bit_clear(9);
+
+    picker.add_bitfield(seed);
+    picker.add_bitfield(seed);
+    picker.add_bitfield(seed);
+    picker.add_bitfield(partial);
+
+    assert(
+        picker.availability(5) == 3 &&
+        picker.availability(0) == 4 &&
+        "failed due to availability not counting bitfields"
+    );
+
+    auto first = picker.pick(seed);
+    assert(
+        first.has_value() && (*first == 5 || *first == 9) &&
+        "failed due to rarest piece not picked first"
+    );
+
+    /* in flight pieces are skipped, the other rare piece is next */
+    picker.add_downloader(*first);
+    auto second = picker.pick(seed);
+    assert(
+        second.has_value() && *second != *first &&
+        (*second == 5 || *second == 9) &&
+        "failed due to downloading piece picked twice"
+    );
+
+    /* a HAVE makes piece 9 as common as the rest */
+    picker.remove_downloader(*first);
+    picker.increment(9);
+    assert(
+        picker.pick(seed) == 5 &&
+        "failed due to HAVE not moving the piece out of the rare bucket"
+    );
+
+    /* pieces we have are never picked, the remote only has piece 7 */
+    picker.set_have(5);
+    dynamic_bitset single;
+    single.resize_bits(TEST_PIECES);
+    single.bit_set(7);
+    single.bit_set(5);
+    assert(
+        picker.have(5) && picker.pick(single) == 7 &&
+        "failed due to piece we have being picked"
+    );
+
+    picker.set_have(7);
+    assert(
+        !picker.pick(single).has_value() &&
+        "failed due to pick without candidates"
+    );
+
+    /* dropping peers lowers availability, ties are picked at random */
+    picker.remove_bitfield(partial);
+    picker.remove_bitfield(seed);
+    assert(
+        picker.availability(0) == 2 &&
+        picker.availability(5) == 2 &&
+        "failed due to availability not decremented"
+    );
+
+    bool distinct = false;
+    auto tie = picker.pick(seed);
+    for (int i = 0; i < 32 && !distinct; ++i)
+        distinct = (picker.pick(seed) != tie);
+    assert(
+        distinct &&
+        "failed due to ties not broken at random"
+    );
+
+    /* endgame starts once every missing piece is in flight */
+    for (size_t i = 0; i < TEST_PIECES; ++i)
+        if (!picker.have(i) && i != 11) picker.add_downloader(i);
+    assert(!picker.endgame() && picker.pick(seed) == 11);
+    picker.add_downloader(11);
+    picker.add_downloader(11);
+    assert(
+        picker.endgame() && !picker.pick(seed).has_value() &&
+        picker.pick_endgame(seed).has_value() &&
+        picker.pick_endgame(seed) != 11 &&
+        picker.pick_endgame(single) == std::nullopt &&
+        "failed due to endgame not picking the least duplicated piece"
+    );
+
+    /* a piece being written is not downloaded again */
+    auto writing = picker.pick_endgame(seed).value();
+    picker.set_storing(writing, true);
+    assert(
+        picker.pick_endgame(seed) != writing &&
+        "failed due to endgame picking a piece being written"
+    );
+    picker.set_storing(writing, false);
+    assert(picker.pick_endgame(seed) == writing);
+    for (size_t i = 0; i < TEST_PIECES; ++i)
+        while (picker.downloaders(i)) picker.remove_downloader(i);
+    assert(!picker.endgame());
+
+    /* the bucket order stays consistent after many updates */
+    for (size_t round = 0; round < 4; ++round)
+        for (size_t i = 0; i < TEST_PIECES; i += round + 1)
+            picker.increment(i);
+    for (size_t i = 0; i < TEST_PIECES; ++i) {
+        if (picker.have(i)) continue;
+        picker.set_have(i);
+    }
+    assert(
+        !picker.pick(seed).has_value() &&
+        "failed due to pick after every piece is done"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
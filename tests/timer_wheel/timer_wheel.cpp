@@ -0,0 +1,84 @@
+#include <generic/timer_wheel.hpp>
+#include <cassert>
+#include <vector>
+#include <print>
+
+#define TEST_NAME "generic/timer_wheel.hpp"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    using clock = timer_wheel<int>::clock;
+    using std::chrono::milliseconds;
+    using std::chrono::seconds;
+
+    auto start = clock::now();
+    timer_wheel<int> wheel(milliseconds(10), start);
+    assert(wheel.empty() && !wheel.next_expiry().has_value());
+
+    std::vector<int> fired;
+    auto collect = [&](int value) { fired.push_back(value); };
+
+    /* timers fire in order of expiry, never before it */
+    wheel.schedule(start + milliseconds(35), 2);
+    wheel.schedule(start + milliseconds(5), 1);
+    auto cancelled = wheel.schedule(start + milliseconds(20), 9);
+    assert(wheel.size() == 3);
+    assert(wheel.next_expiry() == start + milliseconds(10) && "failed due to next expiry");
+
+    assert(wheel.cancel(cancelled) && !wheel.pending(cancelled));
+    assert(!wheel.cancel(cancelled) && "failed due to timer cancelled twice");
+
+    assert(wheel.advance(start + milliseconds(9), collect) == 0 && "failed due to early timer");
+    assert(wheel.advance(start + milliseconds(10), collect) == 1 && fired == std::vector { 1 });
+    assert(wheel.advance(start + milliseconds(39), collect) == 0 && "failed due to early timer");
+    assert(wheel.advance(start + milliseconds(40), collect) == 1 && fired == std::vector({ 1, 2 }));
+    assert(wheel.empty() && "failed due to fired timer still pending");
+
+    /* an id of a fired timer does not cancel the timer reusing its node */
+    fired.clear();
+    auto reused = wheel.schedule(start + milliseconds(100), 3);
+    assert(!wheel.cancel(cancelled) && wheel.pending(reused) && "failed due to stale id");
+
+    /* timers past the first level cascade down and still fire on time */
+    wheel.schedule(start + seconds(5), 4);
+    wheel.schedule(start + seconds(700), 5);
+    wheel.advance(start + milliseconds(4990), collect);
+    assert(fired == std::vector { 3 } && "failed due to cascaded timer fired early");
+    wheel.advance(start + seconds(5), collect);
+    assert(fired == std::vector({ 3, 4 }) && "failed due to cascaded timer not fired");
+    assert(wheel.next_expiry() <= start + seconds(700));
+    wheel.advance(start + milliseconds(699990), collect);
+    assert(fired.size() == 2 && "failed due to timer from the third level fired early");
+    wheel.advance(start + seconds(700), collect);
+    assert(fired == std::vector({ 3, 4, 5 }) && "failed due to timer from the third level");
+
+    /* timers scheduled while firing go to a later tick */
+    fired.clear();
+    auto now = start + seconds(800);
+    wheel.schedule(now, 6);
+    wheel.advance(now, [&](int value) {
+        fired.push_back(value);
+        if (value == 6)
+            wheel.schedule(now, 7);
+    });
+    assert(fired == std::vector { 6 } && wheel.size() == 1 && "failed due to rescheduled timer fired in the same tick");
+    wheel.advance(now + milliseconds(10), collect);
+    assert(fired == std::vector({ 6, 7 }));
+
+    /* many timers, half of them cancelled */
+    fired.clear();
+    std::vector<timer_wheel<int>::timer_id> ids;
+    for (int i = 0; i < 100000; ++i)
+        ids.push_back(wheel.schedule(now + milliseconds(i % 5000), i));
+    for (size_t i = 0; i < ids.size(); i += 2)
+        wheel.cancel(ids[i]);
+    wheel.advance(now + seconds(10), collect);
+    assert(fired.size() == 50000 && wheel.empty() && "failed due to timers lost or fired after cancel");
+    for (int value : fired)
+        assert(value % 2 == 1 && "failed due to cancelled timer fired");
+
+    std::println("passed");
+    return 0;
+}
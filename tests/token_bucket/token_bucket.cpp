@@ -0,0 +1,92 @@
+#include <network/socket/token_bucket.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "token_bucket.cpp"
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    using clock = torr::token_bucket::clock;
+    using std::chrono::milliseconds;
+
+    /* without a rate everything is granted */
+    torr::token_bucket unlimited;
+    assert(!unlimited.limited() && "failed due to unlimited bucket reported limited");
+    assert(unlimited.request(1 << 20) == 1 << 20 && "failed due to unlimited bucket throttled");
+    assert(unlimited.limited_at() == clock::time_point {} && "failed due to unlimited bucket recorded as limited");
+
+    /* a new limit starts with a full burst, and no more */
+    torr::token_bucket bucket;
+    bucket.set_rate(100000);
+    auto now = clock::now();
+    assert(bucket.limited() && bucket.tokens() == 100000);
+    assert(bucket.request(150000, now) == 100000 && "failed due to grant over the burst");
+    assert(bucket.request(1, now) == 0 && "failed due to grant from an empty bucket");
+    assert(bucket.limited_at() == now && "failed due to limited request not recorded");
+
+    /* tokens arrive in batches, not within the refill interval */
+    assert(bucket.request(1000, now + milliseconds(10)) == 0 && "failed due to refill within the interval");
+    size_t refilled = bucket.request(100000, now + milliseconds(100));
+    assert(refilled >= 10000 && refilled < 10500 && "failed due to refill not following the rate");
+
+    /* an idle bucket holds at most the burst, unused grants come back */
+    assert(bucket.request(1 << 20, now + std::chrono::seconds(10)) == 100000 && "failed due to burst cap");
+    bucket.refund(4000);
+    assert(bucket.tokens() == 4000 && "failed due to refund");
+    bucket.refund(1 << 20);
+    assert(bucket.tokens() == bucket.burst() && "failed due to refund over the burst");
+
+    /* rates under a token per refill interval add up across requests */
+    torr::token_bucket slow;
+    slow.set_rate(30);
+    now = clock::now();
+    assert(slow.request(30, now) == 30);
+    size_t trickled = 0;
+    for (auto elapsed = milliseconds(20); elapsed <= milliseconds(1000); elapsed += milliseconds(20))
+        trickled += slow.request(30, now + elapsed);
+    assert(trickled >= 29 && trickled <= 30 && "failed due to fractional tokens lost");
+
+    torr::token_bucket uneven;
+    uneven.set_rate(75);
+    now = clock::now();
+    uneven.request(75, now);
+    size_t granted = 0;
+    for (auto elapsed = milliseconds(20); elapsed <= milliseconds(2000); elapsed += milliseconds(20))
+        granted += uneven.request(75, now + elapsed);
+    assert(granted >= 148 && granted <= 150 && "failed due to rate rounded down");
+
+    /* children draw from the parent, each at most an even share */
+    torr::token_bucket torrent;
+    torrent.set_rate(50000);
+    now = clock::now();
+    torr::token_bucket first;
+    torr::token_bucket second;
+    first.set_parent(&torrent);
+    second.set_parent(&torrent);
+    assert(torrent.children() == 2 && first.limited() && first.parent() == &torrent &&
+        "failed due to parent not attached");
+    assert(first.request(50000, now) == 25000 && "failed due to share over half the tokens");
+    assert(second.request(50000, now) == TOKEN_BUCKET_MIN_SHARE && "failed due to minimum share");
+    assert(torrent.tokens() == 25000 - TOKEN_BUCKET_MIN_SHARE);
+
+    /* the tighter of the child and parent limit applies */
+    first.set_rate(1000);
+    assert(first.request(50000, now) == 1000 && "failed due to child limit ignored");
+    assert(torrent.tokens() == 25000 - TOKEN_BUCKET_MIN_SHARE - 1000);
+    first.refund(500);
+    assert(first.tokens() == 500 && torrent.tokens() == 25000 - TOKEN_BUCKET_MIN_SHARE - 500 &&
+        "failed due to refund not reaching the parent");
+
+    /* a destroyed child leaves the parent's share */
+    {
+        torr::token_bucket third;
+        third.set_parent(&torrent);
+        assert(torrent.children() == 3);
+    }
+    assert(torrent.children() == 2 && "failed due to child not detached");
+
+    std::println("passed");
+    return 0;
+}
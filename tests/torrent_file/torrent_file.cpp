@@ -7,6 +7,10 @@
 #define TEST_FILE "torrent_file/test.torrent"
 #define TEST_EXPECTED_INFO_HASH "dd8255ecdc7ca55fb0bbf81323d87062db1f6d1c"
 #define TEST_EXPECTED_PIECE_LENGTH 262144
+#define TEST_EXPECTED_PIECE_COUNT 1055
+#define TEST_EXPECTED_TOTAL_LENGTH 276445467
+#define TEST_EXPECTED_FILE_COUNT 3
+#define TEST_EXPECTED_LAST_FILE "Big Buck Bunny/poster.jpg"
 
 int main()
 {
@@ -36,6 +40,27 @@ int main()
         "failed due to piece length not matching expected piece length"
     );
 
+    assert(
+        file.piece_count() == TEST_EXPECTED_PIECE_COUNT &&
+        file.piece_hashes()->size() == TEST_EXPECTED_PIECE_COUNT &&
+        "failed due to piece count not matching expected piece count"
+    );
+
+    assert(
+        file.total_length() == TEST_EXPECTED_TOTAL_LENGTH &&
+        file.piece_size(TEST_EXPECTED_PIECE_COUNT - 1) ==
+            TEST_EXPECTED_TOTAL_LENGTH - (TEST_EXPECTED_PIECE_COUNT - 1) * TEST_EXPECTED_PIECE_LENGTH &&
+        "failed due to total length or last piece size not matching"
+    );
+
+    auto files = file.files().value();
+    assert(
+        files->file_count() == TEST_EXPECTED_FILE_COUNT &&
+        files->total_length() == TEST_EXPECTED_TOTAL_LENGTH &&
+        files->file_path(TEST_EXPECTED_FILE_COUNT - 1) == TEST_EXPECTED_LAST_FILE &&
+        "failed due to file layout not matching expected files"
+    );
+
     assert(
         !file.trackers().empty() &&
         "failed due to missing tracker"
@@ -0,0 +1,98 @@
+#include <network/peer/transfer_estimator.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "transfer_estimator.cpp"
+#define TEST_BLOCK_SIZE 16384
+
+using namespace std::chrono_literals;
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    torr::transfer_estimator estimator;
+    auto now = torr::transfer_estimator::clock::time_point {} + 1s;
+
+    assert(
+        estimator.queue_depth(TEST_BLOCK_SIZE) == REQUEST_QUEUE_INITIAL &&
+        "failed due to queue depth without samples not being the initial depth"
+    );
+    assert(
+        estimator.request_timeout() == torr::transfer_estimator::initial_request_timeout &&
+        "failed due to request timeout without samples not being the initial timeout"
+    );
+
+    /* 10 MB/s over a 20ms path */
+    for (int i = 0; i <= 10; ++i) {
+        estimator.add_rtt_sample(20ms, now);
+        estimator.add_bytes(i ? 1000000 : 0, now);
+        now += 100ms;
+    }
+
+    assert(
+        estimator.rate(now) > 9000000 && estimator.rate(now) < 11000000 &&
+        "failed due to rate not matching the transferred bytes"
+    );
+
+    /* a stalled transfer decays a window at a time, without new bytes */
+    assert(
+        estimator.rate(now + 1s) < estimator.rate(now) &&
+        estimator.rate(now + 5s) < estimator.rate(now + 1s) &&
+        estimator.rate(now + 5s) < estimator.rate(now) / 10 &&
+        "failed due to rate of a stalled transfer not decaying"
+    );
+
+    assert(
+        estimator.srtt() == 20ms && estimator.min_rtt() == 20ms &&
+        "failed due to round trip estimate not matching samples"
+    );
+
+    /* 10 MB/s * 20ms * 2 / 16 KiB */
+    assert(
+        estimator.queue_depth(TEST_BLOCK_SIZE) >= 24 &&
+        estimator.queue_depth(TEST_BLOCK_SIZE) <= 26 &&
+        "failed due to queue depth not following the bandwidth-delay product"
+    );
+
+    /* queueing at the peer raises srtt, not the path delay */
+    estimator.add_rtt_sample(200ms, now);
+    assert(
+        estimator.srtt() > 20ms && estimator.min_rtt() == 20ms &&
+        estimator.rto() > estimator.srtt() &&
+        "failed due to queueing delay leaking into the path delay"
+    );
+
+    /* a fast path still leaves the peer a minimum to answer requests */
+    assert(
+        estimator.request_timeout() == torr::transfer_estimator::min_request_timeout &&
+        "failed due to request timeout below the minimum"
+    );
+
+    /* bytes after a stall start from the decayed rate */
+    torr::transfer_estimator resumed;
+    for (int i = 0; i <= 10; ++i, now += 100ms)
+        resumed.add_bytes(i ? 1000000 : 0, now);
+    now += 10s;
+    resumed.add_bytes(1000, now);
+    assert(
+        resumed.rate(now) < 1000000 && resumed.rate(now) == resumed.rate(now + 400ms) &&
+        "failed due to rate resuming from before the stall"
+    );
+
+    torr::transfer_estimator slow;
+    for (int i = 0; i <= 10; ++i) {
+        slow.add_rtt_sample(100ms, now);
+        slow.add_bytes(i ? 1000 : 0, now);
+        now += 100ms;
+    }
+
+    assert(
+        slow.queue_depth(TEST_BLOCK_SIZE) == REQUEST_QUEUE_MIN &&
+        "failed due to slow peer not being limited to the minimum depth"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
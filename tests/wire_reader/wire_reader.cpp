@@ -0,0 +1,100 @@
+#include <network/peer/wire_reader.hpp>
+#include <cassert>
+#include <print>
+
+#define TEST_NAME "wire_reader.cpp"
+
+static std::vector<std::byte> frame(std::initializer_list<uint8_t> bytes)
+{
+    std::vector<std::byte> out;
+    for (auto b : bytes)
+        out.push_back((std::byte)b);
+    return out;
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    torr::wire_reader reader(64, 56);
+    torr::wire_message message;
+
+    /* keep-alive, choke and have in one receive */
+    auto batch = frame({
+        0, 0, 0, 0,
+        0, 0, 0, 1, 0,
+        0, 0, 0, 5, 4, 0, 0, 1, 7,
+    });
+    reader.append(batch);
+
+    assert(
+        reader.next(message).value() &&
+        message.keep_alive &&
+        "failed due to keep-alive not framed as keep-alive"
+    );
+
+    assert(
+        reader.next(message).value() &&
+        !message.keep_alive && message.id == 0 &&
+        message.payload.empty() &&
+        "failed due to choke not framed after keep-alive"
+    );
+
+    assert(
+        reader.next(message).value() &&
+        message.id == 4 && message.payload.size() == 4 &&
+        message.payload[3] == (std::byte)7 &&
+        !reader.next(message).value() &&
+        "failed due to have payload not framed"
+    );
+
+    /* partial message waits for the rest of its bytes */
+    auto first = frame({ 0, 0, 0, 9, 7, 0, 0, 0, 1 });
+    auto second = frame({ 0xAA, 0xBB, 0xCC, 0xDD });
+    reader.append(first);
+    assert(
+        !reader.next(message).value() &&
+        reader.buffered() == first.size() &&
+        "failed due to partial message framed early"
+    );
+
+    reader.append(second);
+    assert(
+        reader.next(message).value() &&
+        message.id == 7 && message.payload.size() == 8 &&
+        message.payload[7] == (std::byte)0xDD &&
+        reader.buffered() == 0 &&
+        "failed due to message completed by a later receive"
+    );
+
+    /* a message wrapping the end of the ring is still contiguous */
+    std::vector<std::byte> stream(70, (std::byte)0);
+    stream[3] = (std::byte)36;
+    stream[4] = (std::byte)9;
+    stream[43] = (std::byte)26;
+    stream[44] = (std::byte)4;
+    for (size_t i = 45; i < stream.size(); ++i)
+        stream[i] = (std::byte)i;
+
+    reader.append(std::span(stream).first(44));
+    assert(reader.next(message).value() && message.payload.size() == 35);
+    reader.append(std::span(stream).subspan(44));
+    assert(
+        reader.next(message).value() &&
+        message.id == 4 && message.payload.size() == 25 &&
+        message.payload[0] == (std::byte)45 &&
+        message.payload[24] == (std::byte)69 &&
+        "failed due to message wrapping the ring buffer"
+    );
+
+    auto oversized = frame({ 0, 0, 1, 0, 7 });
+    reader.append(oversized);
+    assert(
+        !reader.next(message).has_value() &&
+        "failed due to oversized message not rejected"
+    );
+
+    std::println("passed");
+
+    return 0;
+}
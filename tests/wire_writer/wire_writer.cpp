@@ -0,0 +1,183 @@
+#include <network/peer/wire_writer.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <print>
+
+#define TEST_NAME "wire_writer.cpp"
+
+static std::span<const std::byte> bytes(const std::string& text)
+{
+    return std::as_bytes(std::span(text));
+}
+
+/* everything the other end of the socket received so far */
+static std::string receive_all(int fd)
+{
+    std::string received;
+    char buffer[4096];
+    for (;;) {
+        ssize_t result = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (result <= 0)
+            return received;
+        received.append(buffer, result);
+    }
+}
+
+/* a connected loopback pair, unlike socketpair() it can be corked */
+static void tcp_pair(int fds[2])
+{
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    assert(bind(listener, (sockaddr*)&address, sizeof(address)) == 0);
+    assert(listen(listener, 1) == 0);
+    assert(getsockname(listener, (sockaddr*)&address, &length) == 0);
+
+    fds[0] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(connect(fds[0], (sockaddr*)&address, sizeof(address)) == 0);
+    fds[1] = accept(listener, nullptr, nullptr);
+    assert(fds[1] >= 0);
+    close(listener);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+}
+
+static bool corked(int fd)
+{
+    int value = 0;
+    socklen_t length = sizeof(value);
+    getsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, &length);
+    return value;
+}
+
+int main()
+{
+    std::print("test: {} ... ", TEST_NAME);
+
+    /* file contents served from offset 3 */
+    char file_template[] = "/tmp/torr_wire_writer_XXXXXX";
+    int file_fd = mkstemp(file_template);
+    assert(file_fd >= 0);
+    unlink(file_template);
+    std::string file_contents = "---file range of twenty bytes---";
+    assert(write(file_fd, file_contents.data(), file_contents.size()) == (ssize_t)file_contents.size());
+    auto file = std::make_shared<file_descriptor>(file_fd);
+
+    /* short writes at every byte count, granted by a send limit that never refills by itself */
+    int pair[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) == 0);
+    torr::tcp sender;
+    sender.adopt(pair[0]);
+    torr::token_bucket grants;
+    grants.set_rate(1, 1 << 20);
+    grants.request(1 << 20);
+    sender.set_rate_limits(nullptr, &grants);
+
+    std::string external = "external bytes";
+    std::string expected = "head" + external + file_contents.substr(3, 20) + "tail";
+    for (size_t step = 1; step <= expected.size(); ++step) {
+        torr::wire_writer writer;
+        writer.queue(bytes("he"));
+        writer.queue(bytes("ad"));
+        writer.queue_external(bytes(external));
+        writer.queue_file(file, 3, 20);
+        writer.queue(bytes("tail"));
+        assert(writer.queued() == expected.size());
+        grants.request(1 << 20);
+
+        std::string received;
+        while (!writer.empty()) {
+            grants.refund(step);
+            size_t queued = writer.queued();
+            auto sent = writer.flush(sender);
+            assert(sent.has_value() && sent.value() <= step && "failed due to a send over the grant");
+            assert(writer.queued() == queued - sent.value() && "failed due to queued bytes not dropped");
+            received += receive_all(pair[1]);
+        }
+        assert(received == expected && "failed due to bytes lost or repeated across segments");
+    }
+    sender.set_rate_limits(nullptr, nullptr);
+
+    /* drain moves the memory in front of a file range, not past it */
+    {
+        torr::wire_writer writer;
+        writer.queue(bytes("head"));
+        writer.queue_external(bytes(external));
+        writer.queue_file(file, 3, 20);
+        writer.queue(bytes("tail"));
+
+        std::vector<std::byte> out;
+        assert(writer.drain(out) == 4 + external.size() && "failed due to drain not stopping at the file range");
+        assert(std::string((const char*)out.data(), out.size()) == "head" + external);
+        assert(writer.drain(out) == 0 && writer.queued() == 24 && "failed due to drain at a file range");
+
+        auto sent = writer.flush(sender);
+        assert(sent.has_value() && sent.value() == 24 && writer.empty());
+        assert(receive_all(pair[1]) == file_contents.substr(3, 20) + "tail");
+    }
+
+    /* the copy buffer drops sent bytes while the queue never runs empty */
+    {
+        torr::wire_writer writer;
+        std::string message(1000, 'm');
+        size_t sent_total = 0;
+        size_t queued_total = 0;
+        sender.set_rate_limits(nullptr, &grants);
+        for (int turn = 0; turn < 1000; ++turn) {
+            writer.queue(bytes(message));
+            queued_total += message.size();
+            grants.refund(message.size() - (turn % 2 ? 0 : 1));
+            sent_total += writer.flush(sender).value();
+            receive_all(pair[1]);
+            assert(writer.buffered() < 4 * WIRE_WRITER_COMPACT_THRESHOLD && "failed due to sent bytes kept");
+        }
+        assert(writer.queued() == queued_total - sent_total && writer.queued() > 0);
+        grants.refund(writer.queued());
+        writer.flush(sender);
+        assert(writer.empty() && writer.buffered() == 0);
+        receive_all(pair[1]);
+        sender.set_rate_limits(nullptr, nullptr);
+    }
+
+    /* a burst is corked while it goes out, never left corked */
+    int connection[2];
+    tcp_pair(connection);
+    torr::tcp corked_sender;
+    corked_sender.adopt(connection[0]);
+    corked_sender.set_rate_limits(nullptr, &grants);
+    {
+        torr::wire_writer writer;
+        writer.queue(bytes("head"));
+        writer.queue_file(file, 3, 20);
+        grants.refund(10);
+        assert(writer.flush(corked_sender).value() == 10 && !writer.empty());
+        assert(!corked(connection[0]) && "failed due to a partial flush left corked");
+        grants.refund(14);
+        assert(writer.flush(corked_sender).value() == 14 && writer.empty());
+        assert(!corked(connection[0]) && "failed due to a flush left corked");
+
+        /* an error on the socket releases the cork as well */
+        corked_sender.set_rate_limits(nullptr, nullptr);
+        close(connection[1]);
+        std::string burst(1 << 20, 'b');
+        writer.queue(bytes(burst));
+        writer.queue_file(file, 3, 20);
+        std::expected<size_t, const char*> result;
+        for (int i = 0; i < 100 && (result = writer.flush(corked_sender)).has_value(); ++i)
+            usleep(1000);
+        assert(!result.has_value() && "failed due to a send to a closed connection succeeding");
+        assert(!corked(connection[0]) && "failed due to an error left corked");
+    }
+
+    close(pair[1]);
+    std::println("passed");
+    return 0;
+}